@@ -0,0 +1,290 @@
+#include "cue2pb/archive.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <utility>
+#include <unistd.h>
+
+#include "google/protobuf/io/coded_stream.h"
+#include "util/errno.h"
+#include "util/status_builder.h"
+#include "util/status_macros.h"
+
+namespace cue2pb {
+namespace {
+
+using ::google::protobuf::io::CodedInputStream;
+using ::google::protobuf::io::CodedOutputStream;
+
+constexpr std::string_view kHeaderMagic = "CUEPBS01";
+constexpr std::string_view kTrailerMagic = "CUEPBIDX";
+constexpr size_t kEntrySize = 24;
+constexpr size_t kTrailerSize = 32;
+
+// Flush the writer's buffer once it holds this much.
+constexpr size_t kFlushThreshold = 1 << 20;
+
+void AppendFixed32(uint32_t value, std::string *output) {
+  uint8_t buf[sizeof(value)];
+  CodedOutputStream::WriteLittleEndian32ToArray(value, buf);
+  output->append(reinterpret_cast<char*>(buf), sizeof(buf));
+}
+
+void AppendFixed64(uint64_t value, std::string *output) {
+  uint8_t buf[sizeof(value)];
+  CodedOutputStream::WriteLittleEndian64ToArray(value, buf);
+  output->append(reinterpret_cast<char*>(buf), sizeof(buf));
+}
+
+uint32_t ReadFixed32(const char *data) {
+  uint32_t value;
+  CodedInputStream::ReadLittleEndian32FromArray(
+      reinterpret_cast<const uint8_t*>(data), &value);
+  return value;
+}
+
+uint64_t ReadFixed64(const char *data) {
+  uint64_t value;
+  CodedInputStream::ReadLittleEndian64FromArray(
+      reinterpret_cast<const uint8_t*>(data), &value);
+  return value;
+}
+
+}  // namespace
+
+absl::StatusOr<ArchiveWriter> ArchiveWriter::Create(std::string_view path) {
+  std::string tmp_path;
+  ASSIGN_OR_RETURN(int fd, util::CreateTempFile(path, &tmp_path));
+  ArchiveWriter writer(fd, std::string(path), std::move(tmp_path));
+  writer.buffer_.append(kHeaderMagic);
+  writer.offset_ = kHeaderMagic.size();
+  return std::move(writer);
+}
+
+ArchiveWriter::ArchiveWriter(int fd, std::string path, std::string tmp_path)
+  : fd_(fd), path_(std::move(path)), tmp_path_(std::move(tmp_path))
+  {}
+
+ArchiveWriter::ArchiveWriter(ArchiveWriter &&other)
+  : fd_(std::exchange(other.fd_, -1)),
+    path_(std::move(other.path_)),
+    tmp_path_(std::move(other.tmp_path_)),
+    write_status_(std::move(other.write_status_)),
+    offset_(other.offset_),
+    buffer_(std::move(other.buffer_)),
+    entries_(std::move(other.entries_)),
+    keys_(std::move(other.keys_))
+  {}
+
+ArchiveWriter::~ArchiveWriter() {
+  if (fd_ != -1) Discard();
+}
+
+void ArchiveWriter::Discard() {
+  close(std::exchange(fd_, -1));
+  unlink(tmp_path_.c_str());
+}
+
+absl::Status ArchiveWriter::Add(std::string_view key,
+                                const Cuesheet &cuesheet) {
+  return AddSerialized(key, cuesheet.SerializeAsString());
+}
+
+absl::Status ArchiveWriter::AddSerialized(std::string_view key,
+                                          std::string_view cuesheet) {
+  if (fd_ == -1) {
+    return util::FailedPreconditionErrorBuilder() << "Archive is closed";
+  }
+  RETURN_IF_ERROR(write_status_);
+  if (cuesheet.size() > UINT32_MAX || key.size() > UINT32_MAX) {
+    return util::InvalidArgumentErrorBuilder()
+        << "Record for " << key << " is too large";
+  }
+
+  uint8_t buf[10];  // The longest a varint64 can be.
+  uint8_t *end = CodedOutputStream::WriteVarint64ToArray(cuesheet.size(), buf);
+  buffer_.append(reinterpret_cast<char*>(buf), end - buf);
+  offset_ += end - buf;
+
+  entries_.push_back(Entry{
+      offset_, static_cast<uint32_t>(cuesheet.size()),
+      static_cast<uint32_t>(key.size()), keys_.size()});
+  keys_.append(key);
+
+  buffer_.append(cuesheet);
+  offset_ += cuesheet.size();
+  if (buffer_.size() >= kFlushThreshold) return Flush();
+  return absl::OkStatus();
+}
+
+absl::Status ArchiveWriter::Flush() {
+  RETURN_IF_ERROR(write_status_);
+  absl::Status st = util::WriteFully(fd_, buffer_);
+  buffer_.clear();
+  if (!st.ok()) {
+    write_status_ = util::StatusBuilder(st) << "Failed to write " << path_;
+  }
+  return write_status_;
+}
+
+absl::Status ArchiveWriter::Finish() {
+  if (fd_ == -1) {
+    return util::FailedPreconditionErrorBuilder() << "Archive is closed";
+  }
+  if (!write_status_.ok()) {
+    Discard();
+    return write_status_;
+  }
+
+  auto key_of = [this](const Entry &entry) {
+    return std::string_view(keys_).substr(entry.key_offset, entry.key_size);
+  };
+  std::sort(entries_.begin(), entries_.end(),
+            [&](const Entry &a, const Entry &b) {
+              return key_of(a) < key_of(b);
+            });
+  for (size_t i = 1; i < entries_.size(); i++) {
+    if (key_of(entries_[i - 1]) == key_of(entries_[i])) {
+      return util::InvalidArgumentErrorBuilder()
+          << "Duplicate archive key " << key_of(entries_[i]);
+    }
+  }
+
+  uint64_t entries_offset = offset_;
+  for (const Entry &entry : entries_) {
+    AppendFixed64(entry.offset, &buffer_);
+    AppendFixed32(entry.size, &buffer_);
+    AppendFixed32(entry.key_size, &buffer_);
+    AppendFixed64(entry.key_offset, &buffer_);
+  }
+  uint64_t keys_offset = entries_offset + entries_.size() * kEntrySize;
+  buffer_.append(keys_);
+
+  AppendFixed64(entries_offset, &buffer_);
+  AppendFixed64(entries_.size(), &buffer_);
+  AppendFixed64(keys_offset, &buffer_);
+  buffer_.append(kTrailerMagic);
+
+  absl::Status st = Flush();
+  if (st.ok() && close(std::exchange(fd_, -1)) == -1) {
+    st = util::StatusBuilder(util::ErrnoAsStatus())
+        << "Failed to write " << path_;
+  }
+  if (st.ok() && rename(tmp_path_.c_str(), path_.c_str()) == -1) {
+    st = util::StatusBuilder(util::ErrnoAsStatus())
+        << "Failed to rename " << tmp_path_ << " to " << path_;
+  }
+  if (!st.ok()) {
+    if (fd_ != -1) close(std::exchange(fd_, -1));
+    unlink(tmp_path_.c_str());
+  }
+  return st;
+}
+
+bool ArchiveReader::IsArchive(std::string_view contents) {
+  return contents.size() >= kHeaderMagic.size() + kTrailerSize &&
+      contents.substr(0, kHeaderMagic.size()) == kHeaderMagic &&
+      contents.substr(contents.size() - kTrailerMagic.size()) == kTrailerMagic;
+}
+
+absl::StatusOr<ArchiveReader> ArchiveReader::Open(std::string_view path) {
+  ASSIGN_OR_RETURN(util::MappedFile file, util::MappedFile::Open(path));
+  absl::StatusOr<ArchiveReader> reader = Open(std::move(file));
+  if (!reader.ok()) {
+    return util::StatusBuilder(reader.status()) << ": " << path;
+  }
+  return reader;
+}
+
+absl::StatusOr<ArchiveReader> ArchiveReader::Open(util::MappedFile file) {
+  std::string_view contents = file.contents();
+  if (!IsArchive(contents)) {
+    return util::InvalidArgumentErrorBuilder() << "Not a cuesheet archive";
+  }
+
+  const char *trailer = contents.data() + contents.size() - kTrailerSize;
+  uint64_t entries_offset = ReadFixed64(trailer);
+  uint64_t num_entries = ReadFixed64(trailer + 8);
+  uint64_t keys_offset = ReadFixed64(trailer + 16);
+  uint64_t keys_end = contents.size() - kTrailerSize;
+
+  // Every entry is checked up front, so that lookups don't have to be.
+  bool valid = entries_offset >= kHeaderMagic.size() &&
+      entries_offset <= keys_end &&
+      num_entries <= (keys_end - entries_offset) / kEntrySize &&
+      keys_offset == entries_offset + num_entries * kEntrySize;
+  for (uint64_t i = 0; valid && i < num_entries; i++) {
+    const char *entry = contents.data() + entries_offset + i * kEntrySize;
+    uint64_t offset = ReadFixed64(entry);
+    uint64_t size = ReadFixed32(entry + 8);
+    uint64_t key_size = ReadFixed32(entry + 12);
+    uint64_t key_offset = ReadFixed64(entry + 16);
+    valid = offset <= entries_offset && size <= entries_offset - offset &&
+        key_offset <= keys_end - keys_offset &&
+        key_size <= keys_end - keys_offset - key_offset;
+  }
+  if (!valid) {
+    return util::DataLossErrorBuilder() << "Corrupt archive index";
+  }
+
+  return ArchiveReader(std::move(file), entries_offset, num_entries,
+                       keys_offset);
+}
+
+ArchiveReader::ArchiveReader(util::MappedFile file, size_t entries_offset,
+                             size_t num_entries, size_t keys_offset)
+  : file_(std::move(file)),
+    entries_offset_(entries_offset),
+    num_entries_(num_entries),
+    keys_offset_(keys_offset)
+  {}
+
+const char *ArchiveReader::entry(size_t i) const {
+  return file_.contents().data() + entries_offset_ + i * kEntrySize;
+}
+
+std::string_view ArchiveReader::key(size_t i) const {
+  const char *e = entry(i);
+  return file_.contents().substr(keys_offset_ + ReadFixed64(e + 16),
+                                 ReadFixed32(e + 12));
+}
+
+std::string_view ArchiveReader::record(size_t i) const {
+  const char *e = entry(i);
+  return file_.contents().substr(ReadFixed64(e), ReadFixed32(e + 8));
+}
+
+uint64_t ArchiveReader::offset(size_t i) const {
+  return ReadFixed64(entry(i));
+}
+
+absl::StatusOr<std::string_view> ArchiveReader::Find(
+    std::string_view key) const {
+  size_t lo = 0;
+  size_t hi = num_entries_;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (this->key(mid) < key) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo == num_entries_ || this->key(lo) != key) {
+    return util::NotFoundErrorBuilder() << "No archive record for " << key;
+  }
+  return record(lo);
+}
+
+absl::Status ArchiveReader::Read(std::string_view key,
+                                 Cuesheet *cuesheet) const {
+  ASSIGN_OR_RETURN(std::string_view serialized, Find(key));
+  if (!cuesheet->ParseFromArray(serialized.data(), serialized.size())) {
+    return util::DataLossErrorBuilder()
+        << "Failed to parse archive record for " << key;
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace cue2pb
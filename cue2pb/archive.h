@@ -0,0 +1,131 @@
+#ifndef CUE2PB_ARCHIVE_H_
+#define CUE2PB_ARCHIVE_H_
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "cue2pb/cuesheet.pb.h"
+#include "util/file.h"
+
+// A cuesheet archive (.cuepbs) holds many serialized Cuesheets in one file,
+// with an index so that any one of them can be found without reading the
+// others. The layout, with every integer little-endian, is:
+//
+//   "CUEPBS01"
+//   records: for each Cuesheet, a varint length and then the Cuesheet
+//   index entries: one per record, sorted by key, each
+//       uint64 offset of the Cuesheet (just past its varint length)
+//       uint32 size of the Cuesheet
+//       uint32 size of the key
+//       uint64 offset of the key within the keys
+//   keys: every key, concatenated
+//   trailer:
+//       uint64 offset of the index entries
+//       uint64 number of index entries
+//       uint64 offset of the keys
+//       "CUEPBIDX"
+//
+// The records on their own are the same varint length-delimited stream that
+// `cue2pb` writes to stdout when converting many files.
+
+namespace cue2pb {
+
+class ArchiveWriter {
+ public:
+  // Starts an archive to be written to path. It's written to a temporary file
+  // next to path, which only replaces path once Finish() succeeds, so readers
+  // never see a partial archive.
+  static absl::StatusOr<ArchiveWriter> Create(std::string_view path);
+
+  ArchiveWriter(ArchiveWriter &&other);
+  ArchiveWriter &operator=(ArchiveWriter &&other) = delete;
+  ArchiveWriter(const ArchiveWriter &) = delete;
+  ArchiveWriter &operator=(const ArchiveWriter &) = delete;
+
+  // Discards the archive if Finish() wasn't called, or failed.
+  ~ArchiveWriter();
+
+  absl::Status Add(std::string_view key, const Cuesheet &cuesheet);
+
+  // Adds an already serialized Cuesheet.
+  absl::Status AddSerialized(std::string_view key, std::string_view cuesheet);
+
+  // Writes the index, and moves the archive into place. Keys must be unique.
+  //
+  // Once a write has failed, it's returned from every later call, and the
+  // archive is discarded rather than finished.
+  absl::Status Finish();
+
+ private:
+  struct Entry {
+    uint64_t offset;
+    uint32_t size;
+    uint32_t key_size;
+    uint64_t key_offset;
+  };
+
+  ArchiveWriter(int fd, std::string path, std::string tmp_path);
+
+  absl::Status Flush();
+
+  // Closes and removes the temporary file.
+  void Discard();
+
+  int fd_;
+  std::string path_;
+  std::string tmp_path_;
+  // The first failed write.
+  absl::Status write_status_;
+  uint64_t offset_ = 0;
+  std::string buffer_;
+  std::vector<Entry> entries_;
+  std::string keys_;
+};
+
+class ArchiveReader {
+ public:
+  // Returns whether contents look like an archive.
+  static bool IsArchive(std::string_view contents);
+
+  static absl::StatusOr<ArchiveReader> Open(std::string_view path);
+  static absl::StatusOr<ArchiveReader> Open(util::MappedFile file);
+
+  // The number of records.
+  size_t size() const { return num_entries_; }
+
+  // The i'th key in sorted order, and its serialized Cuesheet.
+  std::string_view key(size_t i) const;
+  std::string_view record(size_t i) const;
+
+  // Finds a record by key, returning its serialized Cuesheet.
+  absl::StatusOr<std::string_view> Find(std::string_view key) const;
+
+  // Finds and parses a record.
+  absl::Status Read(std::string_view key, Cuesheet *cuesheet) const;
+
+  // The offset in the archive of the i'th key's record.
+  uint64_t offset(size_t i) const;
+
+ private:
+  ArchiveReader(util::MappedFile file, size_t entries_offset,
+                size_t num_entries, size_t keys_offset);
+
+  // The fixed-size index entry for the i'th key.
+  const char *entry(size_t i) const;
+
+  // Offsets rather than pointers, since a MappedFile that had to read its
+  // contents into memory moves them when it's moved.
+  util::MappedFile file_;
+  size_t entries_offset_;
+  size_t num_entries_;
+  size_t keys_offset_;
+};
+
+}  // namespace cue2pb
+
+#endif  // CUE2PB_ARCHIVE_H_
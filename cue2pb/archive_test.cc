@@ -0,0 +1,191 @@
+#include "cue2pb/archive.h"
+
+#include <string>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "cue2pb/cuesheet.pb.h"
+#include "cue2pb/text_format.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "util/file.h"
+#include "util/testing/assertions.h"
+#include "util/testing/protobuf_assertions.h"
+
+namespace cue2pb {
+
+using ::util::IsEqual;
+using ::util::IsOk;
+
+namespace {
+
+constexpr const char *kTestdata[] = {
+  "eac_multifile_gapless", "eac_singlefile", "full_disc", "hidden_track",
+};
+
+Cuesheet CuesheetFromProtoFileOrDie(std::string_view name) {
+  auto mapped = util::MappedFile::Open(
+      "cue2pb/testdata/" + std::string(name) + ".textproto");
+  return CuesheetFromTextProto(mapped->contents()).value();
+}
+
+class ArchiveTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    char path_template[] = "/tmp/archive_test.XXXXXX";
+    int fd = mkstemp(path_template);
+    ASSERT_NE(-1, fd);
+    close(fd);
+    path_ = path_template;
+  }
+
+  void TearDown() override { unlink(path_.c_str()); }
+
+  std::string path_;
+};
+
+TEST_F(ArchiveTest, FindsEveryRecord) {
+  {
+    auto writer = ArchiveWriter::Create(path_);
+    ASSERT_TRUE(IsOk(writer));
+    // Added in reverse, so that the index has to sort them.
+    for (int i = std::size(kTestdata) - 1; i >= 0; i--) {
+      ASSERT_TRUE(IsOk(writer->Add(
+          kTestdata[i], CuesheetFromProtoFileOrDie(kTestdata[i]))));
+    }
+    ASSERT_TRUE(IsOk(writer->Finish()));
+  }
+
+  auto reader = ArchiveReader::Open(path_);
+  ASSERT_TRUE(IsOk(reader));
+  ASSERT_EQ(std::size(kTestdata), reader->size());
+  for (size_t i = 0; i < std::size(kTestdata); i++) {
+    EXPECT_EQ(kTestdata[i], reader->key(i));
+
+    Cuesheet found;
+    ASSERT_TRUE(IsOk(reader->Read(kTestdata[i], &found)));
+    EXPECT_TRUE(IsEqual(CuesheetFromProtoFileOrDie(kTestdata[i]), found));
+  }
+
+  Cuesheet found;
+  EXPECT_FALSE(IsOk(reader->Read("does_not_exist", &found)));
+  EXPECT_FALSE(IsOk(reader->Read("", &found)));
+}
+
+TEST_F(ArchiveTest, RecordsAreADelimitedStream) {
+  {
+    auto writer = ArchiveWriter::Create(path_);
+    ASSERT_TRUE(IsOk(writer));
+    for (const char *name : kTestdata) {
+      ASSERT_TRUE(IsOk(writer->Add(name, CuesheetFromProtoFileOrDie(name))));
+    }
+    ASSERT_TRUE(IsOk(writer->Finish()));
+  }
+
+  auto mapped = util::MappedFile::Open(path_);
+  ASSERT_TRUE(IsOk(mapped));
+  std::string_view contents = mapped->contents();
+  contents.remove_prefix(8);
+  google::protobuf::io::CodedInputStream in(
+      reinterpret_cast<const uint8_t*>(contents.data()), contents.size());
+  for (const char *name : kTestdata) {
+    uint32_t size;
+    ASSERT_TRUE(in.ReadVarint32(&size));
+    auto limit = in.PushLimit(size);
+    Cuesheet found;
+    ASSERT_TRUE(found.ParseFromCodedStream(&in));
+    in.PopLimit(limit);
+    EXPECT_TRUE(IsEqual(CuesheetFromProtoFileOrDie(name), found)) << name;
+  }
+}
+
+TEST_F(ArchiveTest, Empty) {
+  {
+    auto writer = ArchiveWriter::Create(path_);
+    ASSERT_TRUE(IsOk(writer));
+    ASSERT_TRUE(IsOk(writer->Finish()));
+  }
+
+  auto reader = ArchiveReader::Open(path_);
+  ASSERT_TRUE(IsOk(reader));
+  EXPECT_EQ(0, reader->size());
+  EXPECT_FALSE(IsOk(reader->Find("")));
+}
+
+TEST_F(ArchiveTest, RejectsDuplicateKeys) {
+  auto writer = ArchiveWriter::Create(path_);
+  ASSERT_TRUE(IsOk(writer));
+  ASSERT_TRUE(IsOk(writer->AddSerialized("a", "")));
+  ASSERT_TRUE(IsOk(writer->AddSerialized("a", "")));
+  EXPECT_FALSE(IsOk(writer->Finish()));
+}
+
+TEST_F(ArchiveTest, WriteFailureDiscardsArchive) {
+  ASSERT_TRUE(IsOk(util::WriteFile(path_, "previous contents")));
+
+  // Writes past 64KiB fail with EFBIG rather than raising SIGXFSZ.
+  signal(SIGXFSZ, SIG_IGN);
+  struct rlimit old_limit;
+  ASSERT_EQ(0, getrlimit(RLIMIT_FSIZE, &old_limit));
+  struct rlimit limit = old_limit;
+  limit.rlim_cur = 64 * 1024;
+  ASSERT_EQ(0, setrlimit(RLIMIT_FSIZE, &limit));
+
+  absl::Status added;
+  absl::Status finished;
+  {
+    auto writer = ArchiveWriter::Create(path_);
+    ASSERT_TRUE(IsOk(writer));
+    std::string record(1 << 20, 'x');
+    added = writer->AddSerialized("a", record);
+    // Later calls return the same error, without writing.
+    EXPECT_EQ(added, writer->AddSerialized("b", "y"));
+    finished = writer->Finish();
+  }
+  ASSERT_EQ(0, setrlimit(RLIMIT_FSIZE, &old_limit));
+
+  EXPECT_FALSE(IsOk(added));
+  EXPECT_EQ(added, finished);
+  auto mapped = util::MappedFile::Open(path_);
+  ASSERT_TRUE(IsOk(mapped));
+  EXPECT_EQ("previous contents", mapped->contents());
+}
+
+TEST_F(ArchiveTest, UnfinishedArchiveIsDiscarded) {
+  ASSERT_TRUE(IsOk(util::WriteFile(path_, "previous contents")));
+  {
+    auto writer = ArchiveWriter::Create(path_);
+    ASSERT_TRUE(IsOk(writer));
+    ASSERT_TRUE(IsOk(writer->AddSerialized("a", "")));
+  }
+  auto mapped = util::MappedFile::Open(path_);
+  ASSERT_TRUE(IsOk(mapped));
+  EXPECT_EQ("previous contents", mapped->contents());
+}
+
+TEST_F(ArchiveTest, RejectsCorruptIndex) {
+  {
+    auto writer = ArchiveWriter::Create(path_);
+    ASSERT_TRUE(IsOk(writer));
+    ASSERT_TRUE(IsOk(writer->AddSerialized("a", "record")));
+    ASSERT_TRUE(IsOk(writer->Finish()));
+  }
+  std::string contents(util::MappedFile::Open(path_)->contents());
+
+  // Point the index entry's record past the end of the file.
+  std::string corrupt = contents;
+  size_t entry = 8 + 1 + 6;
+  corrupt[entry + 1] = '\x7f';
+  ASSERT_TRUE(IsOk(util::WriteFile(path_, corrupt)));
+  EXPECT_FALSE(IsOk(ArchiveReader::Open(path_)));
+
+  ASSERT_TRUE(IsOk(util::WriteFile(path_, contents.substr(1))));
+  EXPECT_FALSE(IsOk(ArchiveReader::Open(path_)));
+  EXPECT_FALSE(ArchiveReader::IsArchive("CUEPBS01CUEPBIDX"));
+}
+
+}  // namespace
+}  // namespace cue2pb
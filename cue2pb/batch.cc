@@ -0,0 +1,173 @@
+#include "cue2pb/batch.h"
+
+#include <memory>
+#include <utility>
+#include <vector>
+#include <stddef.h>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/strings/str_split.h"
+#include "absl/synchronization/mutex.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "util/file.h"
+#include "util/status_builder.h"
+#include "util/status_macros.h"
+#include "util/thread_pool.h"
+
+namespace cue2pb {
+namespace {
+
+absl::Status Convert(const std::string &input, const BatchOptions &options,
+                     std::string *output) {
+  if (input == "-" && !options.output_suffix.empty()) {
+    return util::InvalidArgumentErrorBuilder()
+        << "Stdin has no sibling to write to with an output suffix";
+  }
+  ASSIGN_OR_RETURN(util::MappedFile mapped, OpenInput(input));
+  if (options.proto_to_cue) {
+    return ProtoToCue(mapped.contents(), options.format, output);
+  }
+  return CueToProto(mapped.contents(), options.format, options.cache, output);
+}
+
+// Streamed records are written once this many bytes of them are pending.
+constexpr size_t kWriteThreshold = 64 * 1024;
+
+void AppendVarint(uint64_t value, std::string *output) {
+  uint8_t buf[10];  // The longest a varint64 can be.
+  uint8_t *end =
+      google::protobuf::io::CodedOutputStream::WriteVarint64ToArray(value, buf);
+  output->append(reinterpret_cast<char*>(buf), end - buf);
+}
+
+// A bounded window of in-flight conversions, so that results can be written
+// in input order without holding every output in memory at once.
+class Window {
+ public:
+  struct Slot {
+    bool done = false;
+    absl::Status status;
+    std::string output;
+  };
+
+  explicit Window(size_t size)
+    : slots_(size)
+    {}
+
+  size_t size() const { return slots_.size(); }
+
+  Slot *slot(size_t i) { return &slots_[i % slots_.size()]; }
+
+  void MarkDone(size_t i) {
+    absl::MutexLock lock(&mu_);
+    slot(i)->done = true;
+  }
+
+  // Waits for input i to finish, and returns its slot. The slot is reused
+  // once the caller schedules input i + size().
+  Slot *Await(size_t i) {
+    Slot *s = slot(i);
+    absl::MutexLock lock(&mu_);
+    mu_.Await(absl::Condition(&s->done));
+    s->done = false;
+    return s;
+  }
+
+ private:
+  absl::Mutex mu_;
+  std::vector<Slot> slots_;
+};
+
+}  // namespace
+
+absl::StatusOr<util::MappedFile> OpenInput(std::string_view path) {
+  return util::MappedFile::Open(path == "-" ? "/dev/stdin" : path);
+}
+
+std::string SiblingOutputPath(std::string_view path, std::string_view suffix) {
+  size_t slash = path.rfind('/');
+  size_t dot = path.rfind('.');
+  if (dot != std::string_view::npos &&
+      (slash == std::string_view::npos || dot > slash + 1)) {
+    path = path.substr(0, dot);
+  }
+  return std::string(path) + std::string(suffix);
+}
+
+absl::Status ConvertFiles(absl::Span<const std::string> inputs,
+                          const BatchOptions &options, int output_fd,
+                          std::ostream *errors) {
+  util::ThreadPool pool(options.jobs);
+  Window window(4 * pool.num_threads());
+  bool to_stream = options.output_suffix.empty() && options.archive == nullptr;
+
+  auto schedule = [&](size_t i) {
+    pool.Schedule([&, i] {
+      Window::Slot *slot = window.slot(i);
+      slot->output.clear();
+      slot->status = Convert(inputs[i], options, &slot->output);
+      if (slot->status.ok() && !options.output_suffix.empty()) {
+        slot->status = util::WriteFile(
+            SiblingOutputPath(inputs[i], options.output_suffix),
+            slot->output);
+      }
+      window.MarkDone(i);
+    });
+  };
+
+  size_t scheduled = 0;
+  size_t failures = 0;
+  absl::Status write_status;
+  // Records are collected into larger writes, rather than one per file.
+  std::string pending;
+  for (size_t i = 0; i < inputs.size(); i++) {
+    for (; scheduled < inputs.size() && scheduled < i + window.size();
+         scheduled++) {
+      schedule(scheduled);
+    }
+
+    Window::Slot *slot = window.Await(i);
+    if (!slot->status.ok()) {
+      failures++;
+      *errors << inputs[i] << " (input " << i << "): " << slot->status
+              << std::endl;
+      // Streamed records stay aligned with the inputs.
+      if (!to_stream) continue;
+      slot->output.clear();
+    }
+    if (!write_status.ok()) continue;
+    if (options.archive != nullptr) {
+      write_status = options.archive->AddSerialized(inputs[i], slot->output);
+    } else if (to_stream) {
+      AppendVarint(slot->output.size(), &pending);
+      pending.append(slot->output);
+      if (pending.size() >= kWriteThreshold) {
+        write_status = util::WriteFully(output_fd, pending);
+        pending.clear();
+      }
+    }
+  }
+  if (write_status.ok() && !pending.empty()) {
+    write_status = util::WriteFully(output_fd, pending);
+  }
+
+  RETURN_IF_ERROR(write_status);
+  if (failures != 0) {
+    return util::UnknownErrorBuilder()
+        << failures << " of " << inputs.size() << " files failed to convert";
+  }
+  return absl::OkStatus();
+}
+
+absl::Status ReadFileList(std::string_view path,
+                          std::vector<std::string> *out) {
+  ASSIGN_OR_RETURN(util::MappedFile mapped, OpenInput(path));
+  for (std::string_view line :
+       absl::StrSplit(mapped.contents(), '\n', absl::SkipEmpty())) {
+    if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+    if (!line.empty()) out->emplace_back(line);
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace cue2pb
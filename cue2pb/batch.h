@@ -0,0 +1,62 @@
+#ifndef CUE2PB_BATCH_H_
+#define CUE2PB_BATCH_H_
+
+#include <ostream>
+#include <string>
+#include <string_view>
+
+#include "absl/status/status.h"
+#include "absl/types/span.h"
+#include "cue2pb/archive.h"
+#include "cue2pb/convert.h"
+#include "util/file.h"
+
+// Converting many files at once, as done by the cue2pb binary when given more
+// than one input.
+
+namespace cue2pb {
+
+struct BatchOptions {
+  // Convert protos to cuesheets, rather than cuesheets to protos.
+  bool proto_to_cue = false;
+  ProtoFormat format = ProtoFormat::kBinary;
+
+  // Conversion threads. <= 0 means one per CPU.
+  int jobs = 0;
+
+  // If set, each input's output is written next to it, with its extension
+  // replaced by this suffix. Otherwise outputs are written to the output fd as
+  // one stream of varint length-delimited records, one per input in input
+  // order; an input that fails to convert has an empty record. Stdin ("-")
+  // has no sibling, so it can only be streamed.
+  std::string output_suffix;
+
+  // If set, binary protos are added to this archive, keyed by input path,
+  // instead of being written to the output fd. The caller finishes it.
+  ArchiveWriter *archive = nullptr;
+
+  // If set, cuesheets are looked up in and added to this cache.
+  const ParseCache *cache = nullptr;
+};
+
+// Returns the sibling of path that BatchOptions::output_suffix names.
+std::string SiblingOutputPath(std::string_view path, std::string_view suffix);
+
+// Maps the input at path, or reads stdin if path is "-".
+absl::StatusOr<util::MappedFile> OpenInput(std::string_view path);
+
+// Converts every input, each opened with OpenInput(). A file that fails to
+// convert is reported to errors along with its index in inputs, and doesn't
+// stop the others. It has no output, except that when streaming it gets an
+// empty record, the same as a valid but empty Cuesheet; errors tells the two
+// apart. Returns an error if any file failed.
+absl::Status ConvertFiles(absl::Span<const std::string> inputs,
+                          const BatchOptions &options, int output_fd,
+                          std::ostream *errors);
+
+// Reads a list of paths, one per line, from path (opened with OpenInput()).
+absl::Status ReadFileList(std::string_view path, std::vector<std::string> *out);
+
+}  // namespace cue2pb
+
+#endif  // CUE2PB_BATCH_H_
@@ -0,0 +1,164 @@
+#include "cue2pb/batch.h"
+
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "cue2pb/cuesheet.pb.h"
+#include "cue2pb/text_format.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "util/file.h"
+#include "util/testing/assertions.h"
+#include "util/testing/protobuf_assertions.h"
+
+namespace cue2pb {
+
+using ::util::IsEqual;
+using ::util::IsOk;
+
+namespace {
+
+constexpr const char *kTestdata[] = {
+  "eac_multifile_gapless", "eac_singlefile", "full_disc", "hidden_track",
+};
+
+std::string TestdataToPath(std::string_view filename) {
+  return "cue2pb/testdata/" + std::string(filename);
+}
+
+Cuesheet CuesheetFromProtoFileOrDie(std::string_view filename) {
+  auto mapped = util::MappedFile::Open(TestdataToPath(filename));
+  return CuesheetFromTextProto(mapped->contents()).value();
+}
+
+std::string ReadFd(int fd) {
+  std::string out;
+  char buf[4096];
+  ssize_t n;
+  lseek(fd, 0, SEEK_SET);
+  while ((n = read(fd, buf, sizeof(buf))) > 0) out.append(buf, n);
+  return out;
+}
+
+TEST(SiblingOutputPathTest, ReplacesExtension) {
+  EXPECT_EQ("a/b.cuepb", SiblingOutputPath("a/b.cue", ".cuepb"));
+  EXPECT_EQ("a.b/c.cuepb", SiblingOutputPath("a.b/c", ".cuepb"));
+  EXPECT_EQ("a/.hidden.cuepb", SiblingOutputPath("a/.hidden", ".cuepb"));
+  EXPECT_EQ("a/b.x.cuepb", SiblingOutputPath("a/b.x.cue", ".cuepb"));
+}
+
+TEST(ConvertFilesTest, StreamsRecordsInOrder) {
+  std::vector<std::string> inputs;
+  for (int i = 0; i < 5; i++) {
+    for (const char *name : kTestdata) {
+      inputs.push_back(TestdataToPath(std::string(name) + ".cue"));
+    }
+  }
+  inputs.insert(inputs.begin() + 3, "cue2pb/testdata/does_not_exist.cue");
+
+  FILE *out = tmpfile();
+  ASSERT_NE(nullptr, out);
+  BatchOptions options;
+  options.jobs = 3;
+  std::ostringstream errors;
+  EXPECT_FALSE(IsOk(ConvertFiles(inputs, options, fileno(out), &errors)));
+  EXPECT_NE(std::string::npos,
+            errors.str().find("does_not_exist.cue (input 3): "));
+
+  std::string records = ReadFd(fileno(out));
+  fclose(out);
+  google::protobuf::io::CodedInputStream in(
+      reinterpret_cast<const uint8_t*>(records.data()), records.size());
+  for (size_t i = 0; i < inputs.size(); i++) {
+    uint32_t size;
+    ASSERT_TRUE(in.ReadVarint32(&size));
+    // The missing file's record is empty, keeping the rest in place.
+    if (i == 3) {
+      EXPECT_EQ(0u, size);
+      continue;
+    }
+
+    size_t n = i < 3 ? i : i - 1;
+    const char *name = kTestdata[n % std::size(kTestdata)];
+    Cuesheet expected =
+        CuesheetFromProtoFileOrDie(std::string(name) + ".textproto");
+
+    auto limit = in.PushLimit(size);
+    Cuesheet found;
+    ASSERT_TRUE(found.ParseFromCodedStream(&in));
+    in.PopLimit(limit);
+    EXPECT_TRUE(IsEqual(expected, found)) << name;
+  }
+  EXPECT_TRUE(in.ExpectAtEnd());
+}
+
+TEST(ConvertFilesTest, ReadsStdinForDash) {
+  FILE *in = tmpfile();
+  ASSERT_NE(nullptr, in);
+  {
+    auto mapped = util::MappedFile::Open(TestdataToPath("hidden_track.cue"));
+    ASSERT_TRUE(IsOk(util::WriteFully(fileno(in), mapped->contents())));
+  }
+  lseek(fileno(in), 0, SEEK_SET);
+  int saved_stdin = dup(STDIN_FILENO);
+  ASSERT_EQ(STDIN_FILENO, dup2(fileno(in), STDIN_FILENO));
+
+  FILE *out = tmpfile();
+  ASSERT_NE(nullptr, out);
+  BatchOptions options;
+  std::ostringstream errors;
+  absl::Status st = ConvertFiles({"-"}, options, fileno(out), &errors);
+  dup2(saved_stdin, STDIN_FILENO);
+  close(saved_stdin);
+  fclose(in);
+  ASSERT_TRUE(IsOk(st)) << errors.str();
+
+  std::string records = ReadFd(fileno(out));
+  fclose(out);
+  google::protobuf::io::CodedInputStream stream(
+      reinterpret_cast<const uint8_t*>(records.data()), records.size());
+  uint32_t size;
+  ASSERT_TRUE(stream.ReadVarint32(&size));
+  auto limit = stream.PushLimit(size);
+  Cuesheet found;
+  ASSERT_TRUE(found.ParseFromCodedStream(&stream));
+  stream.PopLimit(limit);
+  EXPECT_TRUE(IsEqual(CuesheetFromProtoFileOrDie("hidden_track.textproto"),
+                      found));
+  EXPECT_TRUE(stream.ExpectAtEnd());
+}
+
+TEST(ConvertFilesTest, WritesSiblings) {
+  char dir_template[] = "/tmp/batch_test.XXXXXX";
+  std::string dir = mkdtemp(dir_template);
+  std::string input = dir + "/hidden_track.cue";
+  {
+    auto mapped = util::MappedFile::Open(TestdataToPath("hidden_track.cue"));
+    ASSERT_TRUE(IsOk(util::WriteFile(input, mapped->contents())));
+  }
+
+  BatchOptions options;
+  options.output_suffix = ".cuepb";
+  std::ostringstream errors;
+  ASSERT_TRUE(IsOk(ConvertFiles({input}, options, -1, &errors)));
+
+  auto mapped = util::MappedFile::Open(dir + "/hidden_track.cuepb");
+  ASSERT_TRUE(IsOk(mapped));
+  Cuesheet found;
+  ASSERT_TRUE(found.ParseFromArray(mapped->contents().data(),
+                                   mapped->contents().size()));
+  EXPECT_TRUE(IsEqual(CuesheetFromProtoFileOrDie("hidden_track.textproto"),
+                      found));
+
+  unlink(input.c_str());
+  unlink((dir + "/hidden_track.cuepb").c_str());
+  rmdir(dir.c_str());
+}
+
+}  // namespace
+}  // namespace cue2pb
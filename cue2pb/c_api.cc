@@ -0,0 +1,159 @@
+#include "cue2pb/c_api.h"
+
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "cue2pb/cuesheet.pb.h"
+#include "cue2pb/parser.h"
+#include "cue2pb/unparser.h"
+#include "google/protobuf/arena.h"
+#include "google/protobuf/io/coded_stream.h"
+
+namespace cue2pb {
+namespace {
+
+using ::google::protobuf::Arena;
+using ::google::protobuf::ArenaOptions;
+using ::google::protobuf::io::CodedOutputStream;
+
+// Each call's arena starts out on the stack, which is enough for a typical
+// cuesheet to be parsed without touching the heap. Arena needs the block
+// 8-byte aligned.
+constexpr size_t kArenaBlockSize = 16 * 1024;
+
+ArenaOptions StackArenaOptions(char *block) {
+  ArenaOptions options;
+  options.initial_block = block;
+  options.initial_block_size = kArenaBlockSize;
+  return options;
+}
+
+int Fail(const absl::Status &status, char **err) {
+  if (err != nullptr) {
+    std::string message(status.message());
+    *err = strdup(message.c_str());
+  }
+  return static_cast<int>(status.code());
+}
+
+// Returns where to write size bytes of output, as described in c_api.h, or
+// null if a buffer couldn't be allocated. Nothing is changed in that case.
+template <typename T>
+T *ReserveOutput(T **out, size_t *out_len, size_t size) {
+  T *dst = *out;
+  if (dst == nullptr || *out_len < size) {
+    dst = static_cast<T*>(std::malloc(size == 0 ? 1 : size));
+    if (dst == nullptr) return nullptr;
+  }
+  *out = dst;
+  *out_len = size;
+  return dst;
+}
+
+absl::Status OutOfMemory() {
+  return absl::ResourceExhaustedError("Failed to allocate output");
+}
+
+int Parse(const char *buf, size_t len, uint8_t **out, size_t *out_len,
+          char **err) {
+  alignas(8) char block[kArenaBlockSize];
+  Arena arena(StackArenaOptions(block));
+  absl::StatusOr<Cuesheet*> cuesheet =
+      ParseCuesheet(std::string_view(buf, len), &arena);
+  if (!cuesheet.ok()) return Fail(cuesheet.status(), err);
+
+  size_t size = (*cuesheet)->ByteSizeLong();
+  uint8_t *dst = ReserveOutput(out, out_len, size);
+  if (dst == nullptr) return Fail(OutOfMemory(), err);
+  (*cuesheet)->SerializeWithCachedSizesToArray(dst);
+  return 0;
+}
+
+int Unparse(const uint8_t *buf, size_t len, char **out, size_t *out_len,
+            char **err) {
+  alignas(8) char block[kArenaBlockSize];
+  Arena arena(StackArenaOptions(block));
+  Cuesheet *cuesheet = Arena::CreateMessage<Cuesheet>(&arena);
+  if (len > INT_MAX || !cuesheet->ParseFromArray(buf, static_cast<int>(len))) {
+    return Fail(absl::InvalidArgumentError("Failed to parse binary proto"),
+                err);
+  }
+
+  // Reused between calls, so that unparsing doesn't allocate once it has
+  // grown to fit.
+  thread_local std::string text;
+  text.clear();
+  if (absl::Status st = UnparseCuesheet(*cuesheet, &text); !st.ok()) {
+    return Fail(st, err);
+  }
+
+  char *dst = ReserveOutput(out, out_len, text.size());
+  if (dst == nullptr) return Fail(OutOfMemory(), err);
+  std::memcpy(dst, text.data(), text.size());
+  return 0;
+}
+
+int ParseBatch(const char *const *bufs, const size_t *lens, size_t n,
+               uint8_t **out, size_t *out_len, int *codes, char **err) {
+  alignas(8) char block[kArenaBlockSize];
+  Arena arena(StackArenaOptions(block));
+  std::vector<Cuesheet*> cuesheets(n);
+  absl::Status first_error;
+  size_t total = 0;
+  for (size_t i = 0; i < n; i++) {
+    absl::StatusOr<Cuesheet*> cuesheet =
+        ParseCuesheet(std::string_view(bufs[i], lens[i]), &arena);
+    if (codes != nullptr) codes[i] = static_cast<int>(cuesheet.status().code());
+    size_t size = 0;
+    if (cuesheet.ok()) {
+      cuesheets[i] = *cuesheet;
+      size = cuesheets[i]->ByteSizeLong();
+    } else {
+      first_error.Update(cuesheet.status());
+    }
+    total += CodedOutputStream::VarintSize64(size) + size;
+  }
+
+  uint8_t *dst = ReserveOutput(out, out_len, total);
+  if (dst == nullptr) return Fail(OutOfMemory(), err);
+  for (Cuesheet *cuesheet : cuesheets) {
+    if (cuesheet == nullptr) {
+      dst = CodedOutputStream::WriteVarint64ToArray(0, dst);
+      continue;
+    }
+    dst = CodedOutputStream::WriteVarint64ToArray(cuesheet->GetCachedSize(),
+                                                  dst);
+    dst = cuesheet->SerializeWithCachedSizesToArray(dst);
+  }
+
+  if (!first_error.ok()) return Fail(first_error, err);
+  return 0;
+}
+
+}  // namespace
+}  // namespace cue2pb
+
+extern "C" int cue2pb_parse(const char *buf, size_t len, uint8_t **out,
+                            size_t *out_len, char **err) {
+  return cue2pb::Parse(buf, len, out, out_len, err);
+}
+
+extern "C" int cue2pb_unparse(const uint8_t *buf, size_t len, char **out,
+                              size_t *out_len, char **err) {
+  return cue2pb::Unparse(buf, len, out, out_len, err);
+}
+
+extern "C" int cue2pb_parse_batch(const char *const *bufs, const size_t *lens,
+                                  size_t n, uint8_t **out, size_t *out_len,
+                                  int *codes, char **err) {
+  return cue2pb::ParseBatch(bufs, lens, n, out, out_len, codes, err);
+}
+
+extern "C" void cue2pb_free(void *ptr) {
+  std::free(ptr);
+}
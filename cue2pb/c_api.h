@@ -0,0 +1,54 @@
+#ifndef CUE2PB_C_API_H_
+#define CUE2PB_C_API_H_
+
+/*
+ * A C interface to the parser and unparser, for calling cue2pb in-process from
+ * other languages. Build //cue2pb:libcue2pb.so to get it as a shared library.
+ *
+ * Every function returns 0 on success, or an absl::StatusCode value on
+ * failure. On failure, if err is non-NULL, *err is set to a message that must
+ * be released with cue2pb_free().
+ *
+ * Outputs are returned through an (out, out_len) pair. On input, *out and
+ * *out_len may describe a buffer owned by the caller (or be NULL and 0). If the
+ * output fits, it is written there, and no memory is allocated. Otherwise *out
+ * is pointed at a new buffer, which must be released with cue2pb_free(). In
+ * both cases *out_len is set to the output's length.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Parses a cuesheet into a serialized Cuesheet proto. */
+int cue2pb_parse(const char *buf, size_t len, uint8_t **out, size_t *out_len,
+                 char **err);
+
+/* Unparses a serialized Cuesheet proto into a cuesheet. */
+int cue2pb_unparse(const uint8_t *buf, size_t len, char **out,
+                   size_t *out_len, char **err);
+
+/*
+ * Parses n cuesheets, writing their protos to out as one stream of varint
+ * length-delimited records, in order. A cuesheet that fails to parse gets an
+ * empty record. If codes is non-NULL, codes[i] is set to cuesheet i's status.
+ * Returns the status of the first failure, whose message goes to err, but
+ * parses the rest regardless. So unlike the other functions, *out holds every
+ * record even when this returns non-zero, and if it was allocated it must
+ * still be released with cue2pb_free(). It's left untouched only if the
+ * records couldn't be allocated, which returns RESOURCE_EXHAUSTED.
+ */
+int cue2pb_parse_batch(const char *const *bufs, const size_t *lens, size_t n,
+                       uint8_t **out, size_t *out_len, int *codes, char **err);
+
+/* Releases memory returned by the functions above. NULL is ignored. */
+void cue2pb_free(void *ptr);
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif  /* CUE2PB_C_API_H_ */
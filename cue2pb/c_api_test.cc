@@ -0,0 +1,143 @@
+#include "cue2pb/c_api.h"
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "cue2pb/cuesheet.pb.h"
+#include "cue2pb/text_format.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "util/file.h"
+#include "util/testing/protobuf_assertions.h"
+
+namespace cue2pb {
+
+using ::util::IsEqual;
+
+namespace {
+
+std::string ReadTestdata(std::string_view filename) {
+  return std::string(
+      util::MappedFile::Open("cue2pb/testdata/" + std::string(filename))
+          ->contents());
+}
+
+TEST(CApiTest, ParseIntoCallerBuffer) {
+  std::string cuesheet = ReadTestdata("full_disc.cue");
+  Cuesheet expected =
+      CuesheetFromTextProto(ReadTestdata("full_disc.textproto")).value();
+
+  std::vector<uint8_t> buffer(64 * 1024);
+  uint8_t *out = buffer.data();
+  size_t out_len = buffer.size();
+  ASSERT_EQ(0, cue2pb_parse(cuesheet.data(), cuesheet.size(), &out, &out_len,
+                            nullptr));
+  EXPECT_EQ(buffer.data(), out);
+
+  Cuesheet found;
+  ASSERT_TRUE(found.ParseFromArray(out, out_len));
+  EXPECT_TRUE(IsEqual(expected, found));
+}
+
+TEST(CApiTest, ParseAllocatesIfBufferIsTooSmall) {
+  std::string cuesheet = ReadTestdata("hidden_track.cue");
+
+  uint8_t small[4];
+  uint8_t *out = small;
+  size_t out_len = sizeof(small);
+  ASSERT_EQ(0, cue2pb_parse(cuesheet.data(), cuesheet.size(), &out, &out_len,
+                            nullptr));
+  ASSERT_NE(small, out);
+  Cuesheet found;
+  EXPECT_TRUE(found.ParseFromArray(out, out_len));
+  cue2pb_free(out);
+
+  out = nullptr;
+  out_len = 0;
+  ASSERT_EQ(0, cue2pb_parse(cuesheet.data(), cuesheet.size(), &out, &out_len,
+                            nullptr));
+  ASSERT_NE(nullptr, out);
+  cue2pb_free(out);
+}
+
+TEST(CApiTest, ParseError) {
+  std::string cuesheet = "TRACK 01 AUDIO\n";
+  uint8_t *out = nullptr;
+  size_t out_len = 0;
+  char *err = nullptr;
+  EXPECT_NE(0, cue2pb_parse(cuesheet.data(), cuesheet.size(), &out, &out_len,
+                            &err));
+  EXPECT_EQ(nullptr, out);
+  ASSERT_NE(nullptr, err);
+  EXPECT_NE(std::string::npos, std::string(err).find("line 1"));
+  cue2pb_free(err);
+}
+
+TEST(CApiTest, Unparse) {
+  Cuesheet cuesheet =
+      CuesheetFromTextProto(ReadTestdata("eac_singlefile.textproto")).value();
+  std::string proto = cuesheet.SerializeAsString();
+
+  char *out = nullptr;
+  size_t out_len = 0;
+  ASSERT_EQ(0, cue2pb_unparse(reinterpret_cast<const uint8_t*>(proto.data()),
+                              proto.size(), &out, &out_len, nullptr));
+  EXPECT_EQ(ReadTestdata("eac_singlefile.unparsed_cue"),
+            std::string(out, out_len));
+  cue2pb_free(out);
+
+  char *err = nullptr;
+  const uint8_t garbage[] = {0xff, 0xff};
+  EXPECT_NE(0, cue2pb_unparse(garbage, sizeof(garbage), &out, &out_len, &err));
+  ASSERT_NE(nullptr, err);
+  cue2pb_free(err);
+}
+
+TEST(CApiTest, ParseBatch) {
+  std::vector<std::string> cuesheets = {
+    ReadTestdata("hidden_track.cue"), "TRACK 01 AUDIO\n",
+    ReadTestdata("eac_singlefile.cue"),
+  };
+  std::vector<const char*> bufs;
+  std::vector<size_t> lens;
+  for (const std::string &cuesheet : cuesheets) {
+    bufs.push_back(cuesheet.data());
+    lens.push_back(cuesheet.size());
+  }
+
+  uint8_t *out = nullptr;
+  size_t out_len = 0;
+  int codes[3];
+  char *err = nullptr;
+  EXPECT_NE(0, cue2pb_parse_batch(bufs.data(), lens.data(), bufs.size(), &out,
+                                  &out_len, codes, &err));
+  EXPECT_EQ(0, codes[0]);
+  EXPECT_NE(0, codes[1]);
+  EXPECT_EQ(0, codes[2]);
+  ASSERT_NE(nullptr, err);
+  cue2pb_free(err);
+
+  const char *expected[] = {"hidden_track", nullptr, "eac_singlefile"};
+  google::protobuf::io::CodedInputStream in(out, out_len);
+  for (const char *name : expected) {
+    uint32_t size;
+    ASSERT_TRUE(in.ReadVarint32(&size));
+    if (name == nullptr) {
+      EXPECT_EQ(0, size);
+      continue;
+    }
+    auto limit = in.PushLimit(size);
+    Cuesheet found;
+    ASSERT_TRUE(found.ParseFromCodedStream(&in));
+    in.PopLimit(limit);
+    EXPECT_TRUE(IsEqual(
+        CuesheetFromTextProto(ReadTestdata(std::string(name) + ".textproto"))
+            .value(),
+        found));
+  }
+  EXPECT_TRUE(in.ExpectAtEnd());
+  cue2pb_free(out);
+}
+
+}  // namespace
+}  // namespace cue2pb
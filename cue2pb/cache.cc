@@ -0,0 +1,153 @@
+#include "cue2pb/cache.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "absl/strings/str_format.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "util/errno.h"
+#include "util/fingerprint.h"
+#include "util/status_builder.h"
+#include "util/status_macros.h"
+
+namespace cue2pb {
+namespace {
+
+using ::google::protobuf::io::CodedOutputStream;
+
+constexpr std::string_view kMagic = "CUEPBC02";
+
+// Seeds the fingerprint stored in entries, which must be independent of the
+// one naming them.
+constexpr uint64_t kCheckSeed = 1;
+
+// The header of an entry for cuesheet.
+std::string EntryHeader(std::string_view cuesheet) {
+  std::string header(kMagic);
+  uint8_t buf[8];
+  CodedOutputStream::WriteLittleEndian64ToArray(cuesheet.size(), buf);
+  header.append(reinterpret_cast<char*>(buf), 8);
+  CodedOutputStream::WriteLittleEndian64ToArray(
+      util::Fingerprint64(cuesheet, kCheckSeed), buf);
+  header.append(reinterpret_cast<char*>(buf), 8);
+  CodedOutputStream::WriteLittleEndian32ToArray(kParserVersion, buf);
+  header.append(reinterpret_cast<char*>(buf), 4);
+  header.append(4, '\0');
+  return header;
+}
+
+absl::Status MakeDirectory(const std::string &path) {
+  if (mkdir(path.c_str(), 0777) == -1 && errno != EEXIST) {
+    return util::StatusBuilder(util::ErrnoAsStatus())
+        << "Failed to create " << path;
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+absl::StatusOr<ParseCache> ParseCache::Open(std::string_view dir,
+                                            int64_t max_bytes) {
+  RETURN_IF_ERROR(MakeDirectory(std::string(dir)));
+  return ParseCache(std::string(dir), max_bytes);
+}
+
+ParseCache::ParseCache(std::string dir, int64_t max_bytes)
+  : dir_(std::move(dir)), max_bytes_(max_bytes)
+  {}
+
+std::string ParseCache::EntryPath(uint64_t fingerprint) const {
+  return absl::StrFormat("%s/%02x/%016x", dir_, fingerprint >> 56,
+                         fingerprint);
+}
+
+absl::StatusOr<ParseCache::Entry> ParseCache::Lookup(
+    std::string_view cuesheet) const {
+  std::string path = EntryPath(util::Fingerprint64(cuesheet));
+  ASSIGN_OR_RETURN(util::MappedFile file, util::MappedFile::Open(path));
+
+  // A different cuesheet with the same fingerprint, an entry from another
+  // parser version, or a damaged entry, is a miss.
+  std::string_view contents = file.contents();
+  if (contents.substr(0, kHeaderSize) != EntryHeader(cuesheet)) {
+    return util::NotFoundErrorBuilder() << "No cache entry for the cuesheet";
+  }
+
+  // Mark the entry as recently used. It doesn't matter if this fails.
+  utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+  return Entry(std::move(file));
+}
+
+absl::Status ParseCache::Insert(std::string_view cuesheet,
+                                std::string_view proto) const {
+  uint64_t fingerprint = util::Fingerprint64(cuesheet);
+  std::string path = EntryPath(fingerprint);
+  RETURN_IF_ERROR(MakeDirectory(path.substr(0, path.rfind('/'))));
+
+  std::string contents = EntryHeader(cuesheet);
+  contents.append(proto);
+  RETURN_IF_ERROR(util::WriteFile(path, contents));
+
+  // Rather than every process tracking how much it has inserted, each insert
+  // triggers an eviction with a chance proportional to its size, so that on
+  // average one happens every sixteenth of the cache. Fingerprints are
+  // uniformly distributed, so they serve as the dice.
+  if (max_bytes_ > 0) {
+    uint64_t period = std::max<int64_t>(max_bytes_ / 16, 1);
+    if (fingerprint % period < contents.size()) return Evict();
+  }
+  return absl::OkStatus();
+}
+
+absl::Status ParseCache::Evict() const {
+  if (max_bytes_ <= 0) return absl::OkStatus();
+
+  struct File {
+    int64_t mtime_nsec;
+    int64_t size;
+    std::string path;
+  };
+  std::vector<File> files;
+  int64_t total = 0;
+  for (int shard = 0; shard < 256; shard++) {
+    std::string dir = absl::StrFormat("%s/%02x", dir_, shard);
+    DIR *d = opendir(dir.c_str());
+    if (d == nullptr) continue;
+    while (struct dirent *ent = readdir(d)) {
+      if (ent->d_name[0] == '.') continue;
+      struct stat st;
+      if (fstatat(dirfd(d), ent->d_name, &st, AT_SYMLINK_NOFOLLOW) == -1 ||
+          !S_ISREG(st.st_mode)) {
+        continue;
+      }
+      int64_t mtime = int64_t{st.st_mtim.tv_sec} * 1000000000 +
+          st.st_mtim.tv_nsec;
+      files.push_back({mtime, st.st_size, dir + "/" + ent->d_name});
+      total += st.st_size;
+    }
+    closedir(d);
+  }
+  if (total <= max_bytes_) return absl::OkStatus();
+
+  std::sort(files.begin(), files.end(), [](const File &a, const File &b) {
+    return a.mtime_nsec < b.mtime_nsec;
+  });
+  int64_t target = max_bytes_ / 10 * 9;
+  for (const File &file : files) {
+    if (total <= target) break;
+    // Another process may have evicted it already.
+    if (unlink(file.path.c_str()) == -1 && errno != ENOENT) {
+      return util::StatusBuilder(util::ErrnoAsStatus())
+          << "Failed to evict " << file.path;
+    }
+    total -= file.size;
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace cue2pb
@@ -0,0 +1,88 @@
+#ifndef CUE2PB_CACHE_H_
+#define CUE2PB_CACHE_H_
+
+#include <string>
+#include <string_view>
+#include <utility>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "util/file.h"
+
+// An on-disk cache of parsed cuesheets, keyed by the cuesheet's bytes, so that
+// the same cuesheet is only parsed once no matter how many copies of it there
+// are.
+//
+// Each entry is a file named by util::Fingerprint64 of the cuesheet, sharded
+// into 256 directories. It holds, with every integer little-endian:
+//
+//   "CUEPBC02"
+//   uint64 size of the cuesheet
+//   uint64 a second, independent fingerprint of the cuesheet
+//   uint32 kParserVersion of the parser that wrote it
+//   uint32 reserved
+//   the serialized Cuesheet
+//
+// An entry whose cuesheet size, second fingerprint or parser version differs
+// is a miss, and is replaced by the next insert. Entries are written
+// to a temporary file and renamed into place, so any number of processes may
+// share a cache directory. Hits update the entry's mtime, and once the cache
+// grows past its size limit the least recently used entries are removed.
+
+namespace cue2pb {
+
+// Bump whenever the parser's output for some cuesheet changes, so that protos
+// cached by older parsers are parsed again.
+inline constexpr uint32_t kParserVersion = 1;
+
+class ParseCache {
+ public:
+  // A cache hit: the entry's file, mapped into memory.
+  class Entry {
+   public:
+    // The serialized Cuesheet.
+    std::string_view proto() const {
+      return file_.contents().substr(kHeaderSize);
+    }
+
+   private:
+    friend class ParseCache;
+    explicit Entry(util::MappedFile file)
+      : file_(std::move(file))
+      {}
+
+    util::MappedFile file_;
+  };
+
+  // Creates dir if needed. max_bytes <= 0 means no limit.
+  static absl::StatusOr<ParseCache> Open(std::string_view dir,
+                                         int64_t max_bytes);
+
+  // Returns NotFound on a miss.
+  absl::StatusOr<Entry> Lookup(std::string_view cuesheet) const;
+
+  // Stores the serialized Cuesheet parsed from cuesheet. Now and then, this
+  // also evicts entries.
+  absl::Status Insert(std::string_view cuesheet, std::string_view proto) const;
+
+  // Removes least recently used entries until the cache is under 90% of its
+  // size limit.
+  absl::Status Evict() const;
+
+ private:
+  // See the layout above.
+  static constexpr size_t kHeaderSize = 32;
+
+  ParseCache(std::string dir, int64_t max_bytes);
+
+  std::string EntryPath(uint64_t fingerprint) const;
+
+  std::string dir_;
+  int64_t max_bytes_;
+};
+
+}  // namespace cue2pb
+
+#endif  // CUE2PB_CACHE_H_
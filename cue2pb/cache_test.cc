@@ -0,0 +1,187 @@
+#include "cue2pb/cache.h"
+
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "gtest/gtest.h"
+#include "absl/strings/str_format.h"
+#include "cue2pb/convert.h"
+#include "cue2pb/cuesheet.pb.h"
+#include "cue2pb/text_format.h"
+#include "util/file.h"
+#include "util/fingerprint.h"
+#include "util/testing/assertions.h"
+#include "util/testing/protobuf_assertions.h"
+
+namespace cue2pb {
+
+using ::util::IsEqual;
+using ::util::IsOk;
+
+namespace {
+
+std::string ReadTestdata(std::string_view filename) {
+  return std::string(
+      util::MappedFile::Open("cue2pb/testdata/" + std::string(filename))
+          ->contents());
+}
+
+class ParseCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    char dir_template[] = "/tmp/cache_test.XXXXXX";
+    dir_ = mkdtemp(dir_template);
+  }
+
+  void TearDown() override {
+    std::error_code ec;
+    std::filesystem::remove_all(dir_, ec);
+  }
+
+  size_t NumEntries() {
+    size_t n = 0;
+    std::error_code ec;
+    for (auto it = std::filesystem::recursive_directory_iterator(dir_, ec);
+         it != std::filesystem::recursive_directory_iterator();
+         it.increment(ec)) {
+      n += it->is_regular_file(ec);
+    }
+    return n;
+  }
+
+  std::string dir_;
+};
+
+TEST_F(ParseCacheTest, HitsAfterInsert) {
+  auto cache = ParseCache::Open(dir_ + "/cache", /*max_bytes=*/0);
+  ASSERT_TRUE(IsOk(cache));
+
+  std::string cuesheet = ReadTestdata("hidden_track.cue");
+  EXPECT_FALSE(IsOk(cache->Lookup(cuesheet)));
+  ASSERT_TRUE(IsOk(cache->Insert(cuesheet, "proto")));
+
+  auto entry = cache->Lookup(cuesheet);
+  ASSERT_TRUE(IsOk(entry));
+  EXPECT_EQ("proto", entry->proto());
+
+  // Another cuesheet of the same size misses.
+  cuesheet.back() = '?';
+  EXPECT_FALSE(IsOk(cache->Lookup(cuesheet)));
+}
+
+TEST_F(ParseCacheTest, DamagedEntriesMiss) {
+  auto cache = ParseCache::Open(dir_, /*max_bytes=*/0);
+  ASSERT_TRUE(IsOk(cache));
+  ASSERT_TRUE(IsOk(cache->Insert("cuesheet", "proto")));
+
+  uint64_t fingerprint = util::Fingerprint64("cuesheet");
+  std::string path = absl::StrFormat("%s/%02x/%016x", dir_, fingerprint >> 56,
+                                     fingerprint);
+  ASSERT_TRUE(IsOk(util::WriteFile(path, "garbage")));
+  EXPECT_FALSE(IsOk(cache->Lookup("cuesheet")));
+}
+
+TEST_F(ParseCacheTest, MismatchedEntriesMiss) {
+  auto cache = ParseCache::Open(dir_, /*max_bytes=*/0);
+  ASSERT_TRUE(IsOk(cache));
+  ASSERT_TRUE(IsOk(cache->Insert("cuesheet", "proto")));
+  ASSERT_TRUE(IsOk(cache->Insert("cueshee!", "other proto")));
+
+  auto EntryPath = [&](std::string_view cuesheet) {
+    uint64_t fingerprint = util::Fingerprint64(cuesheet);
+    return absl::StrFormat("%s/%02x/%016x", dir_, fingerprint >> 56,
+                           fingerprint);
+  };
+  std::string entry = std::string(
+      util::MappedFile::Open(EntryPath("cuesheet"))->contents());
+  std::string other = std::string(
+      util::MappedFile::Open(EntryPath("cueshee!"))->contents());
+
+  // As if another cuesheet of the same size had the same fingerprint.
+  ASSERT_TRUE(IsOk(util::WriteFile(EntryPath("cuesheet"), other)));
+  EXPECT_FALSE(IsOk(cache->Lookup("cuesheet")));
+
+  // As if an older parser had written it.
+  entry[24]++;
+  ASSERT_TRUE(IsOk(util::WriteFile(EntryPath("cuesheet"), entry)));
+  EXPECT_FALSE(IsOk(cache->Lookup("cuesheet")));
+  entry[24]--;
+  ASSERT_TRUE(IsOk(util::WriteFile(EntryPath("cuesheet"), entry)));
+  EXPECT_TRUE(IsOk(cache->Lookup("cuesheet")));
+}
+
+TEST_F(ParseCacheTest, CueToProtoUsesCache) {
+  auto cache = ParseCache::Open(dir_, /*max_bytes=*/0);
+  ASSERT_TRUE(IsOk(cache));
+
+  std::string cuesheet = ReadTestdata("full_disc.cue");
+  Cuesheet expected =
+      CuesheetFromTextProto(ReadTestdata("full_disc.textproto")).value();
+  for (int i = 0; i < 2; i++) {
+    std::string binary;
+    ASSERT_TRUE(IsOk(
+        CueToProto(cuesheet, ProtoFormat::kBinary, &*cache, &binary)));
+    Cuesheet found;
+    ASSERT_TRUE(found.ParseFromString(binary));
+    EXPECT_TRUE(IsEqual(expected, found));
+
+    std::string text;
+    ASSERT_TRUE(IsOk(CueToProto(cuesheet, ProtoFormat::kText, &*cache,
+                                &text)));
+    EXPECT_EQ(ReadTestdata("full_disc.textproto"), text);
+  }
+  EXPECT_EQ(1, NumEntries());
+
+  // Hits come from the cache rather than the parser.
+  Cuesheet other;
+  other.set_catalog("from the cache");
+  ASSERT_TRUE(IsOk(cache->Insert(cuesheet, other.SerializeAsString())));
+  std::string binary;
+  ASSERT_TRUE(IsOk(
+      CueToProto(cuesheet, ProtoFormat::kBinary, &*cache, &binary)));
+  EXPECT_EQ(other.SerializeAsString(), binary);
+
+  // Failed parses aren't cached.
+  EXPECT_FALSE(IsOk(CueToProto("NOT A COMMAND\n", ProtoFormat::kBinary,
+                               &*cache, &binary)));
+  EXPECT_EQ(1, NumEntries());
+}
+
+TEST_F(ParseCacheTest, EvictsLeastRecentlyUsed) {
+  // Entries are 32 bytes of header plus 100 of proto.
+  auto cache = ParseCache::Open(dir_, /*max_bytes=*/132 * 10);
+  ASSERT_TRUE(IsOk(cache));
+  std::string proto(100, 'x');
+  for (int i = 0; i < 10; i++) {
+    ASSERT_TRUE(IsOk(cache->Insert(absl::StrFormat("cuesheet %d", i), proto)));
+  }
+  ASSERT_TRUE(IsOk(cache->Evict()));
+  EXPECT_EQ(10, NumEntries());
+
+  // Age everything, then use one entry so that it's the most recent.
+  for (int i = 0; i < 10; i++) {
+    uint64_t fingerprint =
+        util::Fingerprint64(absl::StrFormat("cuesheet %d", i));
+    std::string path = absl::StrFormat("%s/%02x/%016x", dir_,
+                                       fingerprint >> 56, fingerprint);
+    struct timespec times[2] = {{0, UTIME_OMIT}, {1000 + i, 0}};
+    ASSERT_EQ(0, utimensat(AT_FDCWD, path.c_str(), times, 0));
+  }
+  ASSERT_TRUE(IsOk(cache->Lookup("cuesheet 0")));
+
+  ASSERT_TRUE(IsOk(cache->Insert("cuesheet 10", proto)));
+  ASSERT_TRUE(IsOk(cache->Evict()));
+  EXPECT_EQ(9, NumEntries());
+  EXPECT_TRUE(IsOk(cache->Lookup("cuesheet 0")));
+  EXPECT_TRUE(IsOk(cache->Lookup("cuesheet 10")));
+  EXPECT_FALSE(IsOk(cache->Lookup("cuesheet 1")));
+  EXPECT_FALSE(IsOk(cache->Lookup("cuesheet 2")));
+  EXPECT_TRUE(IsOk(cache->Lookup("cuesheet 3")));
+}
+
+}  // namespace
+}  // namespace cue2pb
@@ -0,0 +1,356 @@
+#include "cue2pb/compact.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "absl/status/statusor.h"
+#include "cue2pb/frames.h"
+#include "cue2pb/msf.h"
+#include "util/status_builder.h"
+#include "util/status_macros.h"
+
+namespace cue2pb {
+namespace {
+
+using StringRef = CompactCuesheet::StringRef;
+
+StringRef Intern(std::string_view str, CompactCuesheet *compact) {
+  StringRef ref;
+  ref.offset = static_cast<uint32_t>(compact->pool.size());
+  ref.size = static_cast<uint32_t>(str.size());
+  compact->pool.append(str.data(), str.size());
+  return ref;
+}
+
+absl::StatusOr<uint8_t> ToUint8(int32_t value, std::string_view what) {
+  if (value < 0 || value > std::numeric_limits<uint8_t>::max()) {
+    return util::InvalidArgumentErrorBuilder()
+        << what << " " << value << " doesn't fit in a CompactCuesheet";
+  }
+  return static_cast<uint8_t>(value);
+}
+
+absl::StatusOr<int32_t> ToFrames(int64_t frames) {
+  if (frames < std::numeric_limits<int32_t>::min() ||
+      frames > std::numeric_limits<int32_t>::max()) {
+    return util::InvalidArgumentErrorBuilder()
+        << "Position of " << frames
+        << " frames doesn't fit in a CompactCuesheet";
+  }
+  return static_cast<int32_t>(frames);
+}
+
+absl::Status AddFile(std::string_view path, int type,
+                     CompactCuesheet *compact) {
+  if (compact->num_files == CompactCuesheet::kMaxFiles) {
+    return util::InvalidArgumentErrorBuilder()
+        << "More than " << CompactCuesheet::kMaxFiles << " files";
+  }
+  ASSIGN_OR_RETURN(uint8_t file_type, ToUint8(type, "File type"));
+  CompactCuesheet::File &file = compact->files[compact->num_files++];
+  file.path = Intern(path, compact);
+  file.type = file_type;
+  file.first_track = compact->num_tracks;
+  file.tracks = 0;
+  return absl::OkStatus();
+}
+
+absl::Status AddTrack(int32_t number, int type, CompactCuesheet *compact) {
+  if (compact->num_tracks == CompactCuesheet::kMaxTracks) {
+    return util::InvalidArgumentErrorBuilder()
+        << "More than " << CompactCuesheet::kMaxTracks << " tracks";
+  }
+  ASSIGN_OR_RETURN(uint8_t track_number, ToUint8(number, "Track number"));
+  ASSIGN_OR_RETURN(uint8_t track_type, ToUint8(type, "Track type"));
+  CompactCuesheet::Track &track = compact->tracks[compact->num_tracks++];
+  track = CompactCuesheet::Track();
+  track.number = track_number;
+  track.type = track_type;
+  track.first_index = compact->num_indices;
+  compact->files[compact->num_files - 1].tracks++;
+  return absl::OkStatus();
+}
+
+absl::Status AddIndex(int32_t number, int64_t frames,
+                      CompactCuesheet *compact) {
+  CompactCuesheet::Track &track = compact->tracks[compact->num_tracks - 1];
+  if (compact->num_indices == CompactCuesheet::kMaxIndices) {
+    return util::InvalidArgumentErrorBuilder()
+        << "More than " << CompactCuesheet::kMaxIndices << " indices";
+  }
+  if (track.indices == std::numeric_limits<uint8_t>::max()) {
+    return util::InvalidArgumentErrorBuilder()
+        << "Track " << static_cast<int>(track.number) << " has more than "
+        << static_cast<int>(std::numeric_limits<uint8_t>::max())
+        << " indices";
+  }
+  ASSIGN_OR_RETURN(uint8_t index_number, ToUint8(number, "Index number"));
+  ASSIGN_OR_RETURN(int32_t index_frames, ToFrames(frames));
+  compact->index_numbers[compact->num_indices] = index_number;
+  compact->index_frames[compact->num_indices] = index_frames;
+  compact->num_indices++;
+  track.indices++;
+  return absl::OkStatus();
+}
+
+absl::Status AddFlag(int flag, CompactCuesheet::Track *track) {
+  if (flag < 0 || flag >= 8) {
+    return util::InvalidArgumentErrorBuilder()
+        << "Flag " << flag << " doesn't fit in a CompactCuesheet";
+  }
+  track->flags |= 1 << flag;
+  return absl::OkStatus();
+}
+
+// Moves the comment tags of tags to the end of comment_tags, closing the gap
+// they leave in every other Tags' range.
+void MoveCommentTagsToEnd(CompactCuesheet::Tags *tags,
+                          CompactCuesheet *compact) {
+  auto begin = compact->comment_tags.begin() + tags->first_comment_tag;
+  std::rotate(begin, begin + tags->comment_tags, compact->comment_tags.end());
+
+  auto close_gap = [tags](CompactCuesheet::Tags *other) {
+    if (other != tags && other->comment_tags > 0 &&
+        other->first_comment_tag > tags->first_comment_tag) {
+      other->first_comment_tag -= tags->comment_tags;
+    }
+  };
+  close_gap(&compact->tags);
+  for (int i = 0; i < compact->num_tracks; i++) {
+    close_gap(&compact->tracks[i].tags);
+  }
+  tags->first_comment_tag =
+      static_cast<uint32_t>(compact->comment_tags.size()) - tags->comment_tags;
+}
+
+void AddCommentTag(std::string_view name, std::string_view value,
+                   CompactCuesheet::Tags *tags, CompactCuesheet *compact) {
+  if (tags->comment_tags == 0) {
+    tags->first_comment_tag =
+        static_cast<uint32_t>(compact->comment_tags.size());
+  } else if (tags->first_comment_tag + tags->comment_tags !=
+             compact->comment_tags.size()) {
+    // The disc's comment tags may come after some track's, as when a REM
+    // follows a FILE but precedes its first TRACK. A range has to stay
+    // contiguous, so it's moved past the others.
+    MoveCommentTagsToEnd(tags, compact);
+  }
+  compact->comment_tags.push_back(
+      {Intern(name, compact), Intern(value, compact)});
+  tags->comment_tags++;
+}
+
+void AssignTags(const Cuesheet::Tags &tags, CompactCuesheet::Tags *out,
+                CompactCuesheet *compact) {
+  out->title = Intern(tags.title(), compact);
+  out->performer = Intern(tags.performer(), compact);
+  out->songwriter = Intern(tags.songwriter(), compact);
+  for (const Cuesheet::CommentTag &tag : tags.comment_tag()) {
+    AddCommentTag(tag.name(), tag.value(), out, compact);
+  }
+}
+
+absl::Status AssignCuesheet(const Cuesheet &cuesheet,
+                            CompactCuesheet *compact) {
+  compact->catalog = Intern(cuesheet.catalog(), compact);
+  compact->cd_text_file = Intern(cuesheet.cd_text_file(), compact);
+  AssignTags(cuesheet.tags(), &compact->tags, compact);
+  for (const Cuesheet::File &file : cuesheet.file()) {
+    RETURN_IF_ERROR(AddFile(file.path(), file.type(), compact));
+    for (const Cuesheet::Track &t : file.track()) {
+      RETURN_IF_ERROR(AddTrack(t.number(), t.type(), compact));
+      CompactCuesheet::Track &track =
+          compact->tracks[compact->num_tracks - 1];
+      AssignTags(t.tags(), &track.tags, compact);
+      for (int flag : t.flag()) RETURN_IF_ERROR(AddFlag(flag, &track));
+      track.isrc = Intern(t.isrc(), compact);
+      ASSIGN_OR_RETURN(track.pregap, ToFrames(PregapFrames(t)));
+      ASSIGN_OR_RETURN(track.postgap, ToFrames(PostgapFrames(t)));
+      for (const Cuesheet::Index &index : t.index()) {
+        RETURN_IF_ERROR(
+            AddIndex(index.number(), PositionFrames(index), compact));
+      }
+    }
+  }
+  return absl::OkStatus();
+}
+
+bool IsEmpty(const CompactCuesheet::Tags &tags) {
+  return tags.title.size == 0 && tags.performer.size == 0 &&
+      tags.songwriter.size == 0 && tags.comment_tags == 0;
+}
+
+void SetMSF(int64_t frames, Cuesheet::MSF *msf) {
+  int32_t minute, second, frame;
+  FramesToMSF(frames, &minute, &second, &frame);
+  msf->set_minute(minute);
+  msf->set_second(second);
+  msf->set_frame(frame);
+}
+
+}  // namespace
+
+void CompactCuesheet::Clear() {
+  catalog = StringRef();
+  cd_text_file = StringRef();
+  tags = Tags();
+  num_files = 0;
+  num_tracks = 0;
+  num_indices = 0;
+  comment_tags.clear();
+  pool.clear();
+}
+
+absl::Status CompactCuesheet::Assign(const Cuesheet &cuesheet) {
+  Clear();
+  absl::Status status = AssignCuesheet(cuesheet, this);
+  if (!status.ok()) Clear();
+  return status;
+}
+
+void CompactCuesheet::ToCuesheet(Cuesheet *cuesheet) const {
+  auto set_tags = [this](const Tags &from, Cuesheet::Tags *to) {
+    std::string_view title = str(from.title);
+    std::string_view performer = str(from.performer);
+    std::string_view songwriter = str(from.songwriter);
+    to->set_title(title.data(), title.size());
+    to->set_performer(performer.data(), performer.size());
+    to->set_songwriter(songwriter.data(), songwriter.size());
+    for (uint32_t i = 0; i < from.comment_tags; i++) {
+      const CommentTag &tag = comment_tags[from.first_comment_tag + i];
+      std::string_view name = str(tag.name);
+      std::string_view value = str(tag.value);
+      Cuesheet::CommentTag *to_tag = to->add_comment_tag();
+      to_tag->set_name(name.data(), name.size());
+      to_tag->set_value(value.data(), value.size());
+    }
+  };
+
+  cuesheet->Clear();
+  std::string_view catalog_str = str(catalog);
+  cuesheet->set_catalog(catalog_str.data(), catalog_str.size());
+  std::string_view cd_text_file_str = str(cd_text_file);
+  cuesheet->set_cd_text_file(cd_text_file_str.data(), cd_text_file_str.size());
+  if (!IsEmpty(tags)) set_tags(tags, cuesheet->mutable_tags());
+
+  for (int f = 0; f < num_files; f++) {
+    const File &file = files[f];
+    Cuesheet::File *out_file = cuesheet->add_file();
+    std::string_view path = str(file.path);
+    out_file->set_path(path.data(), path.size());
+    out_file->set_type(static_cast<Cuesheet::File::Type>(file.type));
+
+    for (int t = file.first_track; t < file.first_track + file.tracks; t++) {
+      const Track &track = tracks[t];
+      Cuesheet::Track *out_track = out_file->add_track();
+      out_track->set_number(track.number);
+      out_track->set_type(static_cast<Cuesheet::Track::Type>(track.type));
+      if (!IsEmpty(track.tags)) {
+        set_tags(track.tags, out_track->mutable_tags());
+      }
+      for (int flag = 0; flag < 8; flag++) {
+        if ((track.flags >> flag) & 1) {
+          out_track->add_flag(static_cast<Cuesheet::Track::Flag>(flag));
+        }
+      }
+      std::string_view isrc = str(track.isrc);
+      out_track->set_isrc(isrc.data(), isrc.size());
+      if (track.postgap != 0) {
+        SetMSF(track.postgap, out_track->mutable_postgap());
+      }
+      if (track.pregap != 0) SetMSF(track.pregap, out_track->mutable_pregap());
+      for (int i = track.first_index; i < track.first_index + track.indices;
+           i++) {
+        Cuesheet::Index *index = out_track->add_index();
+        index->set_number(index_numbers[i]);
+        SetMSF(index_frames[i], index->mutable_position());
+      }
+    }
+  }
+}
+
+CompactCuesheet::Tags *CompactCuesheetBuilder::MutableTags(Scope scope) {
+  if (scope == Scope::kTrack) {
+    return &compact_->tracks[compact_->num_tracks - 1].tags;
+  }
+  return &compact_->tags;
+}
+
+absl::Status CompactCuesheetBuilder::OnCatalog(std::string_view catalog) {
+  compact_->catalog = Intern(catalog, compact_);
+  return absl::OkStatus();
+}
+
+absl::Status CompactCuesheetBuilder::OnCdTextFile(std::string_view path) {
+  compact_->cd_text_file = Intern(path, compact_);
+  return absl::OkStatus();
+}
+
+absl::Status CompactCuesheetBuilder::OnFile(std::string_view path,
+                                            Cuesheet::File::Type type) {
+  return AddFile(path, type, compact_);
+}
+
+absl::Status CompactCuesheetBuilder::OnTrack(int32_t number,
+                                             Cuesheet::Track::Type type) {
+  return AddTrack(number, type, compact_);
+}
+
+absl::Status CompactCuesheetBuilder::OnIndex(int32_t number, int64_t frames) {
+  return AddIndex(number, frames, compact_);
+}
+
+absl::Status CompactCuesheetBuilder::OnPregap(int64_t frames) {
+  ASSIGN_OR_RETURN(compact_->tracks[compact_->num_tracks - 1].pregap,
+                   ToFrames(frames));
+  return absl::OkStatus();
+}
+
+absl::Status CompactCuesheetBuilder::OnPostgap(int64_t frames) {
+  ASSIGN_OR_RETURN(compact_->tracks[compact_->num_tracks - 1].postgap,
+                   ToFrames(frames));
+  return absl::OkStatus();
+}
+
+absl::Status CompactCuesheetBuilder::OnIsrc(std::string_view isrc) {
+  compact_->tracks[compact_->num_tracks - 1].isrc = Intern(isrc, compact_);
+  return absl::OkStatus();
+}
+
+absl::Status CompactCuesheetBuilder::OnFlag(Cuesheet::Track::Flag flag) {
+  return AddFlag(flag, &compact_->tracks[compact_->num_tracks - 1]);
+}
+
+absl::Status CompactCuesheetBuilder::OnTag(Scope scope, Tag tag,
+                                           std::string_view value) {
+  CompactCuesheet::Tags *tags = MutableTags(scope);
+  switch (tag) {
+    case Tag::kTitle:
+      tags->title = Intern(value, compact_);
+      break;
+    case Tag::kPerformer:
+      tags->performer = Intern(value, compact_);
+      break;
+    case Tag::kSongwriter:
+      tags->songwriter = Intern(value, compact_);
+      break;
+  }
+  return absl::OkStatus();
+}
+
+absl::Status CompactCuesheetBuilder::OnCommentTag(Scope scope,
+                                                  std::string_view name,
+                                                  std::string_view value) {
+  AddCommentTag(name, value, MutableTags(scope), compact_);
+  return absl::OkStatus();
+}
+
+absl::Status ParseCompactCuesheet(std::string_view input,
+                                  CompactCuesheet *compact,
+                                  const ParseOptions &options) {
+  compact->Clear();
+  CompactCuesheetBuilder builder(compact);
+  return VisitCuesheet(input, &builder, options);
+}
+
+}  // namespace cue2pb
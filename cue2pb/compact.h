@@ -0,0 +1,146 @@
+#ifndef CUE2PB_COMPACT_H_
+#define CUE2PB_COMPACT_H_
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <stdint.h>
+
+#include "absl/status/status.h"
+#include "cue2pb/cuesheet.pb.h"
+#include "cue2pb/visitor.h"
+
+namespace cue2pb {
+
+// A Cuesheet as a single struct, for tables that hold many cuesheets in
+// memory and look through them often. Files, tracks and indices are inline
+// arrays sized for a full disc, of small integer fields, so finding a track or
+// its positions never chases a pointer. Strings are ranges of one pool, and
+// comment tags share one array, so however many strings and tags a disc has,
+// it takes just two allocations, which Clear() keeps for reuse.
+//
+// Unlike a Cuesheet it can't hold more than kMaxFiles files, kMaxTracks
+// tracks or kMaxIndices indices in all, 255 indices in a track, numbers or
+// enum values above 255, or positions past an int32 of frames. A track's
+// flags are a set, so their order and any repeats are lost, as is a PREGAP or
+// POSTGAP of 00:00:00.
+struct CompactCuesheet {
+  static constexpr int kMaxFiles = 99;
+  static constexpr int kMaxTracks = 99;
+  // Several indices for every track of a full disc.
+  static constexpr int kMaxIndices = 512;
+
+  // A range of pool.
+  struct StringRef {
+    uint32_t offset = 0;
+    uint32_t size = 0;
+  };
+
+  struct CommentTag {
+    StringRef name;
+    StringRef value;
+  };
+
+  struct Tags {
+    StringRef title;
+    StringRef performer;
+    StringRef songwriter;
+    // The range of comment_tags holding these tags' comment tags.
+    uint32_t first_comment_tag = 0;
+    uint32_t comment_tags = 0;
+  };
+
+  struct File {
+    StringRef path;
+    uint8_t type;  // A Cuesheet::File::Type.
+    // The range of tracks in this file.
+    uint8_t first_track;
+    uint8_t tracks;
+  };
+
+  struct Track {
+    uint8_t number;
+    uint8_t type;  // A Cuesheet::Track::Type.
+    uint8_t flags;  // Bit 1 << f is set for each Cuesheet::Track::Flag f.
+    // The range of index_numbers and index_frames holding this track's
+    // indices.
+    uint8_t indices;
+    uint16_t first_index;
+    // In frames; see frames.h.
+    int32_t pregap;
+    int32_t postgap;
+    StringRef isrc;
+    Tags tags;
+  };
+
+  std::string_view str(StringRef ref) const {
+    return std::string_view(pool).substr(ref.offset, ref.size);
+  }
+
+  static bool HasFlag(const Track &track, Cuesheet::Track::Flag flag) {
+    return (track.flags >> flag) & 1;
+  }
+
+  void Clear();
+
+  // Replaces the contents with cuesheet. On error, as when cuesheet doesn't
+  // fit, is left cleared.
+  absl::Status Assign(const Cuesheet &cuesheet);
+
+  // Replaces the contents of cuesheet. Positions are written as MSFs.
+  void ToCuesheet(Cuesheet *cuesheet) const;
+
+  StringRef catalog;
+  StringRef cd_text_file;
+  Tags tags;
+
+  uint8_t num_files = 0;
+  uint8_t num_tracks = 0;
+  uint16_t num_indices = 0;
+  File files[kMaxFiles];
+  Track tracks[kMaxTracks];
+  uint8_t index_numbers[kMaxIndices];
+  int32_t index_frames[kMaxIndices];
+
+  std::vector<CommentTag> comment_tags;
+  std::string pool;
+};
+
+// A CuesheetVisitor which fills in a CompactCuesheet, without building a
+// Cuesheet first.
+class CompactCuesheetBuilder : public CuesheetVisitor {
+ public:
+  // compact is not owned, and must outlive the builder. It should be clear.
+  explicit CompactCuesheetBuilder(CompactCuesheet *compact)
+    : compact_(compact)
+    {}
+
+  absl::Status OnCatalog(std::string_view catalog) override;
+  absl::Status OnCdTextFile(std::string_view path) override;
+  absl::Status OnFile(std::string_view path,
+                      Cuesheet::File::Type type) override;
+  absl::Status OnTrack(int32_t number, Cuesheet::Track::Type type) override;
+  absl::Status OnIndex(int32_t number, int64_t frames) override;
+  absl::Status OnPregap(int64_t frames) override;
+  absl::Status OnPostgap(int64_t frames) override;
+  absl::Status OnIsrc(std::string_view isrc) override;
+  absl::Status OnFlag(Cuesheet::Track::Flag flag) override;
+  absl::Status OnTag(Scope scope, Tag tag, std::string_view value) override;
+  absl::Status OnCommentTag(Scope scope, std::string_view name,
+                            std::string_view value) override;
+
+ private:
+  CompactCuesheet::Tags *MutableTags(Scope scope);
+
+  CompactCuesheet *compact_;
+};
+
+// Parses a cuesheet held entirely in memory into compact, which is cleared
+// first. On error, compact holds whatever was parsed before it.
+absl::Status ParseCompactCuesheet(
+    std::string_view input, CompactCuesheet *compact,
+    const ParseOptions &options = ParseOptions());
+
+}  // namespace cue2pb
+
+#endif  // CUE2PB_COMPACT_H_
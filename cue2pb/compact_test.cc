@@ -0,0 +1,188 @@
+#include "cue2pb/compact.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "cue2pb/parser.h"
+#include "util/file.h"
+#include "util/testing/assertions.h"
+#include "util/testing/protobuf_assertions.h"
+
+namespace cue2pb {
+namespace {
+
+using ::util::IsEqual;
+using ::util::IsOk;
+
+constexpr const char *kTestdata[] = {
+  "complete_small", "eac_multifile_gapless", "eac_multifile_gaps",
+  "eac_singlefile", "full_disc", "hidden_track",
+};
+
+// What a Cuesheet looks like after a round trip through a CompactCuesheet,
+// which keeps flags as a set.
+Cuesheet SortFlags(Cuesheet cuesheet) {
+  for (Cuesheet::File &file : *cuesheet.mutable_file()) {
+    for (Cuesheet::Track &track : *file.mutable_track()) {
+      std::sort(track.mutable_flag()->begin(), track.mutable_flag()->end());
+    }
+  }
+  return cuesheet;
+}
+
+TEST(CompactCuesheetTest, Testdata) {
+  // Too big for the stack.
+  auto from_proto = std::make_unique<CompactCuesheet>();
+  auto parsed = std::make_unique<CompactCuesheet>();
+  for (const char *name : kTestdata) {
+    auto mapped = util::MappedFile::Open(
+        absl::StrCat("cue2pb/testdata/", name, ".cue"));
+    ASSERT_TRUE(IsOk(mapped));
+    absl::StatusOr<Cuesheet> cuesheet = ParseCuesheet(mapped->contents());
+    ASSERT_TRUE(IsOk(cuesheet));
+    Cuesheet expected = SortFlags(*cuesheet);
+
+    ASSERT_TRUE(IsOk(from_proto->Assign(*cuesheet))) << name;
+    Cuesheet found;
+    from_proto->ToCuesheet(&found);
+    EXPECT_TRUE(IsEqual(expected, found)) << name;
+
+    ASSERT_TRUE(IsOk(ParseCompactCuesheet(mapped->contents(), parsed.get())))
+        << name;
+    parsed->ToCuesheet(&found);
+    EXPECT_TRUE(IsEqual(expected, found)) << name;
+  }
+}
+
+TEST(CompactCuesheetTest, Fields) {
+  auto compact = std::make_unique<CompactCuesheet>();
+  ASSERT_TRUE(IsOk(ParseCompactCuesheet(
+      "REM GENRE Ska\n"
+      "TITLE \"Singles\"\n"
+      "FILE \"a.wav\" WAVE\n"
+      "  TRACK 01 AUDIO\n"
+      "    FLAGS PRE DCP\n"
+      "    PREGAP 00:00:30\n"
+      "    INDEX 01 00:00:00\n"
+      "FILE \"b.bin\" BINARY\n"
+      "  TRACK 02 MODE1/2048\n"
+      "    ISRC ABC\n"
+      "    REM A b\n"
+      "    REM C d\n"
+      "    INDEX 00 00:00:00\n"
+      "    INDEX 01 01:00:00\n",
+      compact.get())));
+
+  ASSERT_EQ(2, compact->num_files);
+  ASSERT_EQ(2, compact->num_tracks);
+  ASSERT_EQ(3, compact->num_indices);
+  EXPECT_EQ("Singles", compact->str(compact->tags.title));
+  EXPECT_EQ("b.bin", compact->str(compact->files[1].path));
+  EXPECT_EQ(1, compact->files[1].first_track);
+
+  const CompactCuesheet::Track &first = compact->tracks[0];
+  EXPECT_TRUE(CompactCuesheet::HasFlag(first, Cuesheet::Track::FLAG_PRE));
+  EXPECT_TRUE(CompactCuesheet::HasFlag(first, Cuesheet::Track::FLAG_DCP));
+  EXPECT_FALSE(CompactCuesheet::HasFlag(first, Cuesheet::Track::FLAG_4CH));
+  EXPECT_EQ(30, first.pregap);
+
+  const CompactCuesheet::Track &second = compact->tracks[1];
+  EXPECT_EQ(2, second.number);
+  EXPECT_EQ(Cuesheet::Track::TYPE_MODE1_2048, second.type);
+  EXPECT_EQ("ABC", compact->str(second.isrc));
+  ASSERT_EQ(2, second.tags.comment_tags);
+  const CompactCuesheet::CommentTag &tag =
+      compact->comment_tags[second.tags.first_comment_tag + 1];
+  EXPECT_EQ("C", compact->str(tag.name));
+  EXPECT_EQ("d", compact->str(tag.value));
+  ASSERT_EQ(2, second.indices);
+  EXPECT_EQ(1, compact->index_numbers[second.first_index + 1]);
+  EXPECT_EQ(4500, compact->index_frames[second.first_index + 1]);
+
+  // Clearing keeps nothing but memory.
+  ASSERT_TRUE(IsOk(ParseCompactCuesheet("TITLE x\n", compact.get())));
+  EXPECT_EQ(0, compact->num_files);
+  EXPECT_EQ("x", compact->pool);
+}
+
+TEST(CompactCuesheetTest, DiscCommentTagsAfterTracks) {
+  // A REM between a FILE and its first TRACK is the disc's, so the disc's
+  // comment tags are split around the tracks'.
+  constexpr std::string_view kCuesheet =
+      "REM GENRE Jazz\n"
+      "FILE \"a.wav\" WAVE\n"
+      "  TRACK 01 AUDIO\n"
+      "    REM COMPOSER x\n"
+      "    INDEX 01 00:00:00\n"
+      "FILE \"b.wav\" WAVE\n"
+      "REM DISCID y\n"
+      "  TRACK 02 AUDIO\n"
+      "    REM COMMENT z\n"
+      "    INDEX 01 00:00:00\n"
+      "FILE \"c.wav\" WAVE\n"
+      "REM DATE 1959\n"
+      "  TRACK 03 AUDIO\n"
+      "    INDEX 01 00:00:00\n";
+  absl::StatusOr<Cuesheet> expected = ParseCuesheet(kCuesheet);
+  ASSERT_TRUE(IsOk(expected));
+  ASSERT_EQ(3, expected->tags().comment_tag_size());
+
+  auto compact = std::make_unique<CompactCuesheet>();
+  ASSERT_TRUE(IsOk(ParseCompactCuesheet(kCuesheet, compact.get())));
+  Cuesheet found;
+  compact->ToCuesheet(&found);
+  EXPECT_TRUE(IsEqual(*expected, found));
+}
+
+TEST(CompactCuesheetTest, DoesNotFit) {
+  auto compact = std::make_unique<CompactCuesheet>();
+
+  std::string tracks = "FILE \"a.wav\" WAVE\n";
+  for (int i = 1; i <= 100; i++) {
+    absl::StrAppendFormat(&tracks, "TRACK %02d AUDIO\nINDEX 01 00:00:%02d\n",
+                          i, i % 75);
+  }
+  EXPECT_FALSE(IsOk(ParseCompactCuesheet(tracks, compact.get())));
+
+  EXPECT_FALSE(IsOk(ParseCompactCuesheet(
+      "FILE \"a.wav\" WAVE\nTRACK 256 AUDIO\n", compact.get())));
+  EXPECT_FALSE(IsOk(ParseCompactCuesheet(
+      "FILE \"a.wav\" WAVE\nTRACK 01 AUDIO\nINDEX 01 999999:00:00\n",
+      compact.get())));
+
+  // Each limit says which one was exceeded.
+  Cuesheet cuesheet;
+  Cuesheet::Track *track = cuesheet.add_file()->add_track();
+  track->set_number(1);
+  for (int i = 0; i < 256; i++) track->add_index()->set_number(1);
+  absl::Status status = compact->Assign(cuesheet);
+  EXPECT_EQ(absl::StatusCode::kInvalidArgument, status.code());
+  EXPECT_EQ("Track 1 has more than 255 indices", status.message());
+
+  cuesheet.Clear();
+  Cuesheet::File *file = cuesheet.add_file();
+  for (int i = 1; i <= 3; i++) {
+    track = file->add_track();
+    track->set_number(i);
+    for (int j = 0; j < 200; j++) track->add_index()->set_number(1);
+  }
+  status = compact->Assign(cuesheet);
+  EXPECT_EQ(absl::StatusCode::kInvalidArgument, status.code());
+  EXPECT_EQ("More than 512 indices", status.message());
+
+  cuesheet.Clear();
+  cuesheet.set_catalog("1234");
+  cuesheet.add_file()->add_track()->add_flag(
+      static_cast<Cuesheet::Track::Flag>(8));
+  EXPECT_FALSE(IsOk(compact->Assign(cuesheet)));
+  EXPECT_EQ(0, compact->num_files);
+  EXPECT_EQ("", compact->pool);
+}
+
+}  // namespace
+}  // namespace cue2pb
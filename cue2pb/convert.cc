@@ -0,0 +1,88 @@
+#include "cue2pb/convert.h"
+
+#include "cue2pb/cuesheet.pb.h"
+#include "cue2pb/parser.h"
+#include "cue2pb/text_format.h"
+#include "cue2pb/unparser.h"
+#include "google/protobuf/arena.h"
+#include "util/status_macros.h"
+
+namespace cue2pb {
+
+using ::google::protobuf::Arena;
+
+namespace {
+
+absl::Status AppendProto(const Cuesheet &proto, ProtoFormat format,
+                         std::string *output) {
+  switch (format) {
+    case ProtoFormat::kBinary:
+      if (!proto.AppendToString(output)) {
+        return absl::UnknownError("Failed to serialize binary proto");
+      }
+      break;
+    case ProtoFormat::kText:
+      AppendCuesheetTextProto(proto, output);
+      break;
+  }
+
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+absl::Status CueToProto(std::string_view cuesheet, ProtoFormat format,
+                        std::string *output) {
+  Arena arena;
+  ASSIGN_OR_RETURN(Cuesheet *proto, ParseCuesheet(cuesheet, &arena));
+  return AppendProto(*proto, format, output);
+}
+
+absl::Status CueToProto(std::string_view cuesheet, ProtoFormat format,
+                        const ParseCache *cache, std::string *output) {
+  if (cache == nullptr) return CueToProto(cuesheet, format, output);
+
+  Arena arena;
+  if (absl::StatusOr<ParseCache::Entry> entry = cache->Lookup(cuesheet);
+      entry.ok()) {
+    if (format == ProtoFormat::kBinary) {
+      output->append(entry->proto());
+      return absl::OkStatus();
+    }
+    Cuesheet *proto = Arena::CreateMessage<Cuesheet>(&arena);
+    if (proto->ParseFromArray(entry->proto().data(),
+                              static_cast<int>(entry->proto().size()))) {
+      return AppendProto(*proto, format, output);
+    }
+  }
+
+  ASSIGN_OR_RETURN(Cuesheet *proto, ParseCuesheet(cuesheet, &arena));
+  std::string serialized = proto->SerializeAsString();
+  // The cache only saves time; failing to fill it isn't a failure to convert.
+  cache->Insert(cuesheet, serialized).IgnoreError();
+  if (format == ProtoFormat::kBinary) {
+    output->append(serialized);
+    return absl::OkStatus();
+  }
+  return AppendProto(*proto, format, output);
+}
+
+absl::Status ProtoToCue(std::string_view proto, ProtoFormat format,
+                        std::string *output) {
+  Cuesheet cuesheet;
+  switch (format) {
+    case ProtoFormat::kBinary:
+      if (!cuesheet.ParseFromArray(proto.data(),
+                                   static_cast<int>(proto.size()))) {
+        return absl::UnknownError("Failed to parse binary proto");
+      }
+      break;
+    case ProtoFormat::kText:
+      ASSIGN_OR_RETURN(cuesheet, CuesheetFromTextProto(proto));
+      break;
+  }
+
+  return UnparseCuesheet(cuesheet, output);
+}
+
+}  // namespace cue2pb
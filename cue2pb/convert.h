@@ -0,0 +1,36 @@
+#ifndef CUE2PB_CONVERT_H_
+#define CUE2PB_CONVERT_H_
+
+#include <string>
+#include <string_view>
+
+#include "absl/status/status.h"
+#include "cue2pb/cache.h"
+
+// Whole-buffer conversions between cuesheets and Cuesheet protos, as done by
+// the cue2pb binary.
+
+namespace cue2pb {
+
+enum class ProtoFormat {
+  kBinary,
+  kText,
+};
+
+// Parses a cuesheet, and appends it to *output as a proto in the given format.
+absl::Status CueToProto(std::string_view cuesheet, ProtoFormat format,
+                        std::string *output);
+
+// As above, but cuesheets found in cache aren't parsed again, and those that
+// aren't are added to it. cache may be null.
+absl::Status CueToProto(std::string_view cuesheet, ProtoFormat format,
+                        const ParseCache *cache, std::string *output);
+
+// Parses a Cuesheet proto in the given format, and appends it to *output as a
+// cuesheet.
+absl::Status ProtoToCue(std::string_view proto, ProtoFormat format,
+                        std::string *output);
+
+}  // namespace cue2pb
+
+#endif  // CUE2PB_CONVERT_H_
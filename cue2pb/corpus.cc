@@ -0,0 +1,445 @@
+#include "cue2pb/corpus.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <utility>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "absl/base/config.h"
+#include "absl/strings/str_cat.h"
+#include "cue2pb/frames.h"
+#include "util/errno.h"
+#include "util/status_builder.h"
+#include "util/status_macros.h"
+
+namespace cue2pb {
+namespace {
+
+constexpr std::string_view kColumnMagic = "CUECOL01";
+constexpr size_t kColumnHeaderSize = 16;
+constexpr std::string_view kMetaMagic = "CUECORP1";
+constexpr char kMetaFile[] = "corpus.meta";
+
+// Flush a column's buffer once it holds this much.
+constexpr size_t kFlushThreshold = 256 * 1024;
+
+struct ColumnSpec {
+  const char *name;
+  uint32_t width;
+  CorpusTable table;  // Whose rows the column has values for.
+  // For offsets columns, the table they're offsets into, which is also the
+  // last value. Otherwise the same as table.
+  CorpusTable children;
+};
+
+constexpr ColumnSpec Values(const char *name, uint32_t width,
+                            CorpusTable table) {
+  return {name, width, table, table};
+}
+
+constexpr ColumnSpec Offsets(const char *name, uint32_t width,
+                             CorpusTable table, CorpusTable children) {
+  return {name, width, table, children};
+}
+
+bool IsOffsets(const ColumnSpec &spec) { return spec.table != spec.children; }
+
+using Table = CorpusTable;
+
+// Indexed by CorpusColumn.
+constexpr ColumnSpec kColumns[] = {
+  Values("disc.catalog", 4, Table::kDiscs),
+  Values("disc.cd_text_file", 4, Table::kDiscs),
+  Values("disc.title", 4, Table::kDiscs),
+  Values("disc.performer", 4, Table::kDiscs),
+  Values("disc.songwriter", 4, Table::kDiscs),
+  Offsets("disc.files", 4, Table::kDiscs, Table::kFiles),
+  Offsets("disc.tracks", 4, Table::kDiscs, Table::kTracks),
+  Offsets("disc.comment_tags", 4, Table::kDiscs, Table::kDiscCommentTags),
+  Values("file.path", 4, Table::kFiles),
+  Values("file.type", 1, Table::kFiles),
+  Offsets("file.tracks", 4, Table::kFiles, Table::kTracks),
+  Values("track.number", 4, Table::kTracks),
+  Values("track.type", 1, Table::kTracks),
+  Values("track.flags", 1, Table::kTracks),
+  Values("track.isrc", 4, Table::kTracks),
+  Values("track.pregap", 4, Table::kTracks),
+  Values("track.postgap", 4, Table::kTracks),
+  Values("track.title", 4, Table::kTracks),
+  Values("track.performer", 4, Table::kTracks),
+  Values("track.songwriter", 4, Table::kTracks),
+  Offsets("track.indices", 4, Table::kTracks, Table::kIndices),
+  Offsets("track.comment_tags", 4, Table::kTracks, Table::kTrackCommentTags),
+  Values("index.number", 4, Table::kIndices),
+  Values("index.frames", 4, Table::kIndices),
+  Values("disc_comment_tag.name", 4, Table::kDiscCommentTags),
+  Values("disc_comment_tag.value", 4, Table::kDiscCommentTags),
+  Values("track_comment_tag.name", 4, Table::kTrackCommentTags),
+  Values("track_comment_tag.value", 4, Table::kTrackCommentTags),
+  Offsets("string.offsets", 8, Table::kStrings, Table::kStringBytes),
+  Values("string.bytes", 1, Table::kStringBytes),
+};
+static_assert(std::size(kColumns) == kNumCorpusColumns);
+
+std::string ColumnPath(std::string_view dir, CorpusColumn c) {
+  return absl::StrCat(dir, "/", kColumns[static_cast<int>(c)].name, ".col");
+}
+
+absl::Status CheckLittleEndian() {
+#ifdef ABSL_IS_BIG_ENDIAN
+  return absl::UnimplementedError("Corpora are only supported on "
+                                  "little-endian machines");
+#else
+  return absl::OkStatus();
+#endif
+}
+
+absl::Status MakeDirectory(const std::string &path) {
+  if (mkdir(path.c_str(), 0777) == -1 && errno != EEXIST) {
+    return util::StatusBuilder(util::ErrnoAsStatus())
+        << "Failed to create " << path;
+  }
+  return absl::OkStatus();
+}
+
+bool FitsInt32(int64_t frames) {
+  return frames >= std::numeric_limits<int32_t>::min() &&
+      frames <= std::numeric_limits<int32_t>::max();
+}
+
+// Checks everything Add() could fail on, so that it fails before adding
+// anything.
+absl::Status CheckFits(const Cuesheet &cuesheet) {
+  for (const Cuesheet::File &file : cuesheet.file()) {
+    if (file.type() < 0 || file.type() > 255) {
+      return util::InvalidArgumentErrorBuilder()
+          << "File type " << file.type() << " doesn't fit in a corpus";
+    }
+    for (const Cuesheet::Track &track : file.track()) {
+      if (track.type() < 0 || track.type() > 255) {
+        return util::InvalidArgumentErrorBuilder()
+            << "Track type " << track.type() << " doesn't fit in a corpus";
+      }
+      for (int flag : track.flag()) {
+        if (flag < 0 || flag >= 8) {
+          return util::InvalidArgumentErrorBuilder()
+              << "Flag " << flag << " doesn't fit in a corpus";
+        }
+      }
+      bool fits = FitsInt32(PregapFrames(track)) &&
+          FitsInt32(PostgapFrames(track));
+      for (const Cuesheet::Index &index : track.index()) {
+        fits = fits && FitsInt32(PositionFrames(index));
+      }
+      if (!fits) {
+        return util::InvalidArgumentErrorBuilder()
+            << "A position of track " << track.number()
+            << " doesn't fit in a corpus";
+      }
+    }
+  }
+  return absl::OkStatus();
+}
+
+uint64_t ReadUint64(const char *data) {
+  uint64_t value;
+  std::memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+}  // namespace
+
+CorpusWriter::Column::Column(Column &&other)
+  : fd_(std::exchange(other.fd_, -1)),
+    buffer_(std::move(other.buffer_))
+  {}
+
+CorpusWriter::Column::~Column() {
+  if (fd_ != -1) close(fd_);
+}
+
+absl::Status CorpusWriter::Column::Open(const std::string &path,
+                                        uint32_t width) {
+  fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+  if (fd_ == -1) {
+    return util::StatusBuilder(util::ErrnoAsStatus())
+        << "Failed to create " << path;
+  }
+  buffer_.append(kColumnMagic);
+  Append(width);
+  Append(uint32_t{0});
+  return absl::OkStatus();
+}
+
+absl::Status CorpusWriter::Column::MaybeFlush() {
+  if (buffer_.size() < kFlushThreshold) return absl::OkStatus();
+  RETURN_IF_ERROR(util::WriteFully(fd_, buffer_));
+  buffer_.clear();
+  return absl::OkStatus();
+}
+
+absl::Status CorpusWriter::Column::Close() {
+  RETURN_IF_ERROR(util::WriteFully(fd_, buffer_));
+  buffer_.clear();
+  int fd = std::exchange(fd_, -1);
+  if (close(fd) == -1) return util::ErrnoAsStatus();
+  return absl::OkStatus();
+}
+
+absl::StatusOr<CorpusWriter> CorpusWriter::Create(std::string_view dir) {
+  RETURN_IF_ERROR(CheckLittleEndian());
+  RETURN_IF_ERROR(MakeDirectory(std::string(dir)));
+
+  // The columns are about to be truncated, so a previous corpus's metadata
+  // mustn't outlive them.
+  std::string meta_path = absl::StrCat(dir, "/", kMetaFile);
+  if (unlink(meta_path.c_str()) == -1 && errno != ENOENT) {
+    return util::StatusBuilder(util::ErrnoAsStatus())
+        << "Failed to remove " << meta_path;
+  }
+
+  CorpusWriter writer{std::string(dir)};
+  for (int c = 0; c < kNumCorpusColumns; c++) {
+    RETURN_IF_ERROR(writer.columns_[c].Open(
+        ColumnPath(dir, static_cast<CorpusColumn>(c)), kColumns[c].width));
+  }
+  // String 0 is the empty string, which starts and ends at 0.
+  writer.strings_.emplace("", 0);
+  writer.rows(CorpusTable::kStrings) = 1;
+  writer.column(CorpusColumn::kStringOffsets).Append(uint64_t{0});
+  writer.column(CorpusColumn::kStringOffsets).Append(uint64_t{0});
+  return std::move(writer);
+}
+
+CorpusWriter::CorpusWriter(std::string dir)
+  : dir_(std::move(dir)),
+    columns_(kNumCorpusColumns),
+    rows_(kNumCorpusTables)
+  {}
+
+uint32_t CorpusWriter::Intern(std::string_view str) {
+  auto [it, inserted] = strings_.try_emplace(
+      str, static_cast<uint32_t>(rows(CorpusTable::kStrings)));
+  if (inserted) {
+    column(CorpusColumn::kStringBytes).Append(str);
+    rows(CorpusTable::kStringBytes) += str.size();
+    column(CorpusColumn::kStringOffsets)
+        .Append(rows(CorpusTable::kStringBytes));
+    rows(CorpusTable::kStrings)++;
+  }
+  return it->second;
+}
+
+absl::Status CorpusWriter::CheckRoom(const Cuesheet &cuesheet) const {
+  uint64_t added[kNumCorpusTables] = {};
+  auto add = [&added](CorpusTable t, uint64_t n) {
+    added[static_cast<int>(t)] += n;
+  };
+  // Strings are counted as if each were new.
+  add(CorpusTable::kDiscs, 1);
+  add(CorpusTable::kDiscCommentTags, cuesheet.tags().comment_tag_size());
+  add(CorpusTable::kStrings, 5 + 2 * cuesheet.tags().comment_tag_size());
+  for (const Cuesheet::File &file : cuesheet.file()) {
+    add(CorpusTable::kFiles, 1);
+    add(CorpusTable::kStrings, 1);
+    for (const Cuesheet::Track &track : file.track()) {
+      add(CorpusTable::kTracks, 1);
+      add(CorpusTable::kIndices, track.index_size());
+      add(CorpusTable::kTrackCommentTags, track.tags().comment_tag_size());
+      add(CorpusTable::kStrings, 4 + 2 * track.tags().comment_tag_size());
+    }
+  }
+
+  // String bytes are the only table with 64-bit offsets.
+  constexpr const char *kNames[] = {
+    "discs", "files", "tracks", "indices", "disc comment tags",
+    "track comment tags", "strings",
+  };
+  for (int t = 0; t < static_cast<int>(std::size(kNames)); t++) {
+    if (rows_[t] + added[t] > UINT32_MAX) {
+      return absl::ResourceExhaustedError(absl::StrCat(
+          "A corpus can't hold more than ", UINT32_MAX, " ", kNames[t]));
+    }
+  }
+  return absl::OkStatus();
+}
+
+absl::Status CorpusWriter::Add(const Cuesheet &cuesheet) {
+  RETURN_IF_ERROR(CheckFits(cuesheet));
+  RETURN_IF_ERROR(CheckRoom(cuesheet));
+
+  auto append_offset = [this](CorpusColumn c, CorpusTable children) {
+    column(c).Append(static_cast<uint32_t>(rows(children)));
+  };
+  auto append_string = [this](CorpusColumn c, std::string_view str) {
+    column(c).Append(Intern(str));
+  };
+
+  append_string(CorpusColumn::kDiscCatalog, cuesheet.catalog());
+  append_string(CorpusColumn::kDiscCdTextFile, cuesheet.cd_text_file());
+  append_string(CorpusColumn::kDiscTitle, cuesheet.tags().title());
+  append_string(CorpusColumn::kDiscPerformer, cuesheet.tags().performer());
+  append_string(CorpusColumn::kDiscSongwriter, cuesheet.tags().songwriter());
+  append_offset(CorpusColumn::kDiscFiles, CorpusTable::kFiles);
+  append_offset(CorpusColumn::kDiscTracks, CorpusTable::kTracks);
+  append_offset(CorpusColumn::kDiscCommentTags, CorpusTable::kDiscCommentTags);
+  for (const Cuesheet::CommentTag &tag : cuesheet.tags().comment_tag()) {
+    append_string(CorpusColumn::kDiscCommentTagName, tag.name());
+    append_string(CorpusColumn::kDiscCommentTagValue, tag.value());
+    rows(CorpusTable::kDiscCommentTags)++;
+  }
+
+  for (const Cuesheet::File &file : cuesheet.file()) {
+    append_string(CorpusColumn::kFilePath, file.path());
+    column(CorpusColumn::kFileType).Append(static_cast<uint8_t>(file.type()));
+    append_offset(CorpusColumn::kFileTracks, CorpusTable::kTracks);
+    rows(CorpusTable::kFiles)++;
+
+    for (const Cuesheet::Track &track : file.track()) {
+      uint8_t flags = 0;
+      for (int flag : track.flag()) flags |= 1 << flag;
+      column(CorpusColumn::kTrackNumber).Append(track.number());
+      column(CorpusColumn::kTrackType)
+          .Append(static_cast<uint8_t>(track.type()));
+      column(CorpusColumn::kTrackFlags).Append(flags);
+      append_string(CorpusColumn::kTrackIsrc, track.isrc());
+      column(CorpusColumn::kTrackPregap)
+          .Append(static_cast<int32_t>(PregapFrames(track)));
+      column(CorpusColumn::kTrackPostgap)
+          .Append(static_cast<int32_t>(PostgapFrames(track)));
+      append_string(CorpusColumn::kTrackTitle, track.tags().title());
+      append_string(CorpusColumn::kTrackPerformer, track.tags().performer());
+      append_string(CorpusColumn::kTrackSongwriter,
+                    track.tags().songwriter());
+      append_offset(CorpusColumn::kTrackIndices, CorpusTable::kIndices);
+      append_offset(CorpusColumn::kTrackCommentTags,
+                    CorpusTable::kTrackCommentTags);
+      rows(CorpusTable::kTracks)++;
+
+      for (const Cuesheet::Index &index : track.index()) {
+        column(CorpusColumn::kIndexNumber).Append(index.number());
+        column(CorpusColumn::kIndexFrames)
+            .Append(static_cast<int32_t>(PositionFrames(index)));
+        rows(CorpusTable::kIndices)++;
+      }
+      for (const Cuesheet::CommentTag &tag : track.tags().comment_tag()) {
+        append_string(CorpusColumn::kTrackCommentTagName, tag.name());
+        append_string(CorpusColumn::kTrackCommentTagValue, tag.value());
+        rows(CorpusTable::kTrackCommentTags)++;
+      }
+    }
+  }
+  rows(CorpusTable::kDiscs)++;
+
+  for (Column &c : columns_) RETURN_IF_ERROR(c.MaybeFlush());
+  return absl::OkStatus();
+}
+
+absl::Status CorpusWriter::Finish() {
+  for (int c = 0; c < kNumCorpusColumns; c++) {
+    const ColumnSpec &spec = kColumns[c];
+    // Each offsets column ends with the number of children. Only the string
+    // offsets are 64-bit, and those are appended as strings are interned.
+    if (IsOffsets(spec) && spec.width == 4) {
+      columns_[c].Append(static_cast<uint32_t>(rows(spec.children)));
+    }
+    RETURN_IF_ERROR(columns_[c].Close());
+  }
+
+  std::string meta(kMetaMagic);
+  for (uint64_t n : rows_) {
+    meta.append(reinterpret_cast<const char*>(&n), sizeof(n));
+  }
+  return util::WriteFile(absl::StrCat(dir_, "/", kMetaFile), meta);
+}
+
+absl::StatusOr<CorpusReader> CorpusReader::Open(std::string_view dir) {
+  RETURN_IF_ERROR(CheckLittleEndian());
+
+  ASSIGN_OR_RETURN(util::MappedFile meta_file,
+                   util::MappedFile::Open(absl::StrCat(dir, "/", kMetaFile)));
+  std::string_view meta = meta_file.contents();
+  if (meta.size() != kMetaMagic.size() + kNumCorpusTables * 8 ||
+      meta.substr(0, kMetaMagic.size()) != kMetaMagic) {
+    return util::DataLossErrorBuilder()
+        << "Corrupt corpus metadata in " << dir;
+  }
+
+  CorpusReader reader;
+  for (int t = 0; t < kNumCorpusTables; t++) {
+    reader.rows_.push_back(
+        ReadUint64(meta.data() + kMetaMagic.size() + t * 8));
+  }
+
+  for (int c = 0; c < kNumCorpusColumns; c++) {
+    const ColumnSpec &spec = kColumns[c];
+    std::string path = ColumnPath(dir, static_cast<CorpusColumn>(c));
+    ASSIGN_OR_RETURN(util::MappedFile file, util::MappedFile::Open(path));
+    std::string_view contents = file.contents();
+
+    uint64_t values = reader.rows(spec.table) + (IsOffsets(spec) ? 1 : 0);
+    uint32_t width = 0;
+    if (contents.size() >= kColumnHeaderSize) {
+      std::memcpy(&width, contents.data() + kColumnMagic.size(),
+                  sizeof(width));
+    }
+    if (contents.size() < kColumnHeaderSize ||
+        contents.substr(0, kColumnMagic.size()) != kColumnMagic ||
+        width != spec.width ||
+        (contents.size() - kColumnHeaderSize) / width != values ||
+        (contents.size() - kColumnHeaderSize) % width != 0) {
+      return util::DataLossErrorBuilder() << "Corrupt corpus column " << path;
+    }
+    size_t size = contents.size() - kColumnHeaderSize;
+    reader.columns_.push_back({std::move(file), kColumnHeaderSize, size});
+  }
+
+  // Offsets are checked up front, so that following them never has to be.
+  for (int c = 0; c < kNumCorpusColumns; c++) {
+    const ColumnSpec &spec = kColumns[c];
+    if (!IsOffsets(spec)) continue;
+    auto check = [&](auto offsets) {
+      bool valid = offsets[0] == 0 &&
+          offsets[offsets.size() - 1] == reader.rows(spec.children);
+      for (size_t i = 1; valid && i < offsets.size(); i++) {
+        valid = offsets[i - 1] <= offsets[i];
+      }
+      return valid;
+    };
+    auto column = static_cast<CorpusColumn>(c);
+    bool valid = spec.width == 8 ? check(reader.column<uint64_t>(column))
+                                 : check(reader.column<uint32_t>(column));
+    if (!valid) {
+      return util::DataLossErrorBuilder()
+          << "Corrupt corpus offsets in " << ColumnPath(dir, column);
+    }
+  }
+  return std::move(reader);
+}
+
+std::string_view CorpusReader::string(uint32_t id) const {
+  if (id >= rows(CorpusTable::kStrings)) return {};
+  auto offsets = column<uint64_t>(CorpusColumn::kStringOffsets);
+  auto bytes = column<char>(CorpusColumn::kStringBytes);
+  return std::string_view(bytes.data() + offsets[id],
+                          offsets[id + 1] - offsets[id]);
+}
+
+int64_t CorpusReader::FindString(std::string_view str) const {
+  for (uint32_t id = 0; id < rows(CorpusTable::kStrings); id++) {
+    if (string(id) == str) return id;
+  }
+  return -1;
+}
+
+void RangeSizes(absl::Span<const uint32_t> offsets, uint32_t *sizes) {
+  for (size_t i = 0; i + 1 < offsets.size(); i++) {
+    sizes[i] = offsets[i + 1] - offsets[i];
+  }
+}
+
+}  // namespace cue2pb
@@ -0,0 +1,218 @@
+#ifndef CUE2PB_CORPUS_H_
+#define CUE2PB_CORPUS_H_
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "cue2pb/cuesheet.pb.h"
+#include "util/file.h"
+
+// A corpus is many Cuesheets stored column by column, for queries that look
+// at one or two fields of every disc: each field of each kind of row is a
+// separate file of fixed-width values, which the reader maps and hands out as
+// arrays. A query over pregaps, say, reads nothing but the pregaps.
+//
+// Rows that nest (a disc's files, tracks and comment tags, a track's indices)
+// are found through offsets columns: row i's children are
+// [offsets[i], offsets[i + 1]), so an offsets column has one more value than
+// its parent has rows. Strings are ids into a table of the distinct strings
+// of the whole corpus, in which id 0 is the empty string.
+//
+// A corpus is a directory holding, with every integer little-endian:
+//
+//   <column>.col, for each CorpusColumn:
+//       "CUECOL01"
+//       uint32 width of each value
+//       uint32 reserved
+//       the values
+//   corpus.meta, written last:
+//       "CUECORP1"
+//       uint64 number of rows of each CorpusTable, in order
+
+namespace cue2pb {
+
+enum class CorpusTable {
+  kDiscs,
+  kFiles,
+  kTracks,
+  kIndices,
+  kDiscCommentTags,
+  kTrackCommentTags,
+  kStrings,
+  kStringBytes,
+};
+
+inline constexpr int kNumCorpusTables = 8;
+
+enum class CorpusColumn {
+  // Per disc.
+  kDiscCatalog,  // uint32 string.
+  kDiscCdTextFile,  // uint32 string.
+  kDiscTitle,  // uint32 string.
+  kDiscPerformer,  // uint32 string.
+  kDiscSongwriter,  // uint32 string.
+  kDiscFiles,  // uint32 offsets into files.
+  kDiscTracks,  // uint32 offsets into tracks.
+  kDiscCommentTags,  // uint32 offsets into disc comment tags.
+
+  // Per file.
+  kFilePath,  // uint32 string.
+  kFileType,  // uint8 Cuesheet::File::Type.
+  kFileTracks,  // uint32 offsets into tracks.
+
+  // Per track.
+  kTrackNumber,  // int32.
+  kTrackType,  // uint8 Cuesheet::Track::Type.
+  kTrackFlags,  // uint8, with bit 1 << f set for each Cuesheet::Track::Flag f.
+  kTrackIsrc,  // uint32 string.
+  kTrackPregap,  // int32 frames.
+  kTrackPostgap,  // int32 frames.
+  kTrackTitle,  // uint32 string.
+  kTrackPerformer,  // uint32 string.
+  kTrackSongwriter,  // uint32 string.
+  kTrackIndices,  // uint32 offsets into indices.
+  kTrackCommentTags,  // uint32 offsets into track comment tags.
+
+  // Per index.
+  kIndexNumber,  // int32.
+  kIndexFrames,  // int32 frames.
+
+  // Per comment tag.
+  kDiscCommentTagName,  // uint32 string.
+  kDiscCommentTagValue,  // uint32 string.
+  kTrackCommentTagName,  // uint32 string.
+  kTrackCommentTagValue,  // uint32 string.
+
+  // Per string.
+  kStringOffsets,  // uint64 offsets into string bytes.
+  kStringBytes,  // char.
+};
+
+inline constexpr int kNumCorpusColumns = 30;
+
+class CorpusWriter {
+ public:
+  // Creates dir if need be, and starts writing a corpus in it.
+  static absl::StatusOr<CorpusWriter> Create(std::string_view dir);
+
+  CorpusWriter(CorpusWriter &&other) = default;
+  CorpusWriter &operator=(CorpusWriter &&other) = delete;
+  CorpusWriter(const CorpusWriter &) = delete;
+  CorpusWriter &operator=(const CorpusWriter &) = delete;
+
+  // Fails if the cuesheet doesn't fit: a position past an int32 of frames, a
+  // flag above 7, or a type above 255; or if the corpus would have more than
+  // UINT32_MAX rows of a table other than string bytes, whose offsets would
+  // overflow. Nothing is added then.
+  absl::Status Add(const Cuesheet &cuesheet);
+
+  // Finishes every column, and then atomically writes corpus.meta. Until
+  // then, the directory holds no corpus: Create() removes any old
+  // corpus.meta before truncating the columns.
+  absl::Status Finish();
+
+ private:
+  class Column {
+   public:
+    Column() = default;
+    Column(Column &&other);
+    Column &operator=(Column &&other) = delete;
+    ~Column();
+
+    absl::Status Open(const std::string &path, uint32_t width);
+
+    template <typename T>
+    void Append(T value) {
+      buffer_.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+    void Append(std::string_view bytes) { buffer_.append(bytes); }
+
+    absl::Status MaybeFlush();
+    absl::Status Close();
+
+   private:
+    int fd_ = -1;
+    std::string buffer_;
+  };
+
+  explicit CorpusWriter(std::string dir);
+
+  Column &column(CorpusColumn c) { return columns_[static_cast<int>(c)]; }
+  uint64_t &rows(CorpusTable t) { return rows_[static_cast<int>(t)]; }
+  uint32_t Intern(std::string_view str);
+  absl::Status CheckRoom(const Cuesheet &cuesheet) const;
+
+  std::string dir_;
+  std::vector<Column> columns_;
+  std::vector<uint64_t> rows_;
+  absl::flat_hash_map<std::string, uint32_t> strings_;
+};
+
+class CorpusReader {
+ public:
+  static absl::StatusOr<CorpusReader> Open(std::string_view dir);
+
+  uint64_t rows(CorpusTable table) const {
+    return rows_[static_cast<int>(table)];
+  }
+
+  // The values of a column, where T is the type it's documented as holding.
+  template <typename T>
+  absl::Span<const T> column(CorpusColumn c) const {
+    const Mapping &m = columns_[static_cast<int>(c)];
+    return absl::Span<const T>(
+        reinterpret_cast<const T*>(m.file.contents().data() + m.offset),
+        m.size / sizeof(T));
+  }
+
+  std::string_view string(uint32_t id) const;
+
+  // The id of str, or -1 if no string of the corpus is str. This is a scan
+  // of the whole string table, so look strings up once per query, and then
+  // compare ids.
+  int64_t FindString(std::string_view str) const;
+
+ private:
+  struct Mapping {
+    util::MappedFile file;
+    size_t offset;
+    size_t size;
+  };
+
+  CorpusReader() = default;
+
+  std::vector<Mapping> columns_;
+  std::vector<uint64_t> rows_;
+};
+
+// Scans over columns. Each is a plain loop over an array, which the compiler
+// vectorizes.
+
+// How many values of column are value.
+template <typename T>
+uint64_t CountEqual(absl::Span<const T> column, T value) {
+  uint64_t count = 0;
+  for (T v : column) count += v == value;
+  return count;
+}
+
+template <typename T>
+int64_t Sum(absl::Span<const T> column) {
+  int64_t sum = 0;
+  for (T v : column) sum += v;
+  return sum;
+}
+
+// Sets sizes[i] to the number of children of row i of an offsets column.
+void RangeSizes(absl::Span<const uint32_t> offsets, uint32_t *sizes);
+
+}  // namespace cue2pb
+
+#endif  // CUE2PB_CORPUS_H_
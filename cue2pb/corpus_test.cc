@@ -0,0 +1,205 @@
+#include "cue2pb/corpus.h"
+
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <vector>
+#include <stdlib.h>
+
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "cue2pb/frames.h"
+#include "cue2pb/parser.h"
+#include "util/file.h"
+#include "util/testing/assertions.h"
+
+namespace cue2pb {
+
+using ::util::IsOk;
+
+namespace {
+
+constexpr const char *kTestdata[] = {
+  "complete_small", "eac_multifile_gapless", "eac_multifile_gaps",
+  "eac_singlefile", "full_disc", "hidden_track",
+};
+
+class CorpusTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    char dir_template[] = "/tmp/corpus_test.XXXXXX";
+    dir_ = mkdtemp(dir_template);
+
+    for (const char *name : kTestdata) {
+      auto mapped = util::MappedFile::Open(
+          absl::StrCat("cue2pb/testdata/", name, ".cue"));
+      ASSERT_TRUE(IsOk(mapped));
+      absl::StatusOr<Cuesheet> cuesheet = ParseCuesheet(mapped->contents());
+      ASSERT_TRUE(IsOk(cuesheet));
+      cuesheets_.push_back(*std::move(cuesheet));
+    }
+  }
+
+  void TearDown() override {
+    std::error_code ec;
+    std::filesystem::remove_all(dir_, ec);
+  }
+
+  void WriteCorpus() {
+    auto writer = CorpusWriter::Create(dir_);
+    ASSERT_TRUE(IsOk(writer));
+    for (const Cuesheet &cuesheet : cuesheets_) {
+      ASSERT_TRUE(IsOk(writer->Add(cuesheet)));
+    }
+    ASSERT_TRUE(IsOk(writer->Finish()));
+  }
+
+  std::string dir_;
+  std::vector<Cuesheet> cuesheets_;
+};
+
+TEST_F(CorpusTest, RoundTrip) {
+  WriteCorpus();
+  auto reader = CorpusReader::Open(dir_);
+  ASSERT_TRUE(IsOk(reader));
+  ASSERT_EQ(cuesheets_.size(), reader->rows(CorpusTable::kDiscs));
+
+  auto disc_tracks = reader->column<uint32_t>(CorpusColumn::kDiscTracks);
+  auto titles = reader->column<uint32_t>(CorpusColumn::kTrackTitle);
+  auto track_indices = reader->column<uint32_t>(CorpusColumn::kTrackIndices);
+  auto index_frames = reader->column<int32_t>(CorpusColumn::kIndexFrames);
+  auto pregaps = reader->column<int32_t>(CorpusColumn::kTrackPregap);
+  auto flags = reader->column<uint8_t>(CorpusColumn::kTrackFlags);
+  for (size_t d = 0; d < cuesheets_.size(); d++) {
+    const Cuesheet &cuesheet = cuesheets_[d];
+    EXPECT_EQ(cuesheet.tags().title(),
+              reader->string(
+                  reader->column<uint32_t>(CorpusColumn::kDiscTitle)[d]));
+
+    uint32_t t = disc_tracks[d];
+    for (const Cuesheet::File &file : cuesheet.file()) {
+      for (const Cuesheet::Track &track : file.track()) {
+        EXPECT_EQ(track.tags().title(), reader->string(titles[t]));
+        EXPECT_EQ(PregapFrames(track), pregaps[t]);
+        for (int flag : track.flag()) EXPECT_TRUE((flags[t] >> flag) & 1);
+        ASSERT_EQ(track.index_size(),
+                  track_indices[t + 1] - track_indices[t]);
+        for (int i = 0; i < track.index_size(); i++) {
+          EXPECT_EQ(PositionFrames(track.index(i)),
+                    index_frames[track_indices[t] + i]);
+        }
+        t++;
+      }
+    }
+    EXPECT_EQ(disc_tracks[d + 1], t);
+  }
+}
+
+TEST_F(CorpusTest, Queries) {
+  WriteCorpus();
+  auto reader = CorpusReader::Open(dir_);
+  ASSERT_TRUE(IsOk(reader));
+
+  // Total pregap, and discs with a track missing an ISRC.
+  int64_t pregaps = 0;
+  size_t expected_missing = 0;
+  for (const Cuesheet &cuesheet : cuesheets_) {
+    bool missing = false;
+    for (const Cuesheet::File &file : cuesheet.file()) {
+      for (const Cuesheet::Track &track : file.track()) {
+        pregaps += PregapFrames(track);
+        missing = missing || track.isrc().empty();
+      }
+    }
+    expected_missing += missing;
+  }
+  EXPECT_LT(0, pregaps);
+  EXPECT_LT(0, expected_missing);
+  EXPECT_EQ(pregaps,
+            Sum(reader->column<int32_t>(CorpusColumn::kTrackPregap)));
+
+  auto disc_tracks = reader->column<uint32_t>(CorpusColumn::kDiscTracks);
+  auto isrcs = reader->column<uint32_t>(CorpusColumn::kTrackIsrc);
+  size_t missing = 0;
+  for (size_t d = 0; d + 1 < disc_tracks.size(); d++) {
+    missing += CountEqual(isrcs.subspan(disc_tracks[d],
+                                        disc_tracks[d + 1] - disc_tracks[d]),
+                          uint32_t{0}) > 0;
+  }
+  EXPECT_EQ(expected_missing, missing);
+
+  // Discs with a REM GENRE of Ska.
+  int64_t genre = reader->FindString("GENRE");
+  int64_t ska = reader->FindString("Ska");
+  ASSERT_LE(0, genre);
+  ASSERT_LE(0, ska);
+  auto names = reader->column<uint32_t>(CorpusColumn::kDiscCommentTagName);
+  auto values = reader->column<uint32_t>(CorpusColumn::kDiscCommentTagValue);
+  size_t ska_tags = 0;
+  for (size_t i = 0; i < names.size(); i++) {
+    ska_tags += names[i] == genre && values[i] == ska;
+  }
+  EXPECT_LT(0, ska_tags);
+  EXPECT_EQ(-1, reader->FindString("No such string"));
+
+  std::vector<uint32_t> tracks(reader->rows(CorpusTable::kDiscs));
+  RangeSizes(disc_tracks, tracks.data());
+  for (size_t d = 0; d < cuesheets_.size(); d++) {
+    uint32_t expected = 0;
+    for (const Cuesheet::File &file : cuesheets_[d].file()) {
+      expected += file.track_size();
+    }
+    EXPECT_EQ(expected, tracks[d]);
+  }
+}
+
+TEST_F(CorpusTest, AddIsAllOrNothing) {
+  {
+    auto writer = CorpusWriter::Create(dir_);
+    ASSERT_TRUE(IsOk(writer));
+    Cuesheet too_far;
+    too_far.mutable_tags()->set_title("Too far");
+    too_far.add_file()->add_track()->add_index()->mutable_position()
+        ->set_minute(1000000);
+    EXPECT_FALSE(IsOk(writer->Add(too_far)));
+    ASSERT_TRUE(IsOk(writer->Add(cuesheets_[0])));
+    ASSERT_TRUE(IsOk(writer->Finish()));
+  }
+
+  auto reader = CorpusReader::Open(dir_);
+  ASSERT_TRUE(IsOk(reader));
+  EXPECT_EQ(1, reader->rows(CorpusTable::kDiscs));
+  EXPECT_EQ(-1, reader->FindString("Too far"));
+}
+
+TEST_F(CorpusTest, Corrupt) {
+  // Unfinished.
+  {
+    auto writer = CorpusWriter::Create(dir_);
+    ASSERT_TRUE(IsOk(writer));
+    ASSERT_TRUE(IsOk(writer->Add(cuesheets_[0])));
+  }
+  EXPECT_FALSE(IsOk(CorpusReader::Open(dir_)));
+
+  WriteCorpus();
+  ASSERT_TRUE(IsOk(CorpusReader::Open(dir_)));
+
+  // Rewriting a corpus leaves none until it's finished.
+  {
+    auto writer = CorpusWriter::Create(dir_);
+    ASSERT_TRUE(IsOk(writer));
+    ASSERT_TRUE(IsOk(writer->Add(cuesheets_[0])));
+  }
+  EXPECT_FALSE(IsOk(CorpusReader::Open(dir_)));
+
+  WriteCorpus();
+  ASSERT_TRUE(IsOk(CorpusReader::Open(dir_)));
+  ASSERT_TRUE(IsOk(util::WriteFile(dir_ + "/track.pregap.col", "CUECOL01")));
+  auto reader = CorpusReader::Open(dir_);
+  EXPECT_EQ(absl::StatusCode::kDataLoss, reader.status().code());
+}
+
+}  // namespace
+}  // namespace cue2pb
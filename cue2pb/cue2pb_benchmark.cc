@@ -0,0 +1,491 @@
+#include <filesystem>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "benchmark/benchmark.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/str_split.h"
+#include "cue2pb/compact.h"
+#include "cue2pb/corpus.h"
+#include "cue2pb/cuesheet.pb.h"
+#include "cue2pb/frames.h"
+#include "cue2pb/msf.h"
+#include "cue2pb/parser.h"
+#include "cue2pb/tag_index.h"
+#include "cue2pb/text_format.h"
+#include "cue2pb/timeline.h"
+#include "cue2pb/unparser.h"
+#include "cue2pb/visitor.h"
+#include "google/protobuf/arena.h"
+#include "google/protobuf/text_format.h"
+#include "util/file.h"
+#include "util/status_macros.h"
+
+namespace cue2pb {
+namespace {
+
+using ::google::protobuf::Arena;
+using ::google::protobuf::TextFormat;
+
+// Generates a cuesheet that is as large as a real disc can get: the maximum of
+// 99 tracks, each with several indices, comment tags and long quoted titles.
+std::string SyntheticCuesheet(int num_tracks, int indices_per_track,
+                              int comment_tags, int title_length) {
+  std::string title(title_length, 'x');
+  std::string out;
+  for (int i = 0; i < comment_tags; i++) {
+    absl::StrAppendFormat(&out, "REM TAG%d \"%s\"\n", i, title);
+  }
+  absl::StrAppendFormat(&out, "PERFORMER \"%s\"\n", title);
+  absl::StrAppendFormat(&out, "TITLE \"%s\"\n", title);
+  absl::StrAppend(&out, "CATALOG 0123456789012\n");
+  absl::StrAppendFormat(&out, "FILE \"%s.wav\" WAVE\n", title);
+
+  int frames = 0;
+  for (int track = 1; track <= num_tracks; track++) {
+    absl::StrAppendFormat(&out, "  TRACK %02d AUDIO\n", track);
+    absl::StrAppendFormat(&out, "    TITLE \"%s\"\n", title);
+    absl::StrAppendFormat(&out, "    PERFORMER \"%s\"\n", title);
+    absl::StrAppendFormat(&out, "    SONGWRITER \"%s\"\n", title);
+    for (int i = 0; i < comment_tags; i++) {
+      absl::StrAppendFormat(&out, "    REM TAG%d \"%s\"\n", i, title);
+    }
+    absl::StrAppendFormat(&out, "    ISRC USRC1760%04d\n", track);
+    absl::StrAppend(&out, "    FLAGS DCP 4CH PRE\n");
+    for (int index = 0; index < indices_per_track; index++) {
+      absl::StrAppendFormat(&out, "    INDEX %02d %02d:%02d:%02d\n", index,
+                            frames / (75 * 60), frames / 75 % 60, frames % 75);
+      frames += 75 * 17 + 13;
+    }
+  }
+  return out;
+}
+
+constexpr const char *kTestdata[] = {
+  "eac_multifile_gapless", "eac_multifile_gaps", "eac_singlefile",
+  "full_disc", "hidden_track",
+};
+// The testdata, plus one synthetic cuesheet.
+constexpr int kNumCorpora = std::size(kTestdata) + 1;
+
+struct Corpus {
+  std::string name;
+  std::string cuesheet;
+  Cuesheet proto;
+  std::string binary_proto;
+  std::string text_proto;
+};
+
+std::vector<Corpus> MakeCorpora() {
+  std::vector<std::pair<std::string, std::string>> cuesheets;
+  for (const char *name : kTestdata) {
+    auto mapped = util::MappedFile::Open(
+        absl::StrCat("cue2pb/testdata/", name, ".cue"));
+    CHECK_OK(mapped.status());
+    cuesheets.emplace_back(name, std::string(mapped->contents()));
+  }
+  cuesheets.emplace_back("synthetic_max",
+                         SyntheticCuesheet(/*num_tracks=*/99,
+                                           /*indices_per_track=*/4,
+                                           /*comment_tags=*/8,
+                                           /*title_length=*/200));
+
+  std::vector<Corpus> corpora;
+  for (auto &[name, cuesheet] : cuesheets) {
+    Corpus corpus;
+    corpus.name = std::move(name);
+    corpus.cuesheet = std::move(cuesheet);
+    auto proto = ParseCuesheet(std::string_view(corpus.cuesheet));
+    CHECK_OK(proto.status());
+    corpus.proto = *std::move(proto);
+    CHECK(corpus.proto.SerializeToString(&corpus.binary_proto));
+    CHECK(TextFormat::PrintToString(corpus.proto, &corpus.text_proto));
+    corpora.push_back(std::move(corpus));
+  }
+  return corpora;
+}
+
+const std::vector<Corpus> &GetCorpora() {
+  static const std::vector<Corpus> *corpora =
+      new std::vector<Corpus>(MakeCorpora());
+  return *corpora;
+}
+
+const Corpus &GetCorpus(benchmark::State &state) {
+  const Corpus &corpus = GetCorpora().at(state.range(0));
+  state.SetLabel(corpus.name);
+  return corpus;
+}
+
+// Registers a benchmark once per corpus.
+void ForEachCorpus(benchmark::internal::Benchmark *b) {
+  b->DenseRange(0, kNumCorpora - 1);
+}
+
+// Items are lines of cuesheet, so that items/sec is comparable between the
+// parser, the unparser, and across corpora.
+int64_t CountLines(std::string_view s) {
+  int64_t lines = 0;
+  for (char c : s) lines += c == '\n';
+  return lines;
+}
+
+void SetProcessed(benchmark::State &state, const Corpus &corpus,
+                  size_t bytes) {
+  state.SetItemsProcessed(state.iterations() * CountLines(corpus.cuesheet));
+  state.SetBytesProcessed(state.iterations() * bytes);
+}
+
+void BM_ParseCuesheet(benchmark::State &state) {
+  const Corpus &corpus = GetCorpus(state);
+  for (auto _ : state) {
+    auto cuesheet = ParseCuesheet(std::string_view(corpus.cuesheet));
+    benchmark::DoNotOptimize(cuesheet);
+  }
+  SetProcessed(state, corpus, corpus.cuesheet.size());
+}
+BENCHMARK(BM_ParseCuesheet)->Apply(ForEachCorpus);
+
+void BM_ParseCuesheetArena(benchmark::State &state) {
+  const Corpus &corpus = GetCorpus(state);
+  Arena arena;
+  for (auto _ : state) {
+    auto cuesheet = ParseCuesheet(corpus.cuesheet, &arena);
+    benchmark::DoNotOptimize(cuesheet);
+    arena.Reset();
+  }
+  SetProcessed(state, corpus, corpus.cuesheet.size());
+}
+BENCHMARK(BM_ParseCuesheetArena)->Apply(ForEachCorpus);
+
+void BM_ParseCuesheetDiscFields(benchmark::State &state) {
+  const Corpus &corpus = GetCorpus(state);
+  ParseOptions options;
+  options.fields = ParseOptions::kDisc;
+  Arena arena;
+  for (auto _ : state) {
+    auto cuesheet = ParseCuesheet(corpus.cuesheet, &arena, options);
+    benchmark::DoNotOptimize(cuesheet);
+    arena.Reset();
+  }
+  SetProcessed(state, corpus, corpus.cuesheet.size());
+}
+BENCHMARK(BM_ParseCuesheetDiscFields)->Apply(ForEachCorpus);
+
+// Tokenizes without building anything, e.g. to count tracks.
+void BM_VisitCuesheet(benchmark::State &state) {
+  class TrackCounter : public CuesheetVisitor {
+   public:
+    absl::Status OnTrack(int32_t number, Cuesheet::Track::Type type) override {
+      tracks++;
+      return absl::OkStatus();
+    }
+
+    int tracks = 0;
+  };
+
+  const Corpus &corpus = GetCorpus(state);
+  for (auto _ : state) {
+    TrackCounter counter;
+    auto status = VisitCuesheet(corpus.cuesheet, &counter);
+    benchmark::DoNotOptimize(status);
+    benchmark::DoNotOptimize(counter.tracks);
+  }
+  SetProcessed(state, corpus, corpus.cuesheet.size());
+}
+BENCHMARK(BM_VisitCuesheet)->Apply(ForEachCorpus);
+
+// Parses into one reused CompactCuesheet, so that after the first iteration
+// nothing is allocated.
+void BM_ParseCompactCuesheet(benchmark::State &state) {
+  const Corpus &corpus = GetCorpus(state);
+  auto compact = std::make_unique<CompactCuesheet>();
+  for (auto _ : state) {
+    auto status = ParseCompactCuesheet(corpus.cuesheet, compact.get());
+    benchmark::DoNotOptimize(status);
+    benchmark::DoNotOptimize(compact->num_tracks);
+  }
+  SetProcessed(state, corpus, corpus.cuesheet.size());
+}
+BENCHMARK(BM_ParseCompactCuesheet)->Apply(ForEachCorpus);
+
+void BM_UnparseCuesheet(benchmark::State &state) {
+  const Corpus &corpus = GetCorpus(state);
+  for (auto _ : state) {
+    std::ostringstream out;
+    CHECK_OK(UnparseCuesheet(corpus.proto, &out));
+    benchmark::DoNotOptimize(out);
+  }
+  SetProcessed(state, corpus, corpus.cuesheet.size());
+}
+BENCHMARK(BM_UnparseCuesheet)->Apply(ForEachCorpus);
+
+void BM_UnparseCuesheetToString(benchmark::State &state) {
+  const Corpus &corpus = GetCorpus(state);
+  std::string out;
+  for (auto _ : state) {
+    out.clear();
+    CHECK_OK(UnparseCuesheet(corpus.proto, &out));
+    benchmark::DoNotOptimize(out);
+  }
+  SetProcessed(state, corpus, corpus.cuesheet.size());
+}
+BENCHMARK(BM_UnparseCuesheetToString)->Apply(ForEachCorpus);
+
+void BM_CuesheetFromTextProto(benchmark::State &state) {
+  const Corpus &corpus = GetCorpus(state);
+  for (auto _ : state) {
+    auto cuesheet = CuesheetFromTextProto(corpus.text_proto);
+    benchmark::DoNotOptimize(cuesheet);
+  }
+  SetProcessed(state, corpus, corpus.text_proto.size());
+}
+BENCHMARK(BM_CuesheetFromTextProto)->Apply(ForEachCorpus);
+
+// The reflection-based parser that CuesheetFromTextProto falls back to.
+void BM_CuesheetFromTextProto_Generic(benchmark::State &state) {
+  const Corpus &corpus = GetCorpus(state);
+  for (auto _ : state) {
+    Cuesheet cuesheet;
+    CHECK(TextFormat::ParseFromString(corpus.text_proto, &cuesheet));
+    benchmark::DoNotOptimize(cuesheet);
+  }
+  SetProcessed(state, corpus, corpus.text_proto.size());
+}
+BENCHMARK(BM_CuesheetFromTextProto_Generic)->Apply(ForEachCorpus);
+
+void BM_PrintTextProto(benchmark::State &state) {
+  const Corpus &corpus = GetCorpus(state);
+  for (auto _ : state) {
+    std::string out;
+    AppendCuesheetTextProto(corpus.proto, &out);
+    benchmark::DoNotOptimize(out);
+  }
+  SetProcessed(state, corpus, corpus.text_proto.size());
+}
+BENCHMARK(BM_PrintTextProto)->Apply(ForEachCorpus);
+
+void BM_PrintTextProto_Generic(benchmark::State &state) {
+  const Corpus &corpus = GetCorpus(state);
+  for (auto _ : state) {
+    std::string out;
+    CHECK(TextFormat::PrintToString(corpus.proto, &out));
+    benchmark::DoNotOptimize(out);
+  }
+  SetProcessed(state, corpus, corpus.text_proto.size());
+}
+BENCHMARK(BM_PrintTextProto_Generic)->Apply(ForEachCorpus);
+
+void BM_SerializeBinaryProto(benchmark::State &state) {
+  const Corpus &corpus = GetCorpus(state);
+  for (auto _ : state) {
+    std::string out;
+    CHECK(corpus.proto.SerializeToString(&out));
+    benchmark::DoNotOptimize(out);
+  }
+  SetProcessed(state, corpus, corpus.binary_proto.size());
+}
+BENCHMARK(BM_SerializeBinaryProto)->Apply(ForEachCorpus);
+
+void BM_ParseBinaryProto(benchmark::State &state) {
+  const Corpus &corpus = GetCorpus(state);
+  for (auto _ : state) {
+    Cuesheet cuesheet;
+    CHECK(cuesheet.ParseFromString(corpus.binary_proto));
+    benchmark::DoNotOptimize(cuesheet);
+  }
+  SetProcessed(state, corpus, corpus.binary_proto.size());
+}
+BENCHMARK(BM_ParseBinaryProto)->Apply(ForEachCorpus);
+
+// A seek: which track and index are playing at a position in the first file.
+void BM_TimelineSeek(benchmark::State &state) {
+  const Corpus &corpus = GetCorpus(state);
+  auto timeline = CuesheetTimeline::Create(corpus.proto);
+  CHECK_OK(timeline.status());
+  int64_t last = timeline->index_frames().back();
+  int64_t frames = 0;
+  for (auto _ : state) {
+    // Steps through the file in a stride coprime to most index spacings.
+    frames = (frames + 7919) % (last + 1);
+    benchmark::DoNotOptimize(timeline->TrackAt(frames));
+    benchmark::DoNotOptimize(timeline->IndexAt(frames));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TimelineSeek)->Apply(ForEachCorpus);
+
+// Building the timeline, which a player does once per cuesheet.
+void BM_TimelineCreate(benchmark::State &state) {
+  const Corpus &corpus = GetCorpus(state);
+  for (auto _ : state) {
+    auto timeline = CuesheetTimeline::Create(corpus.proto);
+    benchmark::DoNotOptimize(timeline);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TimelineCreate)->Apply(ForEachCorpus);
+
+// The total pregap of many copies of every corpus, first by parsing each
+// binary proto, and then by scanning one column of a corpus store.
+constexpr int kCorpusCopies = 2000;
+
+void BM_SumPregapsFromProtos(benchmark::State &state) {
+  std::vector<std::string> protos;
+  for (int copy = 0; copy < kCorpusCopies; copy++) {
+    for (const Corpus &corpus : GetCorpora()) {
+      protos.push_back(corpus.binary_proto);
+    }
+  }
+  for (auto _ : state) {
+    int64_t pregaps = 0;
+    for (const std::string &binary_proto : protos) {
+      Cuesheet cuesheet;
+      CHECK(cuesheet.ParseFromString(binary_proto));
+      for (const Cuesheet::File &file : cuesheet.file()) {
+        for (const Cuesheet::Track &track : file.track()) {
+          pregaps += PregapFrames(track);
+        }
+      }
+    }
+    benchmark::DoNotOptimize(pregaps);
+  }
+  state.SetItemsProcessed(state.iterations() * protos.size());
+}
+BENCHMARK(BM_SumPregapsFromProtos);
+
+void BM_SumPregapsFromCorpusStore(benchmark::State &state) {
+  char dir_template[] = "/tmp/cue2pb_benchmark.XXXXXX";
+  std::string dir = mkdtemp(dir_template);
+  auto writer = CorpusWriter::Create(dir);
+  CHECK_OK(writer.status());
+  for (int copy = 0; copy < kCorpusCopies; copy++) {
+    for (const Corpus &corpus : GetCorpora()) {
+      CHECK_OK(writer->Add(corpus.proto));
+    }
+  }
+  CHECK_OK(writer->Finish());
+  auto reader = CorpusReader::Open(dir);
+  CHECK_OK(reader.status());
+  std::filesystem::remove_all(dir);
+
+  auto pregaps = reader->column<int32_t>(CorpusColumn::kTrackPregap);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(Sum(pregaps));
+  }
+  state.SetItemsProcessed(state.iterations() *
+                          reader->rows(CorpusTable::kDiscs));
+  state.SetBytesProcessed(state.iterations() * pregaps.size() *
+                          sizeof(int32_t));
+}
+BENCHMARK(BM_SumPregapsFromCorpusStore);
+
+// A tag index of 1.2 million discs: copies of every corpus, each with its own
+// DISCID.
+const TagIndexReader &GetTagIndex() {
+  static const TagIndexReader *index = [] {
+    char path_template[] = "/tmp/cue2pb_benchmark.XXXXXX";
+    int fd = mkstemp(path_template);
+    CHECK(fd != -1);
+    close(fd);
+
+    TagIndexBuilder builder;
+    uint64_t record = 0;
+    for (Corpus corpus : GetCorpora()) {
+      Cuesheet::CommentTag *discid =
+          corpus.proto.mutable_tags()->add_comment_tag();
+      discid->set_name("DISCID");
+      for (int copy = 0; copy < 200000; copy++) {
+        discid->set_value(absl::StrCat(record));
+        CHECK_OK(builder.Add(record++, corpus.proto));
+      }
+    }
+    CHECK_OK(builder.Write(path_template));
+    auto index = TagIndexReader::Open(path_template);
+    CHECK_OK(index.status());
+    unlink(path_template);
+    return new TagIndexReader(*std::move(index));
+  }();
+  return *index;
+}
+
+constexpr const char *kTagQueries[] = {
+  // Matches one disc.
+  "DISCID:1000000 AND GENRE:Ska OR DISCID:5",
+  // Matches half of them.
+  "GENRE:Ska AND DATE:1991 OR CATALOG:ABC01234",
+};
+
+void BM_SearchTagIndex(benchmark::State &state) {
+  const TagIndexReader &index = GetTagIndex();
+  auto query = ParseTagQuery(kTagQueries[state.range(0)]);
+  CHECK_OK(query.status());
+  size_t matches = 0;
+  for (auto _ : state) {
+    auto records = index.Search(*query);
+    CHECK_OK(records.status());
+    matches = records->size();
+  }
+  state.SetLabel(absl::StrCat(matches, " matches"));
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SearchTagIndex)
+    ->DenseRange(0, std::size(kTagQueries) - 1)
+    ->Unit(benchmark::kMicrosecond);
+
+// A spread of positions, so that branch prediction can't memorize one.
+std::vector<std::string> MakeMSFStrings() {
+  std::vector<std::string> strs;
+  for (int i = 0; i < 1024; i++) {
+    strs.push_back(absl::StrFormat("%02d:%02d:%02d", (i * 7) % 80,
+                                   (i * 13) % 60, (i * 31) % 75));
+  }
+  return strs;
+}
+
+// How positions were decoded before DecodeMSF: split into a vector, then
+// SimpleAtoi each field.
+bool SplitAndAtoiMSF(std::string_view str, int32_t *minute, int32_t *second,
+                     int32_t *frame) {
+  std::vector<std::string_view> splits = absl::StrSplit(str, ':');
+  if (splits.size() != 3) return false;
+  return absl::SimpleAtoi(splits[0], minute) &&
+      absl::SimpleAtoi(splits[1], second) &&
+      absl::SimpleAtoi(splits[2], frame);
+}
+
+template <bool (*Decode)(std::string_view, int32_t*, int32_t*, int32_t*)>
+void BM_DecodeMSF(benchmark::State &state) {
+  std::vector<std::string> strs = MakeMSFStrings();
+  size_t i = 0;
+  int64_t bytes = 0;
+  for (auto _ : state) {
+    const std::string &str = strs[i++ % strs.size()];
+    int32_t minute = 0, second = 0, frame = 0;
+    bool ok = Decode(str, &minute, &second, &frame);
+    benchmark::DoNotOptimize(ok);
+    benchmark::DoNotOptimize(minute);
+    benchmark::DoNotOptimize(second);
+    benchmark::DoNotOptimize(frame);
+    bytes += str.size();
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(bytes);
+}
+BENCHMARK_TEMPLATE(BM_DecodeMSF, DecodeMSF)->Name("BM_DecodeMSF");
+BENCHMARK_TEMPLATE(BM_DecodeMSF, SplitAndAtoiMSF)
+    ->Name("BM_DecodeMSF_SplitAndAtoi");
+
+}  // namespace
+}  // namespace cue2pb
@@ -0,0 +1,85 @@
+#include "cue2pb/frames.h"
+
+#include <limits>
+
+namespace cue2pb {
+namespace {
+
+bool FitsInt32(int64_t frames) {
+  return frames >= std::numeric_limits<int32_t>::min() &&
+      frames <= std::numeric_limits<int32_t>::max();
+}
+
+void SetMSF(int64_t frames, Cuesheet::MSF *msf) {
+  int32_t minute, second, frame;
+  FramesToMSF(frames, &minute, &second, &frame);
+  msf->set_minute(minute);
+  msf->set_second(second);
+  msf->set_frame(frame);
+}
+
+}  // namespace
+
+void IndexFrames(const Cuesheet::Track &track, int64_t *frames) {
+  for (const Cuesheet::Index &index : track.index()) {
+    *frames++ = PositionFrames(index);
+  }
+}
+
+void FramesToSamples(const int64_t *frames, size_t n, int64_t *samples) {
+  for (size_t i = 0; i < n; i++) samples[i] = FramesToSamples(frames[i]);
+}
+
+void FramesToSeconds(const int64_t *frames, size_t n, double *seconds) {
+  for (size_t i = 0; i < n; i++) seconds[i] = FramesToSeconds(frames[i]);
+}
+
+void FramesToBytes(const int64_t *frames, size_t n,
+                   Cuesheet::Track::Type type, int64_t *bytes) {
+  const int64_t sector_size = SectorSize(type);
+  for (size_t i = 0; i < n; i++) bytes[i] = frames[i] * sector_size;
+}
+
+void CompactPositions(Cuesheet *cuesheet) {
+  for (Cuesheet::File &file : *cuesheet->mutable_file()) {
+    for (Cuesheet::Track &track : *file.mutable_track()) {
+      if (track.has_pregap() && FitsInt32(PregapFrames(track))) {
+        track.set_pregap_frames(static_cast<int32_t>(PregapFrames(track)));
+        track.clear_pregap();
+      }
+      if (track.has_postgap() && FitsInt32(PostgapFrames(track))) {
+        track.set_postgap_frames(static_cast<int32_t>(PostgapFrames(track)));
+        track.clear_postgap();
+      }
+      for (Cuesheet::Index &index : *track.mutable_index()) {
+        if (index.has_position() && FitsInt32(PositionFrames(index))) {
+          index.set_frames(static_cast<int32_t>(PositionFrames(index)));
+          index.clear_position();
+        }
+      }
+    }
+  }
+}
+
+void ExpandPositions(Cuesheet *cuesheet) {
+  for (Cuesheet::File &file : *cuesheet->mutable_file()) {
+    for (Cuesheet::Track &track : *file.mutable_track()) {
+      if (!track.has_pregap() && track.pregap_frames() != 0) {
+        SetMSF(track.pregap_frames(), track.mutable_pregap());
+      }
+      track.clear_pregap_frames();
+      if (!track.has_postgap() && track.postgap_frames() != 0) {
+        SetMSF(track.postgap_frames(), track.mutable_postgap());
+      }
+      track.clear_postgap_frames();
+      for (Cuesheet::Index &index : *track.mutable_index()) {
+        if (!index.has_position()) {
+          SetMSF(index.frames(), index.mutable_position());
+        }
+        index.clear_frames();
+      }
+    }
+  }
+}
+
+}  // namespace cue2pb
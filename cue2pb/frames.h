@@ -0,0 +1,102 @@
+#ifndef CUE2PB_FRAMES_H_
+#define CUE2PB_FRAMES_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cue2pb/cuesheet.pb.h"
+#include "cue2pb/msf.h"
+
+// Conversions between the ways a position on a CD is written down: as minutes,
+// seconds and frames (an MSF), as a count of frames since 00:00:00 (a logical
+// block address), as audio samples, as seconds, or as a byte offset into a
+// track's data.
+
+namespace cue2pb {
+
+// CD audio is 44.1kHz, so each frame holds 588 samples (per channel).
+inline constexpr int32_t kSamplesPerSecond = 44100;
+inline constexpr int32_t kSamplesPerFrame =
+    kSamplesPerSecond / kFramesPerSecond;
+static_assert(kSamplesPerFrame * kFramesPerSecond == kSamplesPerSecond);
+
+constexpr int64_t FramesToSamples(int64_t frames) {
+  return frames * kSamplesPerFrame;
+}
+
+// Rounds down, to the frame the sample is in.
+constexpr int64_t SamplesToFrames(int64_t samples) {
+  return samples / kSamplesPerFrame;
+}
+
+constexpr double FramesToSeconds(int64_t frames) {
+  return static_cast<double>(frames) / kFramesPerSecond;
+}
+
+// Rounds to the nearest frame, so that FramesToSeconds() round trips.
+constexpr int64_t SecondsToFrames(double seconds) {
+  double frames = seconds * kFramesPerSecond;
+  return static_cast<int64_t>(frames < 0 ? frames - 0.5 : frames + 0.5);
+}
+
+// The size in bytes of one frame (sector) of a track of the given type, or 0
+// for TYPE_UNKNOWN. Audio is 2352 bytes a frame whether it is raw or in a WAVE
+// file: 588 samples of 16-bit stereo.
+constexpr int32_t SectorSize(Cuesheet::Track::Type type) {
+  switch (type) {
+    case Cuesheet::Track::TYPE_AUDIO:
+    case Cuesheet::Track::TYPE_MODE1_2352:
+    case Cuesheet::Track::TYPE_MODE2_2352:
+    case Cuesheet::Track::TYPE_CDI_2352:
+      return 2352;
+    case Cuesheet::Track::TYPE_CDG:
+      return 2448;
+    case Cuesheet::Track::TYPE_MODE1_2048:
+      return 2048;
+    case Cuesheet::Track::TYPE_MODE2_2336:
+    case Cuesheet::Track::TYPE_CDI_2336:
+      return 2336;
+    default:
+      return 0;
+  }
+}
+
+constexpr int64_t FramesToBytes(int64_t frames, Cuesheet::Track::Type type) {
+  return frames * SectorSize(type);
+}
+
+// Positions of a Cuesheet, in frames, read from whichever form they were
+// stored in (see cuesheet.proto).
+inline int64_t MSFFrames(const Cuesheet::MSF &msf) {
+  return MSFToFrames(msf.minute(), msf.second(), msf.frame());
+}
+inline int64_t PositionFrames(const Cuesheet::Index &index) {
+  return index.has_position() ? MSFFrames(index.position()) : index.frames();
+}
+inline int64_t PregapFrames(const Cuesheet::Track &track) {
+  return track.has_pregap() ? MSFFrames(track.pregap())
+                            : track.pregap_frames();
+}
+inline int64_t PostgapFrames(const Cuesheet::Track &track) {
+  return track.has_postgap() ? MSFFrames(track.postgap())
+                             : track.postgap_frames();
+}
+
+// Conversions of whole arrays of positions, e.g. every index of a disc. The
+// arithmetic ones are plain loops, which the compiler vectorizes.
+//
+// IndexFrames() writes track.index_size() positions.
+void IndexFrames(const Cuesheet::Track &track, int64_t *frames);
+void FramesToSamples(const int64_t *frames, size_t n, int64_t *samples);
+void FramesToSeconds(const int64_t *frames, size_t n, double *seconds);
+void FramesToBytes(const int64_t *frames, size_t n,
+                   Cuesheet::Track::Type type, int64_t *bytes);
+
+// Rewrites every position of cuesheet into the compact frames form, or back
+// into MSFs. Positions too far in to fit an int32 of frames stay MSFs.
+void CompactPositions(Cuesheet *cuesheet);
+void ExpandPositions(Cuesheet *cuesheet);
+
+}  // namespace cue2pb
+
+#endif  // CUE2PB_FRAMES_H_
@@ -0,0 +1,112 @@
+#include "cue2pb/frames.h"
+
+#include <fstream>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "absl/status/statusor.h"
+#include "cue2pb/parser.h"
+#include "util/file.h"
+#include "util/testing/assertions.h"
+#include "util/testing/protobuf_assertions.h"
+
+namespace cue2pb {
+namespace {
+
+using ::util::IsEqual;
+using ::util::IsOk;
+
+static_assert(kSamplesPerFrame == 588);
+static_assert(FramesToSamples(MSFToFrames(0, 1, 0)) == 44100);
+static_assert(SamplesToFrames(587) == 0);
+static_assert(SamplesToFrames(588) == 1);
+static_assert(FramesToSeconds(150) == 2.0);
+static_assert(SecondsToFrames(2.0) == 150);
+static_assert(SectorSize(Cuesheet::Track::TYPE_AUDIO) == 2352);
+static_assert(SectorSize(Cuesheet::Track::TYPE_CDG) == 2448);
+static_assert(SectorSize(Cuesheet::Track::TYPE_MODE1_2048) == 2048);
+static_assert(SectorSize(Cuesheet::Track::TYPE_CDI_2336) == 2336);
+static_assert(SectorSize(Cuesheet::Track::TYPE_UNKNOWN) == 0);
+static_assert(FramesToBytes(75, Cuesheet::Track::TYPE_AUDIO) == 176400);
+
+TEST(FramesTest, SecondsRoundTrip) {
+  for (int64_t frames = 0; frames < 10 * kFramesPerSecond; frames++) {
+    EXPECT_EQ(frames, SecondsToFrames(FramesToSeconds(frames)));
+  }
+  EXPECT_EQ(-1, SecondsToFrames(FramesToSeconds(-1)));
+}
+
+TEST(FramesTest, ReadsEitherForm) {
+  Cuesheet::Track track;
+  track.set_pregap_frames(150);
+  track.mutable_postgap()->set_second(1);
+  track.add_index()->set_frames(32);
+  Cuesheet::MSF *position = track.add_index()->mutable_position();
+  position->set_minute(1);
+  position->set_frame(2);
+  track.add_index();
+
+  EXPECT_EQ(150, PregapFrames(track));
+  EXPECT_EQ(75, PostgapFrames(track));
+
+  std::vector<int64_t> frames(track.index_size());
+  IndexFrames(track, frames.data());
+  EXPECT_EQ((std::vector<int64_t>{32, 4502, 0}), frames);
+}
+
+TEST(FramesTest, Batched) {
+  const int64_t frames[] = {0, 1, 75, 4500, 335549};
+  constexpr size_t n = sizeof(frames) / sizeof(frames[0]);
+  int64_t samples[n], bytes[n];
+  double seconds[n];
+  FramesToSamples(frames, n, samples);
+  FramesToSeconds(frames, n, seconds);
+  FramesToBytes(frames, n, Cuesheet::Track::TYPE_MODE1_2048, bytes);
+  for (size_t i = 0; i < n; i++) {
+    EXPECT_EQ(FramesToSamples(frames[i]), samples[i]);
+    EXPECT_EQ(FramesToSeconds(frames[i]), seconds[i]);
+    EXPECT_EQ(frames[i] * 2048, bytes[i]);
+  }
+}
+
+absl::StatusOr<Cuesheet> ParseFullDisc(const ParseOptions &options) {
+  std::ifstream input =
+      util::OpenInputFile("cue2pb/testdata/full_disc.cue").value();
+  return ParseCuesheet(&input, options);
+}
+
+TEST(FramesTest, CompactAndExpandPositions) {
+  absl::StatusOr<Cuesheet> expanded = ParseFullDisc(ParseOptions());
+  ASSERT_TRUE(IsOk(expanded));
+
+  ParseOptions options;
+  options.compact_positions = true;
+  absl::StatusOr<Cuesheet> compact = ParseFullDisc(options);
+  ASSERT_TRUE(IsOk(compact));
+  EXPECT_LT(compact->ByteSizeLong(), expanded->ByteSizeLong());
+
+  Cuesheet cuesheet = *expanded;
+  CompactPositions(&cuesheet);
+  EXPECT_TRUE(IsEqual(*compact, cuesheet));
+  ExpandPositions(&cuesheet);
+  EXPECT_TRUE(IsEqual(*expanded, cuesheet));
+}
+
+TEST(FramesTest, TooLargeToCompact) {
+  ParseOptions options;
+  options.compact_positions = true;
+  absl::StatusOr<Cuesheet> cuesheet = ParseCuesheet(
+      "FILE \"foo.wav\" WAVE\n"
+      "TRACK 01 AUDIO\n"
+      "PREGAP 00:02:00\n"
+      "INDEX 01 999999:00:00\n", options);
+  ASSERT_TRUE(IsOk(cuesheet));
+  const Cuesheet::Track &track = cuesheet->file(0).track(0);
+  EXPECT_FALSE(track.has_pregap());
+  EXPECT_EQ(150, track.pregap_frames());
+  EXPECT_EQ(999999, track.index(0).position().minute());
+  EXPECT_EQ(0, track.index(0).frames());
+}
+
+}  // namespace
+}  // namespace cue2pb
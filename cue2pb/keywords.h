@@ -0,0 +1,202 @@
+#ifndef CUE2PB_KEYWORDS_H_
+#define CUE2PB_KEYWORDS_H_
+
+#include <string_view>
+#include <stddef.h>
+
+#include "cue2pb/cuesheet.pb.h"
+
+// The keyword tables shared by the parser and the unparser. Every token the
+// cuesheet format knows about is spelled exactly once, here, so that parsing
+// and unparsing can't disagree.
+
+namespace cue2pb {
+
+enum class Command {
+  kUnknown,
+  kCatalog,
+  kCdTextFile,
+  kFile,
+  kFlags,
+  kIndex,
+  kIsrc,
+  kPerformer,
+  kPostgap,
+  kPregap,
+  kRem,
+  kSongwriter,
+  kTitle,
+  kTrack,
+};
+
+template <typename T>
+struct Keyword {
+  std::string_view name;
+  T value;
+};
+
+// Each table is ordered by enum value, starting from the first value after
+// the unknown/unset one, so that a value's keyword is found by indexing.
+inline constexpr Keyword<Command> kCommands[] = {
+  {"CATALOG", Command::kCatalog},
+  {"CDTEXTFILE", Command::kCdTextFile},
+  {"FILE", Command::kFile},
+  {"FLAGS", Command::kFlags},
+  {"INDEX", Command::kIndex},
+  {"ISRC", Command::kIsrc},
+  {"PERFORMER", Command::kPerformer},
+  {"POSTGAP", Command::kPostgap},
+  {"PREGAP", Command::kPregap},
+  {"REM", Command::kRem},
+  {"SONGWRITER", Command::kSongwriter},
+  {"TITLE", Command::kTitle},
+  {"TRACK", Command::kTrack},
+};
+
+inline constexpr Keyword<Cuesheet::File::Type> kFileTypes[] = {
+  {"WAVE", Cuesheet::File::TYPE_WAVE},
+  {"MP3", Cuesheet::File::TYPE_MP3},
+  {"AIFF", Cuesheet::File::TYPE_AIFF},
+  {"BINARY", Cuesheet::File::TYPE_BINARY},
+  {"MOTOROLA", Cuesheet::File::TYPE_MOTOROLA},
+};
+
+inline constexpr Keyword<Cuesheet::Track::Type> kTrackTypes[] = {
+  {"AUDIO", Cuesheet::Track::TYPE_AUDIO},
+  {"CDG", Cuesheet::Track::TYPE_CDG},
+  {"MODE1/2048", Cuesheet::Track::TYPE_MODE1_2048},
+  {"MODE1/2352", Cuesheet::Track::TYPE_MODE1_2352},
+  {"MODE2/2336", Cuesheet::Track::TYPE_MODE2_2336},
+  {"MODE2/2352", Cuesheet::Track::TYPE_MODE2_2352},
+  {"CDI/2336", Cuesheet::Track::TYPE_CDI_2336},
+  {"CDI/2352", Cuesheet::Track::TYPE_CDI_2352},
+};
+
+// Spellings that are accepted when parsing but never produced. Older versions
+// of this parser only understood CDI_2336 and CDI_2352.
+inline constexpr Keyword<Cuesheet::Track::Type> kTrackTypeAliases[] = {
+  {"CDI_2336", Cuesheet::Track::TYPE_CDI_2336},
+  {"CDI_2352", Cuesheet::Track::TYPE_CDI_2352},
+};
+
+inline constexpr Keyword<Cuesheet::Track::Flag> kTrackFlags[] = {
+  {"DCP", Cuesheet::Track::FLAG_DCP},
+  {"4CH", Cuesheet::Track::FLAG_4CH},
+  {"PRE", Cuesheet::Track::FLAG_PRE},
+};
+
+namespace keywords_internal {
+
+template <typename T, size_t N>
+constexpr std::string_view NameOf(const Keyword<T> (&table)[N], T value) {
+  size_t i = static_cast<size_t>(value) - 1;
+  // Values below the first entry wrap around to a huge index.
+  if (i >= N) return {};
+  return table[i].name;
+}
+
+template <typename T, size_t N>
+constexpr bool Find(const Keyword<T> (&table)[N], std::string_view name,
+                    T *value) {
+  for (const Keyword<T> &keyword : table) {
+    if (keyword.name.size() == name.size() && keyword.name == name) {
+      *value = keyword.value;
+      return true;
+    }
+  }
+  return false;
+}
+
+template <typename T, size_t N>
+constexpr bool IsOrdered(const Keyword<T> (&table)[N]) {
+  for (size_t i = 0; i < N; i++) {
+    if (static_cast<size_t>(table[i].value) != i + 1) return false;
+  }
+  return true;
+}
+
+static_assert(IsOrdered(kCommands));
+static_assert(IsOrdered(kFileTypes));
+static_assert(IsOrdered(kTrackTypes));
+static_assert(IsOrdered(kTrackFlags));
+
+}  // namespace keywords_internal
+
+// Returns the keyword for a value, or an empty string_view if the value has
+// no keyword (e.g. TYPE_UNKNOWN, or a value from a newer cuesheet.proto).
+constexpr std::string_view CommandName(Command command) {
+  return keywords_internal::NameOf(kCommands, command);
+}
+constexpr std::string_view FileTypeName(Cuesheet::File::Type type) {
+  return keywords_internal::NameOf(kFileTypes, type);
+}
+constexpr std::string_view TrackTypeName(Cuesheet::Track::Type type) {
+  return keywords_internal::NameOf(kTrackTypes, type);
+}
+constexpr std::string_view TrackFlagName(Cuesheet::Track::Flag flag) {
+  return keywords_internal::NameOf(kTrackFlags, flag);
+}
+
+// Commands are looked up on every line, so rather than scanning the table the
+// candidate is picked by length and first character, and then confirmed
+// against its keyword.
+constexpr Command ParseCommand(std::string_view token) {
+  if (token.empty()) return Command::kUnknown;
+
+  Command candidate = Command::kUnknown;
+  switch (token.size()) {
+    case 3:
+      candidate = Command::kRem;
+      break;
+    case 4:
+      if (token[0] == 'F') candidate = Command::kFile;
+      if (token[0] == 'I') candidate = Command::kIsrc;
+      break;
+    case 5:
+      if (token[0] == 'F') candidate = Command::kFlags;
+      if (token[0] == 'I') candidate = Command::kIndex;
+      if (token[0] == 'T') {
+        candidate = token[1] == 'I' ? Command::kTitle : Command::kTrack;
+      }
+      break;
+    case 6:
+      candidate = Command::kPregap;
+      break;
+    case 7:
+      if (token[0] == 'C') candidate = Command::kCatalog;
+      if (token[0] == 'P') candidate = Command::kPostgap;
+      break;
+    case 9:
+      candidate = Command::kPerformer;
+      break;
+    case 10:
+      if (token[0] == 'C') candidate = Command::kCdTextFile;
+      if (token[0] == 'S') candidate = Command::kSongwriter;
+      break;
+  }
+
+  if (candidate == Command::kUnknown || CommandName(candidate) != token) {
+    return Command::kUnknown;
+  }
+  return candidate;
+}
+
+// These return false if the token isn't a known keyword, leaving the output
+// untouched.
+constexpr bool ParseFileType(std::string_view token,
+                             Cuesheet::File::Type *type) {
+  return keywords_internal::Find(kFileTypes, token, type);
+}
+constexpr bool ParseTrackType(std::string_view token,
+                              Cuesheet::Track::Type *type) {
+  return keywords_internal::Find(kTrackTypes, token, type) ||
+      keywords_internal::Find(kTrackTypeAliases, token, type);
+}
+constexpr bool ParseTrackFlag(std::string_view token,
+                              Cuesheet::Track::Flag *flag) {
+  return keywords_internal::Find(kTrackFlags, token, flag);
+}
+
+}  // namespace cue2pb
+
+#endif  // CUE2PB_KEYWORDS_H_
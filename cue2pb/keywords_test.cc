@@ -0,0 +1,91 @@
+#include "cue2pb/keywords.h"
+
+#include <string_view>
+
+#include "gtest/gtest.h"
+
+namespace cue2pb {
+namespace {
+
+static_assert(ParseCommand("TRACK") == Command::kTrack);
+static_assert(ParseCommand("TITLE") == Command::kTitle);
+static_assert(ParseCommand("TRACKS") == Command::kUnknown);
+static_assert(TrackTypeName(Cuesheet::Track::TYPE_CDI_2336) == "CDI/2336");
+static_assert(FileTypeName(Cuesheet::File::TYPE_UNKNOWN).empty());
+
+TEST(KeywordsTest, CommandsRoundTrip) {
+  for (const Keyword<Command> &keyword : kCommands) {
+    EXPECT_EQ(keyword.value, ParseCommand(keyword.name)) << keyword.name;
+    EXPECT_EQ(keyword.name, CommandName(keyword.value));
+  }
+}
+
+TEST(KeywordsTest, UnknownCommands) {
+  for (std::string_view token : {"", "R", "rem", "FILES", "TRACKS", "TRACE",
+                                 "PREGAPS", "CATALOGS", "INDEXES"}) {
+    EXPECT_EQ(Command::kUnknown, ParseCommand(token)) << token;
+  }
+}
+
+TEST(KeywordsTest, FileTypesRoundTrip) {
+  using File = ::cue2pb::Cuesheet::File;
+  for (int i = File::Type_MIN; i <= File::Type_MAX; i++) {
+    if (!File::Type_IsValid(i) || i == File::TYPE_UNKNOWN) continue;
+    auto type = static_cast<File::Type>(i);
+    std::string_view name = FileTypeName(type);
+    ASSERT_FALSE(name.empty()) << File::Type_Name(type);
+
+    File::Type parsed = File::TYPE_UNKNOWN;
+    ASSERT_TRUE(ParseFileType(name, &parsed)) << name;
+    EXPECT_EQ(type, parsed);
+  }
+}
+
+TEST(KeywordsTest, TrackTypesRoundTrip) {
+  using Track = ::cue2pb::Cuesheet::Track;
+  for (int i = Track::Type_MIN; i <= Track::Type_MAX; i++) {
+    if (!Track::Type_IsValid(i) || i == Track::TYPE_UNKNOWN) continue;
+    auto type = static_cast<Track::Type>(i);
+    std::string_view name = TrackTypeName(type);
+    ASSERT_FALSE(name.empty()) << Track::Type_Name(type);
+
+    Track::Type parsed = Track::TYPE_UNKNOWN;
+    ASSERT_TRUE(ParseTrackType(name, &parsed)) << name;
+    EXPECT_EQ(type, parsed);
+  }
+}
+
+TEST(KeywordsTest, TrackTypeAliases) {
+  using Track = ::cue2pb::Cuesheet::Track;
+  Track::Type parsed = Track::TYPE_UNKNOWN;
+  ASSERT_TRUE(ParseTrackType("CDI_2352", &parsed));
+  EXPECT_EQ(Track::TYPE_CDI_2352, parsed);
+  EXPECT_EQ("CDI/2352", TrackTypeName(parsed));
+}
+
+TEST(KeywordsTest, TrackFlagsRoundTrip) {
+  using Track = ::cue2pb::Cuesheet::Track;
+  for (int i = Track::Flag_MIN; i <= Track::Flag_MAX; i++) {
+    if (!Track::Flag_IsValid(i) || i == Track::FLAG_UNKNOWN) continue;
+    auto flag = static_cast<Track::Flag>(i);
+    std::string_view name = TrackFlagName(flag);
+    ASSERT_FALSE(name.empty()) << Track::Flag_Name(flag);
+
+    Track::Flag parsed = Track::FLAG_UNKNOWN;
+    ASSERT_TRUE(ParseTrackFlag(name, &parsed)) << name;
+    EXPECT_EQ(flag, parsed);
+  }
+}
+
+TEST(KeywordsTest, UnknownValues) {
+  using Track = ::cue2pb::Cuesheet::Track;
+  EXPECT_TRUE(TrackTypeName(static_cast<Track::Type>(100)).empty());
+  EXPECT_TRUE(TrackTypeName(static_cast<Track::Type>(-1)).empty());
+
+  Track::Type parsed = Track::TYPE_AUDIO;
+  EXPECT_FALSE(ParseTrackType("audio", &parsed));
+  EXPECT_EQ(Track::TYPE_AUDIO, parsed);
+}
+
+}  // namespace
+}  // namespace cue2pb
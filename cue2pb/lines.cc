@@ -0,0 +1,258 @@
+#include "cue2pb/lines.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define CUE2PB_LINES_X86 1
+#endif
+
+namespace cue2pb {
+namespace {
+
+using ::cue2pb::lines_internal::Isa;
+
+constexpr size_t kBlockSize = 64;
+constexpr size_t kWindowBlocks = kSplitLinesWindow / kBlockSize;
+static_assert(kSplitLinesWindow % kBlockSize == 0);
+
+// The same characters as absl::ascii_isspace: ' ', and '\t' through '\r'.
+constexpr bool IsSpace(unsigned char c) {
+  return c == ' ' || static_cast<unsigned char>(c - '\t') <= '\r' - '\t';
+}
+
+// For each block of 64 bytes at p, sets bit i of newlines[block] and
+// spaces[block] if byte i of the block is a newline, or whitespace (which
+// includes newlines), respectively.
+using ClassifyFn = void (*)(const char *p, size_t blocks, uint64_t *newlines,
+                            uint64_t *spaces);
+
+void ClassifyScalar(const char *p, size_t blocks, uint64_t *newlines,
+                    uint64_t *spaces) {
+  for (size_t block = 0; block < blocks; block++, p += kBlockSize) {
+    uint64_t n = 0, s = 0;
+    for (size_t i = 0; i < kBlockSize; i++) {
+      auto c = static_cast<unsigned char>(p[i]);
+      n |= uint64_t{c == '\n'} << i;
+      s |= uint64_t{IsSpace(c)} << i;
+    }
+    newlines[block] = n;
+    spaces[block] = s;
+  }
+}
+
+#ifdef CUE2PB_LINES_X86
+
+void ClassifySse2(const char *p, size_t blocks, uint64_t *newlines,
+                  uint64_t *spaces) {
+  const __m128i newline = _mm_set1_epi8('\n');
+  const __m128i space = _mm_set1_epi8(' ');
+  const __m128i tab = _mm_set1_epi8('\t');
+  const __m128i control_range = _mm_set1_epi8('\r' - '\t');
+
+  for (size_t block = 0; block < blocks; block++, p += kBlockSize) {
+    uint64_t n = 0, s = 0;
+    for (size_t i = 0; i < kBlockSize; i += 16) {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+      // '\t' through '\r' are the bytes b for which b - '\t' is at most
+      // '\r' - '\t' as an unsigned byte, i.e. for which min(b - '\t', 4) is
+      // b - '\t'.
+      __m128i t = _mm_sub_epi8(v, tab);
+      __m128i is_control = _mm_cmpeq_epi8(_mm_min_epu8(t, control_range), t);
+      __m128i is_space = _mm_or_si128(is_control, _mm_cmpeq_epi8(v, space));
+      __m128i is_newline = _mm_cmpeq_epi8(v, newline);
+      n |= uint64_t{static_cast<uint16_t>(_mm_movemask_epi8(is_newline))}
+          << i;
+      s |= uint64_t{static_cast<uint16_t>(_mm_movemask_epi8(is_space))} << i;
+    }
+    newlines[block] = n;
+    spaces[block] = s;
+  }
+}
+
+__attribute__((target("avx2")))
+void ClassifyAvx2(const char *p, size_t blocks, uint64_t *newlines,
+                  uint64_t *spaces) {
+  const __m256i newline = _mm256_set1_epi8('\n');
+  const __m256i space = _mm256_set1_epi8(' ');
+  const __m256i tab = _mm256_set1_epi8('\t');
+  const __m256i control_range = _mm256_set1_epi8('\r' - '\t');
+
+  for (size_t block = 0; block < blocks; block++, p += kBlockSize) {
+    uint64_t n = 0, s = 0;
+    for (size_t i = 0; i < kBlockSize; i += 32) {
+      __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+      // As in ClassifySse2().
+      __m256i t = _mm256_sub_epi8(v, tab);
+      __m256i is_control =
+          _mm256_cmpeq_epi8(_mm256_min_epu8(t, control_range), t);
+      __m256i is_space =
+          _mm256_or_si256(is_control, _mm256_cmpeq_epi8(v, space));
+      __m256i is_newline = _mm256_cmpeq_epi8(v, newline);
+      n |= uint64_t{static_cast<uint32_t>(_mm256_movemask_epi8(is_newline))}
+          << i;
+      s |= uint64_t{static_cast<uint32_t>(_mm256_movemask_epi8(is_space))}
+          << i;
+    }
+    newlines[block] = n;
+    spaces[block] = s;
+  }
+}
+
+#endif  // CUE2PB_LINES_X86
+
+ClassifyFn ClassifierFor(Isa isa) {
+  switch (isa) {
+#ifdef CUE2PB_LINES_X86
+    case Isa::kSse2:
+      return &ClassifySse2;
+    case Isa::kAvx2:
+      return &ClassifyAvx2;
+#endif
+    default:
+      return &ClassifyScalar;
+  }
+}
+
+Isa BestIsa() {
+#ifdef CUE2PB_LINES_X86
+  if (__builtin_cpu_supports("avx2")) return Isa::kAvx2;
+  return Isa::kSse2;
+#else
+  return Isa::kScalar;
+#endif
+}
+
+// Bit scans over a bitmap of one bit per byte of the window. Each returns to
+// if there's no such bit in [from, to).
+size_t NextSet(const uint64_t *bits, size_t from, size_t to) {
+  while (from < to) {
+    uint64_t word = bits[from / kBlockSize] >> (from % kBlockSize);
+    if (word != 0) return std::min(to, from + __builtin_ctzll(word));
+    from = (from / kBlockSize + 1) * kBlockSize;
+  }
+  return to;
+}
+
+size_t NextClear(const uint64_t *bits, size_t from, size_t to) {
+  while (from < to) {
+    uint64_t word = ~bits[from / kBlockSize] >> (from % kBlockSize);
+    if (word != 0) return std::min(to, from + __builtin_ctzll(word));
+    from = (from / kBlockSize + 1) * kBlockSize;
+  }
+  return to;
+}
+
+// Returns the end of the last clear bit in [from, to), i.e. one past it.
+size_t PrevClearEnd(const uint64_t *bits, size_t from, size_t to) {
+  while (to > from) {
+    size_t last = to - 1;
+    uint64_t word =
+        ~bits[last / kBlockSize] << (kBlockSize - 1 - last % kBlockSize);
+    if (word != 0) return std::max(from, last - __builtin_clzll(word) + 1);
+    to = last - last % kBlockSize;
+  }
+  return from;
+}
+
+Line SplitBitmapLine(const uint64_t *spaces, size_t begin, size_t end) {
+  Line line;
+  size_t command_begin = NextClear(spaces, begin, end);
+  size_t rest_end = PrevClearEnd(spaces, command_begin, end);
+  size_t command_end = NextSet(spaces, command_begin, rest_end);
+  line.command_begin = static_cast<uint32_t>(command_begin);
+  line.command_end = static_cast<uint32_t>(command_end);
+  line.rest_begin =
+      static_cast<uint32_t>(NextClear(spaces, command_end, rest_end));
+  line.rest_end = static_cast<uint32_t>(rest_end);
+  return line;
+}
+
+size_t SplitLinesWith(ClassifyFn classify, std::string_view input,
+                      Line *lines, size_t max_lines, size_t *consumed) {
+  size_t size = std::min(input.size(), kSplitLinesWindow);
+  size_t blocks = (size + kBlockSize - 1) / kBlockSize;
+
+  uint64_t newlines[kWindowBlocks];
+  uint64_t spaces[kWindowBlocks];
+  size_t full_blocks = size / kBlockSize;
+  classify(input.data(), full_blocks, newlines, spaces);
+  if (full_blocks < blocks) {
+    // NULs are neither newlines nor whitespace.
+    char tail[kBlockSize] = {};
+    std::memcpy(tail, input.data() + full_blocks * kBlockSize,
+                size - full_blocks * kBlockSize);
+    classify(tail, 1, &newlines[full_blocks], &spaces[full_blocks]);
+  }
+
+  size_t n = 0;
+  size_t begin = 0;
+  for (size_t i = 0; i < blocks && n < max_lines; i++) {
+    for (uint64_t word = newlines[i]; word != 0 && n < max_lines;
+         word &= word - 1) {
+      size_t eol = i * kBlockSize + __builtin_ctzll(word);
+      lines[n++] = SplitBitmapLine(spaces, begin, eol);
+      begin = eol + 1;
+    }
+  }
+  *consumed = begin;
+  return n;
+}
+
+}  // namespace
+
+Line SplitLine(std::string_view line) {
+  auto is_space = [&line](size_t i) {
+    return IsSpace(static_cast<unsigned char>(line[i]));
+  };
+
+  size_t command_begin = 0;
+  while (command_begin < line.size() && is_space(command_begin)) {
+    command_begin++;
+  }
+  size_t rest_end = line.size();
+  while (rest_end > command_begin && is_space(rest_end - 1)) rest_end--;
+  size_t command_end = command_begin;
+  while (command_end < rest_end && !is_space(command_end)) command_end++;
+  size_t rest_begin = command_end;
+  while (rest_begin < rest_end && is_space(rest_begin)) rest_begin++;
+
+  Line ret;
+  ret.command_begin = static_cast<uint32_t>(command_begin);
+  ret.command_end = static_cast<uint32_t>(command_end);
+  ret.rest_begin = static_cast<uint32_t>(rest_begin);
+  ret.rest_end = static_cast<uint32_t>(rest_end);
+  return ret;
+}
+
+size_t SplitLines(std::string_view input, Line *lines, size_t max_lines,
+                  size_t *consumed) {
+  static const ClassifyFn classify = ClassifierFor(BestIsa());
+  return SplitLinesWith(classify, input, lines, max_lines, consumed);
+}
+
+namespace lines_internal {
+
+bool IsSupported(Isa isa) {
+  switch (isa) {
+    case Isa::kScalar:
+      return true;
+#ifdef CUE2PB_LINES_X86
+    case Isa::kSse2:
+      return true;
+    case Isa::kAvx2:
+      return __builtin_cpu_supports("avx2");
+#endif
+    default:
+      return false;
+  }
+}
+
+size_t SplitLines(Isa isa, std::string_view input, Line *lines,
+                  size_t max_lines, size_t *consumed) {
+  return SplitLinesWith(ClassifierFor(isa), input, lines, max_lines, consumed);
+}
+
+}  // namespace lines_internal
+}  // namespace cue2pb
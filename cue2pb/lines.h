@@ -0,0 +1,66 @@
+#ifndef CUE2PB_LINES_H_
+#define CUE2PB_LINES_H_
+
+#include <string_view>
+#include <stddef.h>
+#include <stdint.h>
+
+// Splits cuesheet input into lines, and each line into its command and the
+// rest of it. Any ASCII whitespace (so tabs, and the \r of CRLF line endings)
+// separates tokens and is trimmed from both ends of a line.
+
+namespace cue2pb {
+
+// Offsets into the input the line was split from. command is empty for a blank
+// line, and rest is empty if there's nothing after the command.
+struct Line {
+  uint32_t command_begin;
+  uint32_t command_end;
+  uint32_t rest_begin;
+  uint32_t rest_end;
+
+  std::string_view command(std::string_view input) const {
+    return input.substr(command_begin, command_end - command_begin);
+  }
+  std::string_view rest(std::string_view input) const {
+    return input.substr(rest_begin, rest_end - rest_begin);
+  }
+};
+
+// Splits a single line, which must not contain a newline.
+Line SplitLine(std::string_view line);
+
+// The most bytes SplitLines() looks at in one call.
+inline constexpr size_t kSplitLinesWindow = 4096;
+
+// Splits up to max_lines newline-terminated lines from the front of input, and
+// sets *consumed to the length of those lines, including their newlines.
+// Returns how many lines were split.
+//
+// The first min(input.size(), kSplitLinesWindow) bytes are classified at once,
+// using AVX2 or SSE2 where the CPU supports them, into bitmaps from which the
+// lines are then read off. Returns 0 if those bytes contain no newline, which
+// for a full window means the first line is longer than it; the caller can
+// find the end of such a line itself, and SplitLine() it.
+size_t SplitLines(std::string_view input, Line *lines, size_t max_lines,
+                  size_t *consumed);
+
+namespace lines_internal {
+
+enum class Isa {
+  kScalar,
+  kSse2,
+  kAvx2,
+};
+
+bool IsSupported(Isa isa);
+
+// SplitLines() with a specific instruction set, which must be supported.
+size_t SplitLines(Isa isa, std::string_view input, Line *lines,
+                  size_t max_lines, size_t *consumed);
+
+}  // namespace lines_internal
+
+}  // namespace cue2pb
+
+#endif  // CUE2PB_LINES_H_
@@ -0,0 +1,155 @@
+#include "cue2pb/lines.h"
+
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace cue2pb {
+namespace {
+
+using ::cue2pb::lines_internal::Isa;
+
+struct Tokens {
+  std::string command;
+  std::string rest;
+
+  bool operator==(const Tokens &other) const {
+    return command == other.command && rest == other.rest;
+  }
+};
+
+std::ostream &operator<<(std::ostream &os, const Tokens &tokens) {
+  return os << "{'" << tokens.command << "', '" << tokens.rest << "'}";
+}
+
+Tokens Split(std::string_view line) {
+  Line split = SplitLine(line);
+  return {std::string(split.command(line)), std::string(split.rest(line))};
+}
+
+TEST(SplitLineTest, Tokens) {
+  EXPECT_EQ((Tokens{"TRACK", "01 AUDIO"}), Split("TRACK 01 AUDIO"));
+  EXPECT_EQ((Tokens{"TRACK", "01 AUDIO"}), Split("  TRACK   01 AUDIO  "));
+  EXPECT_EQ((Tokens{"TRACK", "01\tAUDIO"}), Split("\tTRACK\t01\tAUDIO\r"));
+  EXPECT_EQ((Tokens{"REM", ""}), Split("REM"));
+  EXPECT_EQ((Tokens{"REM", ""}), Split("REM \r"));
+  EXPECT_EQ((Tokens{"", ""}), Split(""));
+  EXPECT_EQ((Tokens{"", ""}), Split(" \t\r\v\f"));
+}
+
+std::vector<Isa> SupportedIsas() {
+  std::vector<Isa> isas;
+  for (Isa isa : {Isa::kScalar, Isa::kSse2, Isa::kAvx2}) {
+    if (lines_internal::IsSupported(isa)) isas.push_back(isa);
+  }
+  return isas;
+}
+
+// Splits every line of input, and checks each against SplitLine().
+void ExpectSplitsLikeSplitLine(Isa isa, std::string_view input,
+                               size_t max_lines) {
+  std::vector<Line> lines(max_lines);
+  while (!input.empty()) {
+    size_t consumed = 0;
+    size_t n = lines_internal::SplitLines(isa, input, lines.data(), max_lines,
+                                          &consumed);
+    if (n == 0) {
+      size_t eol = input.find('\n');
+      if (eol != std::string_view::npos) {
+        ASSERT_LE(kSplitLinesWindow, eol);
+        input.remove_prefix(eol + 1);
+        continue;
+      }
+      return;
+    }
+    ASSERT_LE(n, max_lines);
+
+    std::string_view remaining = input;
+    for (size_t i = 0; i < n; i++) {
+      size_t eol = remaining.find('\n');
+      ASSERT_NE(std::string_view::npos, eol);
+      std::string_view line = remaining.substr(0, eol);
+      size_t offset = line.data() - input.data();
+      Tokens expected = Split(line);
+      Tokens found{std::string(lines[i].command(input)),
+                   std::string(lines[i].rest(input))};
+      EXPECT_EQ(expected, found) << "'" << line << "'";
+      if (!expected.command.empty()) {
+        EXPECT_EQ(offset + SplitLine(line).command_begin,
+                  lines[i].command_begin);
+      }
+      remaining.remove_prefix(eol + 1);
+    }
+    ASSERT_EQ(input.size() - remaining.size(), consumed);
+    input.remove_prefix(consumed);
+  }
+}
+
+TEST(SplitLinesTest, Cuesheet) {
+  std::string input =
+      "REM GENRE Ska\r\n"
+      "FILE \"The Specials - Singles.wav\" WAVE\r\n"
+      "\tTRACK 01 AUDIO\r\n"
+      "\r\n"
+      "\n"
+      "    INDEX\t01 00:00:00   \r\n"
+      "unterminated";
+  for (Isa isa : SupportedIsas()) {
+    Line lines[16];
+    size_t consumed;
+    ASSERT_EQ(6, lines_internal::SplitLines(isa, input, lines, 16, &consumed));
+    EXPECT_EQ(input.size() - std::string_view("unterminated").size(),
+              consumed);
+    EXPECT_EQ("TRACK", lines[2].command(input));
+    EXPECT_EQ("01 AUDIO", lines[2].rest(input));
+    EXPECT_EQ("", lines[3].command(input));
+    EXPECT_EQ("", lines[4].command(input));
+    EXPECT_EQ("INDEX", lines[5].command(input));
+    EXPECT_EQ("01 00:00:00", lines[5].rest(input));
+
+    ExpectSplitsLikeSplitLine(isa, input, 16);
+    ExpectSplitsLikeSplitLine(isa, input, 1);
+  }
+}
+
+TEST(SplitLinesTest, RandomInput) {
+  // Mostly whitespace and newlines, so that lines and tokens start and end at
+  // every offset within and across blocks.
+  const char alphabet[] = "ab  \t\t\r\n\n\v\f";
+  std::mt19937 rng(1234);
+  for (int iteration = 0; iteration < 200; iteration++) {
+    size_t size = std::uniform_int_distribution<size_t>(0, 9000)(rng);
+    std::string input(size, ' ');
+    for (char &c : input) {
+      c = alphabet[std::uniform_int_distribution<size_t>(
+          0, sizeof(alphabet) - 2)(rng)];
+    }
+    for (Isa isa : SupportedIsas()) {
+      ExpectSplitsLikeSplitLine(isa, input, 300);
+      ExpectSplitsLikeSplitLine(isa, input, 7);
+    }
+  }
+}
+
+TEST(SplitLinesTest, LongLines) {
+  std::string input = "TITLE " + std::string(2 * kSplitLinesWindow, 'x') +
+      "\nTRACK 01 AUDIO\n" + std::string(kSplitLinesWindow - 32, ' ') + "\n";
+  for (Isa isa : SupportedIsas()) {
+    Line lines[4];
+    size_t consumed;
+    EXPECT_EQ(0, lines_internal::SplitLines(isa, input, lines, 4, &consumed));
+
+    std::string_view rest = input;
+    rest.remove_prefix(rest.find('\n') + 1);
+    ASSERT_EQ(2, lines_internal::SplitLines(isa, rest, lines, 4, &consumed));
+    EXPECT_EQ("TRACK", lines[0].command(rest));
+    EXPECT_EQ("", lines[1].command(rest));
+    EXPECT_EQ(rest.size(), consumed);
+  }
+}
+
+}  // namespace
+}  // namespace cue2pb
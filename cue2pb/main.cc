@@ -1,18 +1,24 @@
-#include <fstream>
+#include <optional>
 #include <string>
+#include <vector>
 #include <iostream>
 #include <sysexits.h>
 #include <cstdlib>
 #include <stdlib.h>
-#include <ios>
 #include <errno.h>
+#include <unistd.h>
+#include <signal.h>
 
-#include "cue2pb/parser.h"
-#include "cue2pb/unparser.h"
+#include "cue2pb/archive.h"
+#include "cue2pb/batch.h"
+#include "cue2pb/convert.h"
+#include "cue2pb/server.h"
+#include "cue2pb/sync.h"
+#include "cue2pb/tag_index.h"
 #include "util/file.h"
+#include "util/thread_pool.h"
+#include "util/status_builder.h"
 #include "util/status_macros.h"
-#include "cue2pb/text_format.h"
-#include "cue2pb/cuesheet.pb.h"
 #include "absl/types/span.h"
 #include "absl/strings/string_view.h"
 #include "absl/strings/str_cat.h"
@@ -23,77 +29,240 @@
 #include "absl/flags/parse.h"
 #include "absl/flags/usage.h"
 #include "absl/flags/usage_config.h"
-#include "google/protobuf/text_format.h"
-#include "google/protobuf/io/zero_copy_stream_impl.h"
 
 ABSL_FLAG(bool, proto_to_cue, false,
           "Convert back from a protobuf to a Cuesheet");
 ABSL_FLAG(bool, textformat, false, "Use the text protobuf format");
+ABSL_FLAG(std::string, serve, "",
+          "Instead of converting a file, run as a conversion server speaking "
+          "the protocol in cue2pb/service.proto. 'stdio' serves requests "
+          "from stdin on stdout; anything else is the path of a unix domain "
+          "socket to listen on");
+ABSL_FLAG(std::string, files_from, "",
+          "Also convert every file listed, one per line, in this file ('-' "
+          "for stdin)");
+ABSL_FLAG(int, jobs, 0,
+          "The number of files to convert in parallel when converting more "
+          "than one. Defaults to one per CPU");
+ABSL_FLAG(std::string, output_suffix, "",
+          "Write each file's output next to it, with its extension replaced "
+          "by this suffix (e.g. .cuepb), instead of to stdout. When "
+          "converting more than one file to stdout, each output is written as "
+          "a varint length-delimited record. A file that fails to convert "
+          "gets an empty record, which looks the same as an empty cuesheet's; "
+          "the failure is reported on stderr with the file's index");
+ABSL_FLAG(std::string, output, "",
+          "Write the protos of every file converted into this cuesheet "
+          "archive (e.g. cuesheets.cuepbs), keyed by input path. Only for "
+          "binary protos");
+ABSL_FLAG(std::string, archive_key, "",
+          "With --proto_to_cue and a cuesheet archive, the key of the "
+          "cuesheet to convert back. May be omitted if the archive holds only "
+          "one");
+ABSL_FLAG(std::string, tag_index, "",
+          "With --output, also index the tags of the archive's cuesheets in "
+          "this file (e.g. cuesheets.cuetags). With a cuesheet archive as "
+          "the only argument, index that archive. With --query, the index to "
+          "search");
+ABSL_FLAG(std::string, query, "",
+          "Print the archive offset of every cuesheet in --tag_index matching "
+          "this query of FIELD:value terms joined by AND and OR, e.g. "
+          "'GENRE:Jazz AND PERFORMER:\"Miles Davis\"'");
+ABSL_FLAG(std::string, recursive, "",
+          "Convert every .cue file under this directory to a proto next to "
+          "it (named by --output_suffix, .cuepb by default). A manifest in "
+          "the directory records what was converted, so that unchanged files "
+          "are skipped next time");
+ABSL_FLAG(std::string, cache_dir, "",
+          "Keep the protos of converted cuesheets in this directory, keyed by "
+          "their contents, so that copies of the same cuesheet are only "
+          "parsed once. May be shared by concurrent cue2pb processes");
+ABSL_FLAG(int64_t, cache_max_bytes, int64_t{1} << 30,
+          "The size past which --cache_dir evicts its least recently used "
+          "entries");
+ABSL_FLAG(int, workers, 0,
+          "The number of conversion threads for --serve. Defaults to one per "
+          "CPU");
 
 namespace cue2pb {
 
-using ::google::protobuf::TextFormat;
-using ::google::protobuf::io::OstreamOutputStream;
+absl::Status ArchiveToCue(util::MappedFile mapped, std::string *out) {
+  ASSIGN_OR_RETURN(ArchiveReader reader, ArchiveReader::Open(std::move(mapped)));
+
+  std::string key = absl::GetFlag(FLAGS_archive_key);
+  if (key.empty()) {
+    if (reader.size() != 1) {
+      return util::InvalidArgumentErrorBuilder()
+          << "The archive holds " << reader.size()
+          << " cuesheets; choose one with --archive_key";
+    }
+    key = std::string(reader.key(0));
+  }
+
+  ASSIGN_OR_RETURN(std::string_view record, reader.Find(key));
+  return ProtoToCue(record, ProtoFormat::kBinary, out);
+}
+
+absl::Status WriteTagIndex(absl::string_view archive_path,
+                           absl::string_view index_path) {
+  ASSIGN_OR_RETURN(ArchiveReader archive, ArchiveReader::Open(archive_path));
+  TagIndexBuilder builder;
+  RETURN_IF_ERROR(IndexArchive(archive, &builder));
+  return builder.Write(index_path);
+}
+
+absl::Status QueryTagIndex(absl::string_view index_path,
+                           absl::string_view query) {
+  ASSIGN_OR_RETURN(TagQuery parsed, ParseTagQuery(query));
+  ASSIGN_OR_RETURN(TagIndexReader index, TagIndexReader::Open(index_path));
+  ASSIGN_OR_RETURN(std::vector<uint64_t> records, index.Search(parsed));
+
+  std::string out;
+  for (uint64_t record : records) absl::StrAppend(&out, record, "\n");
+  return util::WriteFully(STDOUT_FILENO, out);
+}
+
+ProtoFormat FlagProtoFormat() {
+  return absl::GetFlag(FLAGS_textformat) ? ProtoFormat::kText
+                                         : ProtoFormat::kBinary;
+}
 
 absl::Status ProtoToCue(absl::string_view protofile) {
-  bool textformat = absl::GetFlag(FLAGS_textformat);
+  ASSIGN_OR_RETURN(util::MappedFile mapped, OpenInput(protofile));
 
-  auto mode = std::ios::in;
-  if (!textformat) {
-    mode |= std::ios::binary;
+  std::string out;
+  if (FlagProtoFormat() == ProtoFormat::kBinary &&
+      ArchiveReader::IsArchive(mapped.contents())) {
+    RETURN_IF_ERROR(ArchiveToCue(std::move(mapped), &out));
+  } else {
+    RETURN_IF_ERROR(ProtoToCue(mapped.contents(), FlagProtoFormat(), &out));
   }
+  return util::WriteFully(STDOUT_FILENO, out);
+}
 
-  ASSIGN_OR_RETURN(std::ifstream istrm, util::OpenInputFile(protofile, mode));
+absl::Status CueToProto(absl::string_view cuefile, const ParseCache *cache) {
+  ASSIGN_OR_RETURN(util::MappedFile mapped, OpenInput(cuefile));
 
-  Cuesheet cuesheet;
-  if (textformat) {
-    ASSIGN_OR_RETURN(cuesheet, CuesheetFromTextProto(&istrm));
-  } else {
-    if (!cuesheet.ParseFromIstream(&istrm)) {
-      return absl::UnknownError("Failed to parse binary proto");
-    }
+  std::string out;
+  RETURN_IF_ERROR(
+      CueToProto(mapped.contents(), FlagProtoFormat(), cache, &out));
+  return util::WriteFully(STDOUT_FILENO, out);
+}
+
+absl::Status Serve(absl::string_view address) {
+  // A client hanging up mid-response must not kill the server.
+  signal(SIGPIPE, SIG_IGN);
+
+  util::ThreadPool pool(absl::GetFlag(FLAGS_workers));
+  if (address == "stdio") {
+    return ServeStream(STDIN_FILENO, STDOUT_FILENO, &pool);
   }
+  return ServeUnixSocket(address, &pool);
+}
 
-  RETURN_IF_ERROR(UnparseCuesheet(cuesheet, &std::cout));
+absl::Status Sync(absl::string_view root, std::string output_suffix,
+                  const ParseCache *cache) {
+  if (absl::GetFlag(FLAGS_proto_to_cue)) {
+    return absl::InvalidArgumentError(
+        "--recursive only converts cuesheets to protos");
+  }
 
-  return absl::OkStatus();
+  SyncOptions options;
+  options.format = FlagProtoFormat();
+  options.jobs = absl::GetFlag(FLAGS_jobs);
+  if (!output_suffix.empty()) options.output_suffix = std::move(output_suffix);
+  options.cache = cache;
+
+  SyncStats stats;
+  absl::Status st = SyncTree(root, options, &stats, &std::cerr);
+  std::cerr << stats.converted << " converted, " << stats.unchanged
+            << " unchanged, " << stats.failed << " failed" << std::endl;
+  return st;
 }
 
-absl::Status CueToProto(absl::string_view cuefile) {
-  bool textformat = absl::GetFlag(FLAGS_textformat);
+absl::Status Main(absl::Span<absl::string_view> args) {
+  if (std::string address = absl::GetFlag(FLAGS_serve); !address.empty()) {
+    if (!args.empty()) {
+      return absl::InvalidArgumentError("--serve takes no arguments");
+    }
+    return Serve(address);
+  }
 
-  auto mode = std::ios::in;
-  if (!textformat) {
-    mode |= std::ios::binary;
+  std::string tag_index = absl::GetFlag(FLAGS_tag_index);
+  if (std::string query = absl::GetFlag(FLAGS_query); !query.empty()) {
+    if (tag_index.empty() || !args.empty()) {
+      return absl::InvalidArgumentError(
+          "--query searches a --tag_index, and takes no arguments");
+    }
+    return QueryTagIndex(tag_index, query);
   }
 
-  ASSIGN_OR_RETURN(std::ifstream istrm, util::OpenInputFile(cuefile, mode));
-  ASSIGN_OR_RETURN(Cuesheet cuesheet, ParseCuesheet(&istrm));
+  std::optional<ParseCache> cache;
+  if (std::string dir = absl::GetFlag(FLAGS_cache_dir); !dir.empty()) {
+    ASSIGN_OR_RETURN(cache, ParseCache::Open(
+        dir, absl::GetFlag(FLAGS_cache_max_bytes)));
+  }
+  const ParseCache *cache_ptr = cache ? &*cache : nullptr;
 
-  if (textformat) {
-    OstreamOutputStream cout_os(&std::cout);
-    if (!TextFormat::Print(cuesheet, &cout_os)) {
-      return absl::UnknownError("Failed to print cuesheet");
+  std::string files_from = absl::GetFlag(FLAGS_files_from);
+  std::string output_suffix = absl::GetFlag(FLAGS_output_suffix);
+  if (std::string root = absl::GetFlag(FLAGS_recursive); !root.empty()) {
+    if (!args.empty() || !files_from.empty()) {
+      return absl::InvalidArgumentError(
+          "--recursive takes no other files to convert");
     }
-  } else {
-    if (!cuesheet.SerializeToOstream(&std::cout)) {
-      return absl::UnknownError("Failed to serialize binary proto");
+    return Sync(root, output_suffix, cache_ptr);
+  }
+  std::string output = absl::GetFlag(FLAGS_output);
+  if (!tag_index.empty() && output.empty()) {
+    if (args.size() != 1 || !files_from.empty()) {
+      return absl::InvalidArgumentError(
+          "--tag_index without --output indexes one cuesheet archive");
+    }
+    return WriteTagIndex(args[0], tag_index);
+  }
+  if (args.size() == 1 && files_from.empty() && output_suffix.empty() &&
+      output.empty()) {
+    if (absl::GetFlag(FLAGS_proto_to_cue)) {
+      return ProtoToCue(args[0]);
+    } else {
+      return CueToProto(args[0], cache_ptr);
     }
   }
 
-  return absl::OkStatus();
-}
+  std::vector<std::string> inputs(args.begin(), args.end());
+  if (!files_from.empty()) {
+    RETURN_IF_ERROR(ReadFileList(files_from, &inputs));
+  }
+  if (inputs.empty()) {
+    return absl::InvalidArgumentError("No cuefile specified");
+  }
 
-absl::Status Main(absl::Span<absl::string_view> args) {
-  if (args.size() != 1) {
-    return absl::InvalidArgumentError("No cuefile specified or too many arguments");
+  BatchOptions options;
+  options.proto_to_cue = absl::GetFlag(FLAGS_proto_to_cue);
+  options.format = FlagProtoFormat();
+  options.jobs = absl::GetFlag(FLAGS_jobs);
+  options.output_suffix = std::move(output_suffix);
+  options.cache = cache_ptr;
+  if (output.empty()) {
+    return ConvertFiles(inputs, options, STDOUT_FILENO, &std::cerr);
   }
 
-  if (absl::GetFlag(FLAGS_proto_to_cue)) {
-    return ProtoToCue(args[0]);
-  } else {
-    return CueToProto(args[0]);
+  if (options.proto_to_cue || options.format != ProtoFormat::kBinary ||
+      !options.output_suffix.empty()) {
+    return absl::InvalidArgumentError(
+        "--output can't be combined with --proto_to_cue, --textformat or "
+        "--output_suffix");
   }
+  ASSIGN_OR_RETURN(ArchiveWriter archive, ArchiveWriter::Create(output));
+  options.archive = &archive;
+  absl::Status st = ConvertFiles(inputs, options, STDOUT_FILENO, &std::cerr);
+  // Files that failed to convert are left out, but the rest are kept. If
+  // writing the archive failed, Finish() discards it and returns why.
+  absl::Status finished = archive.Finish();
+  if (!finished.ok()) return finished;
+  if (!tag_index.empty()) RETURN_IF_ERROR(WriteTagIndex(output, tag_index));
+  return st;
 }
 
 }  // namespace cue2pb
@@ -105,7 +274,7 @@ int main(int argc, char *argv[]) {
   absl::SetProgramUsageMessage(
       absl::StrCat(
         "Convert CD cuesheets to/from protobufs.\n",
-        "Usage: ", program_invocation_short_name, " [flags] cuefile"));
+        "Usage: ", program_invocation_short_name, " [flags] cuefile..."));
   absl::FlagsUsageConfig config;
   config.contains_help_flags = [](absl::string_view path) {
     return path == "cue2pb/main.cc";
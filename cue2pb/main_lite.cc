@@ -0,0 +1,93 @@
+// A minimal cue2pb for embedding and spawning per file: binary protos only,
+// built against the lite protobuf runtime, without absl flags or the failure
+// signal handler.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+
+#include "absl/status/status.h"
+#include "cue2pb/cuesheet.pb.h"
+#include "cue2pb/parser.h"
+#include "cue2pb/unparser.h"
+#include "util/file.h"
+#include "util/status_macros.h"
+
+namespace cue2pb {
+namespace {
+
+constexpr char kUsage[] =
+    "Convert CD cuesheets to/from binary protobufs.\n"
+    "Usage: cue2pb_lite [--proto_to_cue] file\n"
+    "\n"
+    "file may be - for stdin.\n";
+
+absl::StatusOr<util::MappedFile> OpenInput(std::string_view path) {
+  return util::MappedFile::Open(path == "-" ? "/dev/stdin" : path);
+}
+
+absl::Status CueToProto(std::string_view cuefile) {
+  ASSIGN_OR_RETURN(util::MappedFile mapped, OpenInput(cuefile));
+  google::protobuf::Arena arena;
+  ASSIGN_OR_RETURN(Cuesheet *cuesheet,
+                   ParseCuesheet(mapped.contents(), &arena));
+
+  std::string out;
+  if (!cuesheet->SerializeToString(&out)) {
+    return absl::UnknownError("Failed to serialize binary proto");
+  }
+  return util::WriteFully(STDOUT_FILENO, out);
+}
+
+absl::Status ProtoToCue(std::string_view protofile) {
+  ASSIGN_OR_RETURN(util::MappedFile mapped, OpenInput(protofile));
+  Cuesheet cuesheet;
+  if (!cuesheet.ParseFromArray(mapped.contents().data(),
+                               static_cast<int>(mapped.contents().size()))) {
+    return absl::UnknownError("Failed to parse binary proto");
+  }
+
+  std::string out;
+  RETURN_IF_ERROR(UnparseCuesheet(cuesheet, &out));
+  return util::WriteFully(STDOUT_FILENO, out);
+}
+
+absl::Status Main(int argc, char *argv[]) {
+  bool proto_to_cue = false;
+  const char *file = nullptr;
+  for (int i = 1; i < argc; i++) {
+    std::string_view arg = argv[i];
+    if (arg == "--proto_to_cue") {
+      proto_to_cue = true;
+    } else if (arg == "--help") {
+      std::fputs(kUsage, stdout);
+      return absl::OkStatus();
+    } else if (file == nullptr && (arg == "-" || arg.substr(0, 1) != "-")) {
+      file = argv[i];
+    } else {
+      return absl::InvalidArgumentError("Unexpected argument " +
+                                        std::string(arg));
+    }
+  }
+  if (file == nullptr) return absl::InvalidArgumentError("No file specified");
+
+  return proto_to_cue ? ProtoToCue(file) : CueToProto(file);
+}
+
+}  // namespace
+}  // namespace cue2pb
+
+int main(int argc, char *argv[]) {
+  if (absl::Status err = cue2pb::Main(argc, argv); !err.ok()) {
+    if (err.code() == absl::StatusCode::kInvalidArgument) {
+      std::fputs(cue2pb::kUsage, stderr);
+      std::fputc('\n', stderr);
+    }
+    std::fprintf(stderr, "%s\n", err.ToString().c_str());
+    return static_cast<int>(err.code());
+  }
+  return EXIT_SUCCESS;
+}
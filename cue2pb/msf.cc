@@ -0,0 +1,107 @@
+#include "cue2pb/msf.h"
+
+#include <cstring>
+#include <stddef.h>
+
+namespace cue2pb {
+namespace {
+
+// Eight byte "mm:ss:ff", loaded little-endian so that byte i of the string is
+// byte i of the word.
+constexpr uint64_t kDigitBytes = 0xFFFF00FFFF00FFFFull;
+constexpr uint64_t kColons = (uint64_t{':'} << 16) | (uint64_t{':'} << 40);
+constexpr uint64_t kZeros = 0x3030303030303030ull;
+constexpr uint64_t kHighNibbles = 0xF0F0F0F0F0F0F0F0ull;
+constexpr uint64_t kSixes = 0x0606060606060606ull;
+
+uint64_t LoadLittleEndian64(const char *p) {
+  uint64_t v;
+  std::memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  v = __builtin_bswap64(v);
+#endif
+  return v;
+}
+
+bool DecodeFixedMSF(const char *p, int32_t *minute, int32_t *second,
+                    int32_t *frame) {
+  uint64_t v = LoadLittleEndian64(p);
+
+  if ((v & ~kDigitBytes) != kColons) return false;
+  // A byte is an ASCII digit iff its high nibble is 3 both before and after
+  // adding 6 ('9' + 6 == '?', but ':' + 6 == '@'). Once every high nibble is
+  // known to be 3, adding 6 can't carry between bytes.
+  uint64_t digits = v & kDigitBytes;
+  constexpr uint64_t kDigitHighNibbles = kZeros & kDigitBytes;
+  if ((digits & kHighNibbles) != kDigitHighNibbles) return false;
+  if (((digits + kSixes) & kHighNibbles & kDigitBytes) != kDigitHighNibbles) {
+    return false;
+  }
+
+  // Fold each pair of digits into its first byte: byte i becomes
+  // 10 * d[i] + d[i + 1]. Every byte stays below 110, so nothing carries.
+  uint64_t t = v - kZeros;
+  uint64_t pairs = t * 10 + (t >> 8);
+  auto m = static_cast<int32_t>(pairs & 0xFF);
+  auto s = static_cast<int32_t>((pairs >> 24) & 0xFF);
+  auto f = static_cast<int32_t>((pairs >> 48) & 0xFF);
+
+  if (s >= kSecondsPerMinute || f >= kFramesPerSecond) return false;
+  *minute = m;
+  *second = s;
+  *frame = f;
+  return true;
+}
+
+// Consumes one or more digits from the front of *str.
+bool ConsumeNumber(std::string_view *str, int32_t *value) {
+  // Nine digits can't overflow an int32_t.
+  constexpr size_t kMaxDigits = 9;
+
+  auto is_digit = [str](size_t i) {
+    return static_cast<unsigned>(static_cast<unsigned char>((*str)[i]) - '0')
+        <= 9;
+  };
+
+  size_t i = 0;
+  int32_t v = 0;
+  for (; i < str->size() && i < kMaxDigits && is_digit(i); i++) {
+    v = v * 10 + ((*str)[i] - '0');
+  }
+  // A tenth digit is too many.
+  if (i == 0 || (i < str->size() && is_digit(i))) return false;
+
+  str->remove_prefix(i);
+  *value = v;
+  return true;
+}
+
+bool ConsumeColon(std::string_view *str) {
+  if (str->empty() || str->front() != ':') return false;
+  str->remove_prefix(1);
+  return true;
+}
+
+}  // namespace
+
+bool DecodeMSF(std::string_view str, int32_t *minute, int32_t *second,
+               int32_t *frame) {
+  if (str.size() == 8 && DecodeFixedMSF(str.data(), minute, second, frame)) {
+    return true;
+  }
+
+  int32_t m, s, f;
+  if (!ConsumeNumber(&str, &m) || !ConsumeColon(&str) ||
+      !ConsumeNumber(&str, &s) || !ConsumeColon(&str) ||
+      !ConsumeNumber(&str, &f) || !str.empty()) {
+    return false;
+  }
+  if (s >= kSecondsPerMinute || f >= kFramesPerSecond) return false;
+
+  *minute = m;
+  *second = s;
+  *frame = f;
+  return true;
+}
+
+}  // namespace cue2pb
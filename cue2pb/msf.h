@@ -0,0 +1,38 @@
+#ifndef CUE2PB_MSF_H_
+#define CUE2PB_MSF_H_
+
+#include <string_view>
+#include <stdint.h>
+
+namespace cue2pb {
+
+inline constexpr int32_t kSecondsPerMinute = 60;
+inline constexpr int32_t kFramesPerSecond = 75;
+inline constexpr int32_t kFramesPerMinute = kSecondsPerMinute * kFramesPerSecond;
+
+// Converts between a position in minutes, seconds and frames, and the number
+// of frames since 00:00:00. Minutes are unbounded, so frames need 64 bits.
+constexpr int64_t MSFToFrames(int32_t minute, int32_t second, int32_t frame) {
+  return int64_t{minute} * kFramesPerMinute +
+      int64_t{second} * kFramesPerSecond + frame;
+}
+constexpr void FramesToMSF(int64_t frames, int32_t *minute, int32_t *second,
+                           int32_t *frame) {
+  *minute = static_cast<int32_t>(frames / kFramesPerMinute);
+  *second = static_cast<int32_t>(frames / kFramesPerSecond % kSecondsPerMinute);
+  *frame = static_cast<int32_t>(frames % kFramesPerSecond);
+}
+
+// Decodes a CD position of the form mm:ss:ff (minutes, seconds, frames), as
+// used by INDEX, PREGAP and POSTGAP. Returns false, leaving the outputs
+// untouched, unless str is well formed with seconds < 60 and frames < 75.
+//
+// The common eight byte form is checked and decoded as a single 64-bit word.
+// Anything else (e.g. three digit minutes, or single digit fields) falls back
+// to a scalar decoder. Neither allocates.
+bool DecodeMSF(std::string_view str, int32_t *minute, int32_t *second,
+               int32_t *frame);
+
+}  // namespace cue2pb
+
+#endif  // CUE2PB_MSF_H_
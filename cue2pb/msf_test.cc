@@ -0,0 +1,106 @@
+#include "cue2pb/msf.h"
+
+#include <string>
+#include <string_view>
+
+#include "gtest/gtest.h"
+#include "absl/strings/str_format.h"
+
+namespace cue2pb {
+namespace {
+
+struct DecodedMSF {
+  int32_t minute = -1;
+  int32_t second = -1;
+  int32_t frame = -1;
+};
+
+bool Decode(std::string_view str, DecodedMSF *msf) {
+  return DecodeMSF(str, &msf->minute, &msf->second, &msf->frame);
+}
+
+TEST(DecodeMSFTest, FixedWidth) {
+  DecodedMSF msf;
+  ASSERT_TRUE(Decode("03:22:70", &msf));
+  EXPECT_EQ(3, msf.minute);
+  EXPECT_EQ(22, msf.second);
+  EXPECT_EQ(70, msf.frame);
+}
+
+TEST(DecodeMSFTest, EveryFixedWidthValue) {
+  for (int m = 0; m < 100; m += 7) {
+    for (int s = 0; s < 60; s++) {
+      for (int f = 0; f < 75; f++) {
+        std::string str = absl::StrFormat("%02d:%02d:%02d", m, s, f);
+        DecodedMSF msf;
+        ASSERT_TRUE(Decode(str, &msf)) << str;
+        EXPECT_EQ(m, msf.minute) << str;
+        EXPECT_EQ(s, msf.second) << str;
+        EXPECT_EQ(f, msf.frame) << str;
+      }
+    }
+  }
+}
+
+TEST(DecodeMSFTest, VariableWidth) {
+  DecodedMSF msf;
+  ASSERT_TRUE(Decode("123:04:05", &msf));
+  EXPECT_EQ(123, msf.minute);
+  EXPECT_EQ(4, msf.second);
+  EXPECT_EQ(5, msf.frame);
+
+  ASSERT_TRUE(Decode("1:2:3", &msf));
+  EXPECT_EQ(1, msf.minute);
+  EXPECT_EQ(2, msf.second);
+  EXPECT_EQ(3, msf.frame);
+
+  ASSERT_TRUE(Decode("999999999:00:00", &msf));
+  EXPECT_EQ(999999999, msf.minute);
+
+  ASSERT_TRUE(Decode("100:0:00", &msf));
+  EXPECT_EQ(100, msf.minute);
+  EXPECT_EQ(0, msf.second);
+  EXPECT_EQ(0, msf.frame);
+}
+
+TEST(DecodeMSFTest, OutOfRange) {
+  DecodedMSF msf;
+  EXPECT_FALSE(Decode("00:60:00", &msf));
+  EXPECT_FALSE(Decode("00:00:75", &msf));
+  EXPECT_FALSE(Decode("00:99:99", &msf));
+  EXPECT_FALSE(Decode("100:60:00", &msf));
+  EXPECT_EQ(-1, msf.minute);
+}
+
+TEST(DecodeMSFTest, Malformed) {
+  DecodedMSF msf;
+  const std::string_view malformed[] = {
+    "", "00:00", "00:00:00:00", "0a:00:00", "00;00;00", "-1:00:00",
+    "00:00:0 ", " 0:00:00", "00::0000", "//:00:00", "::::::::",
+    "0000000000:00:00", "9999999999:00:00", "4294967296:00:00",
+    "00:0000000001:00", std::string_view("00:\0000:00", 8),
+  };
+  for (std::string_view str : malformed) {
+    EXPECT_FALSE(Decode(str, &msf)) << str;
+  }
+  EXPECT_EQ(-1, msf.minute);
+}
+
+static_assert(MSFToFrames(0, 0, 0) == 0);
+static_assert(MSFToFrames(0, 2, 0) == 150);
+static_assert(MSFToFrames(74, 33, 74) == 335549);
+
+TEST(FramesTest, RoundTrip) {
+  for (int64_t frames : {int64_t{0}, int64_t{74}, int64_t{75}, int64_t{4499},
+                         int64_t{4500}, int64_t{335549},
+                         MSFToFrames(999999999, 59, 74)}) {
+    DecodedMSF msf;
+    FramesToMSF(frames, &msf.minute, &msf.second, &msf.frame);
+    EXPECT_LT(msf.second, kSecondsPerMinute);
+    EXPECT_LT(msf.frame, kFramesPerSecond);
+    EXPECT_EQ(frames, MSFToFrames(msf.minute, msf.second, msf.frame));
+  }
+}
+
+}  // namespace
+}  // namespace cue2pb
@@ -2,13 +2,118 @@
 #define CUE2PB_PARSER_H_
 
 #include <istream>
+#include <limits>
+#include <string_view>
+#include <stdint.h>
 
 #include "cue2pb/cuesheet.pb.h"
+#include "cue2pb/visitor.h"
+#include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "google/protobuf/arena.h"
 
 namespace cue2pb {
 
-absl::StatusOr<Cuesheet> ParseCuesheet(std::istream *input);
+// A change to what any of these parse from some input must bump
+// kParserVersion in cache.h, so that cached protos aren't served stale.
+
+// Parses a cuesheet held entirely in memory. Lines are parsed in place, so
+// this is the cheapest way to parse a cuesheet that is already in a buffer or
+// a util::MappedFile. options can limit what's parsed; see ParseOptions.
+absl::StatusOr<Cuesheet> ParseCuesheet(
+    std::string_view input, const ParseOptions &options = ParseOptions());
+
+// As above, but allocates the Cuesheet and everything in it on arena. The
+// returned Cuesheet is owned by the arena, and on error any partially parsed
+// Cuesheet is left there until the arena is reset. Callers parsing many
+// cuesheets can Reset() one arena between them to reuse its memory.
+absl::StatusOr<Cuesheet*> ParseCuesheet(
+    std::string_view input, google::protobuf::Arena *arena,
+    const ParseOptions &options = ParseOptions());
+
+// Reads input in chunks, parsing each as it arrives. Stops reading once
+// everything asked for has been parsed.
+absl::StatusOr<Cuesheet> ParseCuesheet(
+    std::istream *input, const ParseOptions &options = ParseOptions());
+
+// A CuesheetVisitor which builds a Cuesheet. It remembers which FILE and
+// TRACK block it is in, so finding where a command belongs never requires
+// searching the partially built Cuesheet.
+//
+// Strings are set from (data, size) pairs straight out of the input, and
+// submessages are built in place, so that when the Cuesheet lives on an arena
+// nothing is built on the heap first and then copied over.
+class CuesheetBuilder : public CuesheetVisitor {
+ public:
+  // cuesheet is not owned, and must outlive the builder. It may live on an
+  // arena. Of options, only compact_positions applies to the builder.
+  explicit CuesheetBuilder(Cuesheet *cuesheet,
+                           const ParseOptions &options = ParseOptions())
+    : cuesheet_(cuesheet),
+      compact_positions_(options.compact_positions)
+    {}
+
+  absl::Status OnCatalog(std::string_view catalog) override;
+  absl::Status OnCdTextFile(std::string_view path) override;
+  absl::Status OnFile(std::string_view path,
+                      Cuesheet::File::Type type) override;
+  absl::Status OnTrack(int32_t number, Cuesheet::Track::Type type) override;
+  absl::Status OnIndex(int32_t number, int64_t frames) override;
+  absl::Status OnPregap(int64_t frames) override;
+  absl::Status OnPostgap(int64_t frames) override;
+  absl::Status OnIsrc(std::string_view isrc) override;
+  absl::Status OnFlag(Cuesheet::Track::Flag flag) override;
+  absl::Status OnTag(Scope scope, Tag tag, std::string_view value) override;
+  absl::Status OnCommentTag(Scope scope, std::string_view name,
+                            std::string_view value) override;
+
+ private:
+  Cuesheet::Tags *MutableTags(Scope scope);
+
+  // Whether to store a position of frames in the compact form.
+  bool Compact(int64_t frames) const {
+    return compact_positions_ && frames <= std::numeric_limits<int32_t>::max();
+  }
+
+  Cuesheet *cuesheet_;
+  bool compact_positions_;
+  Cuesheet::File *file_ = nullptr;
+  Cuesheet::Track *track_ = nullptr;
+};
+
+// Parses a cuesheet incrementally, for input that arrives in chunks from a
+// pipe, socket or decompressor. See CuesheetTokenizer for how chunks are
+// handled.
+//
+//   CuesheetParser parser(&cuesheet);
+//   while (...) RETURN_IF_ERROR(parser.Feed(chunk));
+//   RETURN_IF_ERROR(parser.Finish());
+class CuesheetParser {
+ public:
+  // cuesheet is not owned, and must outlive the parser. It may live on an
+  // arena.
+  explicit CuesheetParser(Cuesheet *cuesheet,
+                          const ParseOptions &options = ParseOptions())
+    : builder_(cuesheet, options),
+      tokenizer_(&builder_, options)
+    {}
+
+  absl::Status Feed(std::string_view chunk) {
+    return tokenizer_.Feed(chunk);
+  }
+
+  // Parses whatever is left, including a last line without a newline.
+  absl::Status Finish(std::string_view chunk = {}) {
+    return tokenizer_.Finish(chunk);
+  }
+
+  // Whether the rest of the input will be ignored.
+  bool done() const { return tokenizer_.done(); }
+
+ private:
+  CuesheetBuilder builder_;
+  CuesheetTokenizer tokenizer_;
+};
 
 }  // namespace cue2pb
 
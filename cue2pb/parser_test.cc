@@ -9,6 +9,8 @@
 #include "util/file.h"
 #include "cue2pb/text_format.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "google/protobuf/arena.h"
 #include "util/testing/protobuf_assertions.h"
 #include "util/testing/assertions.h"
 #include "util/status_macros.h"
@@ -80,6 +82,60 @@ TEST_P(CuesheetEqualsProtoFilesTest, MatchFiles) {
   EXPECT_TRUE(IsEqual(expected, *found));
 }
 
+TEST_P(CuesheetEqualsProtoFilesTest, MatchMappedFiles) {
+  auto files = GetParam();
+
+  Cuesheet expected = CuesheetFromProtoFileOrDie(files.proto);
+
+  absl::StatusOr<util::MappedFile> mapped =
+      util::MappedFile::Open(TestdataToPath(files.cuesheet));
+  ASSERT_TRUE(IsOk(mapped));
+
+  absl::StatusOr<Cuesheet> found = ParseCuesheet(mapped->contents());
+  ASSERT_TRUE(IsOk(found));
+  EXPECT_TRUE(IsEqual(expected, *found));
+}
+
+TEST_P(CuesheetEqualsProtoFilesTest, MatchChunked) {
+  auto files = GetParam();
+
+  Cuesheet expected = CuesheetFromProtoFileOrDie(files.proto);
+
+  absl::StatusOr<util::MappedFile> mapped =
+      util::MappedFile::Open(TestdataToPath(files.cuesheet));
+  ASSERT_TRUE(IsOk(mapped));
+  std::string_view contents = mapped->contents();
+
+  for (size_t chunk_size : {1, 2, 7, 64}) {
+    Cuesheet found;
+    CuesheetParser parser(&found);
+    for (size_t i = 0; i < contents.size(); i += chunk_size) {
+      ASSERT_TRUE(IsOk(parser.Feed(contents.substr(i, chunk_size))));
+    }
+    ASSERT_TRUE(IsOk(parser.Finish()));
+    EXPECT_TRUE(IsEqual(expected, found)) << "chunk size " << chunk_size;
+  }
+}
+
+TEST(ParseArenaTest, ReusesArenaAcrossFiles) {
+  google::protobuf::Arena arena;
+  for (const char *name : {"eac_singlefile", "full_disc", "hidden_track"}) {
+    Cuesheet expected =
+        CuesheetFromProtoFileOrDie(absl::StrCat(name, ".textproto"));
+    absl::StatusOr<util::MappedFile> mapped =
+        util::MappedFile::Open(TestdataToPath(absl::StrCat(name, ".cue")));
+    ASSERT_TRUE(IsOk(mapped));
+
+    absl::StatusOr<Cuesheet*> found =
+        ParseCuesheet(mapped->contents(), &arena);
+    ASSERT_TRUE(IsOk(found));
+    EXPECT_EQ(&arena, (*found)->GetArena());
+    EXPECT_TRUE(IsEqual(expected, **found));
+
+    arena.Reset();
+  }
+}
+
 TEST_P(CuesheetEqualsProtoTest, MatchSample) {
   const auto &p = GetParam();
   const Cuesheet &expected = p.expected;
@@ -90,6 +146,15 @@ TEST_P(CuesheetEqualsProtoTest, MatchSample) {
   EXPECT_TRUE(IsEqual(expected, *found));
 }
 
+TEST_P(CuesheetEqualsProtoTest, MatchSampleInPlace) {
+  const auto &p = GetParam();
+
+  absl::StatusOr<Cuesheet> found =
+      ParseCuesheet(std::string_view(p.cuesheet));
+  ASSERT_TRUE(IsOk(found));
+  EXPECT_TRUE(IsEqual(p.expected, *found));
+}
+
 INSTANTIATE_TEST_SUITE_P(
     Examples,
     CuesheetEqualsProtoFilesTest,
@@ -164,6 +229,28 @@ INSTANTIATE_TEST_SUITE_P(
     )
 );
 
+INSTANTIATE_TEST_SUITE_P(
+    TrackTypes,
+    CuesheetEqualsProtoTest,
+    testing::Values(
+      CuesheetProtoSample(
+        R"""(file { path: "foo.bin" type: TYPE_BINARY
+                    track { type: TYPE_CDI_2336 number: 1 } })""",
+        R"""(
+            FILE "foo.bin" BINARY
+            TRACK 01 CDI/2336
+        )"""
+      ),
+      CuesheetProtoSample(
+        R"""(file { path: "foo.bin" type: TYPE_BINARY
+                    track { type: TYPE_CDI_2352 number: 1 } })""",
+        R"""(
+            FILE "foo.bin" BINARY
+            TRACK 01 CDI_2352
+        )"""
+      )
+    )
+);
 
 TEST(ParseInvalidTest, MissingFileType) {
   std::istringstream istrm(R"""(
@@ -192,5 +279,184 @@ TEST(ParseInvalidTest, MissingTrack) {
   ASSERT_FALSE(IsOk(ParseCuesheet(&istrm)));
 }
 
+TEST(ParseInvalidTest, TrackCommandsOutsideTrack) {
+  for (const char *cuesheet : {
+      "ISRC USRC17607839\n",
+      "FILE \"foo.wav\" WAVE\nPREGAP 00:02:00\n",
+      "FILE \"foo.wav\" WAVE\nFLAGS DCP\n",
+      "TRACK 01 AUDIO\n"}) {
+    EXPECT_FALSE(IsOk(ParseCuesheet(std::string_view(cuesheet)))) << cuesheet;
+  }
+}
+
+TEST(ParseInvalidTest, UnquotedFile) {
+  for (const char *cuesheet : {
+      "FILE foo.wav WAVE\n",
+      "FILE\n",
+      "FILE \"foo.wav WAVE\n"}) {
+    absl::StatusOr<Cuesheet> parsed =
+        ParseCuesheet(std::string_view(cuesheet));
+    EXPECT_EQ(absl::StatusCode::kInvalidArgument, parsed.status().code())
+        << cuesheet;
+  }
+}
+
+TEST(CuesheetParserTest, FinishParsesUnterminatedLine) {
+  Cuesheet found;
+  CuesheetParser parser(&found);
+  ASSERT_TRUE(IsOk(parser.Feed("CATALOG 1234\nTITLE \"Sing")));
+  EXPECT_EQ("1234", found.catalog());
+  EXPECT_EQ("", found.tags().title());
+
+  ASSERT_TRUE(IsOk(parser.Feed("les\"")));
+  ASSERT_TRUE(IsOk(parser.Finish()));
+  EXPECT_EQ("Singles", found.tags().title());
+
+  EXPECT_FALSE(IsOk(parser.Feed("PERFORMER foo\n")));
+  EXPECT_FALSE(IsOk(parser.Finish()));
+}
+
+TEST(CuesheetParserTest, ErrorsAreSticky) {
+  Cuesheet found;
+  CuesheetParser parser(&found);
+  ASSERT_TRUE(IsOk(parser.Feed("CATALOG 1234\nTITLE foo\nTRA")));
+  absl::Status st = parser.Feed("CK 01 AUDIO\nTITLE bar\n");
+  ASSERT_FALSE(st.ok());
+  EXPECT_EQ(absl::StatusCode::kInvalidArgument, st.code());
+  EXPECT_NE(std::string::npos, st.message().find("line 3")) << st;
+  EXPECT_EQ("foo", found.tags().title());
+
+  EXPECT_EQ(st, parser.Feed("TITLE baz\n"));
+  EXPECT_EQ(st, parser.Finish());
+  EXPECT_EQ("foo", found.tags().title());
+}
+
+TEST(ParseWhitespaceTest, TabsAndCrlf) {
+  Cuesheet expected = CuesheetFromProtoStringOrDie(R"""(
+    tags { comment_tag { name: "GENRE" value: "Ska" } }
+    file {
+      path: "a.wav"
+      type: TYPE_WAVE
+      track {
+        number: 1
+        type: TYPE_AUDIO
+        flag: FLAG_DCP
+        flag: FLAG_PRE
+        index { number: 1 position { minute: 1 second: 2 frame: 3 } }
+      }
+    }
+  )""");
+
+  absl::StatusOr<Cuesheet> found = ParseCuesheet(std::string_view(
+      "REM\tGENRE\tSka\r\n"
+      "FILE \"a.wav\"\tWAVE\r\n"
+      "\tTRACK\t01\tAUDIO\r\n"
+      "\t\tFLAGS\tDCP \tPRE\r\n"
+      "\t\tINDEX\t01\t01:02:03\r\n"));
+  ASSERT_TRUE(IsOk(found));
+  EXPECT_TRUE(IsEqual(expected, *found));
+}
+
+TEST(ParseOptionsTest, DiscFieldsMatchFullParse) {
+  Cuesheet expected = CuesheetFromProtoFileOrDie("full_disc.textproto");
+  expected.clear_file();
+
+  absl::StatusOr<util::MappedFile> mapped =
+      util::MappedFile::Open(TestdataToPath("full_disc.cue"));
+  ASSERT_TRUE(IsOk(mapped));
+
+  ParseOptions options;
+  options.fields = ParseOptions::kDisc;
+  absl::StatusOr<Cuesheet> found = ParseCuesheet(mapped->contents(), options);
+  ASSERT_TRUE(IsOk(found));
+  EXPECT_TRUE(IsEqual(expected, *found));
+
+  // Disc-level commands after a later FILE still belong to the disc.
+  std::string_view multi_file =
+      "REM GENRE Ska\n"
+      "FILE \"a.wav\" WAVE\n"
+      "  TRACK 01 AUDIO\n"
+      "    TITLE \"First\"\n"
+      "    INDEX 01 00:00:00\n"
+      "FILE \"b.wav\" WAVE\n"
+      "REM DISCID 1234ABCD\n"
+      "TITLE \"late\"\n"
+      "CATALOG 1234567890123\n"
+      "  TRACK 02 AUDIO\n"
+      "    INDEX 01 00:00:00\n";
+  absl::StatusOr<Cuesheet> full = ParseCuesheet(multi_file);
+  ASSERT_TRUE(IsOk(full));
+  EXPECT_EQ("late", full->tags().title());
+  full->clear_file();
+  found = ParseCuesheet(multi_file, options);
+  ASSERT_TRUE(IsOk(found));
+  EXPECT_TRUE(IsEqual(*full, *found));
+
+  // Track-level commands are skipped without parsing their arguments.
+  std::string_view bad_index =
+      "TITLE \"Singles\"\nFILE \"a.wav\" WAVE\nTRACK 01 AUDIO\n"
+      "INDEX 01 garbage\n";
+  found = ParseCuesheet(bad_index, options);
+  ASSERT_TRUE(IsOk(found));
+  EXPECT_EQ("Singles", found->tags().title());
+  EXPECT_EQ(0, found->file_size());
+  EXPECT_FALSE(IsOk(ParseCuesheet(bad_index)));
+}
+
+TEST(ParseOptionsTest, TrackFieldsImplyTracks) {
+  Cuesheet full = CuesheetFromProtoFileOrDie("full_disc.textproto");
+  Cuesheet expected;
+  for (const Cuesheet::File &full_file : full.file()) {
+    Cuesheet::File *file = expected.add_file();
+    file->set_path(full_file.path());
+    file->set_type(full_file.type());
+    for (const Cuesheet::Track &full_track : full_file.track()) {
+      Cuesheet::Track *track = file->add_track();
+      track->set_number(full_track.number());
+      track->set_type(full_track.type());
+      track->set_isrc(full_track.isrc());
+    }
+  }
+
+  absl::StatusOr<util::MappedFile> mapped =
+      util::MappedFile::Open(TestdataToPath("full_disc.cue"));
+  ASSERT_TRUE(IsOk(mapped));
+
+  ParseOptions options;
+  options.fields = ParseOptions::kIsrc;
+  absl::StatusOr<Cuesheet> found = ParseCuesheet(mapped->contents(), options);
+  ASSERT_TRUE(IsOk(found));
+  EXPECT_TRUE(IsEqual(expected, *found));
+}
+
+TEST(ParseOptionsTest, NoFields) {
+  ParseOptions options;
+  options.fields = 0;
+  absl::StatusOr<Cuesheet> found =
+      ParseCuesheet(std::string_view("not a cuesheet\n"), options);
+  ASSERT_TRUE(IsOk(found));
+  EXPECT_EQ(0, found->ByteSizeLong());
+}
+
+TEST(ParseOptionsTest, StreamingParserIsDone) {
+  ParseOptions options;
+  options.fields = ParseOptions::kCatalog;
+  Cuesheet found;
+  CuesheetParser parser(&found, options);
+  ASSERT_TRUE(IsOk(parser.Feed("FILE \"a.wav\" WAVE\nTRACK 01 AUDIO\n")));
+  EXPECT_FALSE(parser.done());
+  ASSERT_TRUE(IsOk(parser.Finish("FILE \"b.wav\" WAVE\nCATALOG 1234\n")));
+  EXPECT_EQ("1234", found.catalog());
+  EXPECT_EQ(0, found.file_size());
+
+  // With nothing asked for, nothing is looked at.
+  options.fields = 0;
+  Cuesheet empty;
+  CuesheetParser nothing(&empty, options);
+  EXPECT_TRUE(nothing.done());
+  ASSERT_TRUE(IsOk(nothing.Finish("not a cuesheet\n")));
+  EXPECT_EQ(0, empty.ByteSizeLong());
+}
+
 }  // namespace
 }  // namespace cue2pb
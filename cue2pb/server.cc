@@ -0,0 +1,274 @@
+#include "cue2pb/server.h"
+
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "cue2pb/convert.h"
+#include "cue2pb/service.pb.h"
+#include "google/protobuf/io/zero_copy_stream_impl.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
+#include "google/protobuf/util/delimited_message_util.h"
+#include "util/errno.h"
+#include "util/file.h"
+#include "util/status_builder.h"
+
+namespace cue2pb {
+namespace {
+
+using ::google::protobuf::io::FileInputStream;
+using ::google::protobuf::io::StringOutputStream;
+using ::google::protobuf::util::ParseDelimitedFromZeroCopyStream;
+using ::google::protobuf::util::SerializeDelimitedToZeroCopyStream;
+
+ConversionResponse Convert(const ConversionRequest &request) {
+  ProtoFormat format = request.format() == ConversionRequest::FORMAT_TEXT
+      ? ProtoFormat::kText : ProtoFormat::kBinary;
+
+  ConversionResponse response;
+  response.set_id(request.id());
+
+  absl::Status st;
+  switch (request.direction()) {
+    case ConversionRequest::DIRECTION_CUE_TO_PROTO:
+      st = CueToProto(request.input(), format, response.mutable_output());
+      break;
+    case ConversionRequest::DIRECTION_PROTO_TO_CUE:
+      st = ProtoToCue(request.input(), format, response.mutable_output());
+      break;
+    default:
+      st = util::InvalidArgumentErrorBuilder()
+          << "Unknown direction: " << request.direction();
+      break;
+  }
+
+  if (!st.ok()) {
+    response.clear_output();
+    response.set_code(static_cast<int>(st.code()));
+    response.set_error(std::string(st.message()));
+  }
+  return response;
+}
+
+// Requests a stream may have read but not yet answered. Enough to keep every
+// worker busy, while bounding what a client that stops reading can pin.
+constexpr int kMaxInFlight = 64;
+
+// Connections served at once. Further ones wait in the listen backlog.
+constexpr int kMaxConnections = 256;
+
+// The state of one stream, shared by its reader, the workers converting its
+// requests, and its writer. Only the writer blocks on out_fd, so a client
+// that stops reading holds up its own stream and not the pool.
+class Stream {
+ public:
+  explicit Stream(int out_fd)
+    : out_fd_(out_fd),
+      writer_([this] { WriteLoop(); })
+    {}
+
+  // Waits until fewer than kMaxInFlight requests are in flight, then adds one.
+  // Blocking here stops the reader, pushing back on the client.
+  void Begin() {
+    absl::MutexLock lock(&mu_);
+    mu_.Await(absl::Condition(this, &Stream::HasRoom));
+    in_flight_++;
+  }
+
+  // Queues a request's response for the writer.
+  void Finish(const ConversionResponse &response) {
+    std::string buf;
+    {
+      StringOutputStream out(&buf);
+      SerializeDelimitedToZeroCopyStream(response, &out);
+    }
+
+    absl::MutexLock lock(&mu_);
+    responses_.push_back(std::move(buf));
+  }
+
+  // Waits for every response to be written, then stops the writer.
+  absl::Status Wait() {
+    {
+      absl::MutexLock lock(&mu_);
+      reading_done_ = true;
+    }
+    writer_.join();
+    absl::MutexLock lock(&mu_);
+    return write_status_;
+  }
+
+ private:
+  bool HasRoom() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    return in_flight_ < kMaxInFlight;
+  }
+
+  bool ShouldWrite() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    return !responses_.empty() || (reading_done_ && in_flight_ == 0);
+  }
+
+  // Writes responses as they're queued. After a failed write, the rest are
+  // dropped, but still retired so that the reader and Wait() don't hang.
+  void WriteLoop() {
+    for (;;) {
+      std::string buf;
+      bool failed;
+      {
+        absl::MutexLock lock(&mu_);
+        mu_.Await(absl::Condition(this, &Stream::ShouldWrite));
+        if (responses_.empty()) return;
+        buf = std::move(responses_.front());
+        responses_.pop_front();
+        failed = !write_status_.ok();
+      }
+
+      absl::Status st = failed ? absl::OkStatus()
+                               : util::WriteFully(out_fd_, buf);
+
+      absl::MutexLock lock(&mu_);
+      if (write_status_.ok()) write_status_ = std::move(st);
+      in_flight_--;
+    }
+  }
+
+  const int out_fd_;
+  absl::Mutex mu_;
+  int in_flight_ ABSL_GUARDED_BY(mu_) = 0;
+  bool reading_done_ ABSL_GUARDED_BY(mu_) = false;
+  std::deque<std::string> responses_ ABSL_GUARDED_BY(mu_);
+  absl::Status write_status_ ABSL_GUARDED_BY(mu_);
+  // Last, so that it starts after everything it uses.
+  std::thread writer_;
+};
+
+// Counts the connections being served, so that accepting can wait for a slot.
+class ConnectionLimit {
+ public:
+  void Acquire() {
+    absl::MutexLock lock(&mu_);
+    mu_.Await(absl::Condition(this, &ConnectionLimit::HasRoom));
+    active_++;
+  }
+
+  void Release() {
+    absl::MutexLock lock(&mu_);
+    active_--;
+  }
+
+ private:
+  bool HasRoom() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    return active_ < kMaxConnections;
+  }
+
+  absl::Mutex mu_;
+  int active_ ABSL_GUARDED_BY(mu_) = 0;
+};
+
+// Binds fd to addr. If a socket file is already there but nothing is listening
+// on it, e.g. one left by a server that crashed, it's replaced.
+absl::Status Bind(int fd, const sockaddr_un &addr) {
+  const sockaddr *sa = reinterpret_cast<const sockaddr*>(&addr);
+  if (bind(fd, sa, sizeof(addr)) == 0) return absl::OkStatus();
+  if (errno != EADDRINUSE) return util::ErrnoAsStatus();
+
+  int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (probe == -1) return util::ErrnoAsStatus();
+  bool stale = connect(probe, sa, sizeof(addr)) == -1 &&
+      errno == ECONNREFUSED;
+  close(probe);
+  if (!stale) return util::ErrnoAsStatus(EADDRINUSE);
+
+  if (unlink(addr.sun_path) == -1 && errno != ENOENT) {
+    return util::ErrnoAsStatus();
+  }
+  if (bind(fd, sa, sizeof(addr)) == -1) return util::ErrnoAsStatus();
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+absl::Status ServeStream(int in_fd, int out_fd, util::ThreadPool *pool) {
+  Stream stream(out_fd);
+  FileInputStream in(in_fd);
+
+  absl::Status read_status;
+  for (;;) {
+    auto request = std::make_shared<ConversionRequest>();
+    bool clean_eof = false;
+    if (!ParseDelimitedFromZeroCopyStream(request.get(), &in, &clean_eof)) {
+      if (!clean_eof) {
+        read_status = in.GetErrno() != 0
+            ? util::StatusBuilder(util::ErrnoAsStatus(in.GetErrno()))
+                << "Failed to read request"
+            : util::InvalidArgumentErrorBuilder() << "Malformed request";
+      }
+      break;
+    }
+
+    stream.Begin();
+    pool->Schedule([&stream, request = std::move(request)] {
+      stream.Finish(Convert(*request));
+    });
+  }
+
+  absl::Status write_status = stream.Wait();
+  if (!read_status.ok()) return read_status;
+  return write_status;
+}
+
+absl::Status ServeUnixSocket(std::string_view path, util::ThreadPool *pool) {
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    return util::InvalidArgumentErrorBuilder()
+        << "Socket path too long: " << path;
+  }
+  std::memcpy(addr.sun_path, path.data(), path.size());
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd == -1) {
+    return util::StatusBuilder(util::ErrnoAsStatus())
+        << "Failed to create socket";
+  }
+  absl::Status st = Bind(fd, addr);
+  if (st.ok() && listen(fd, SOMAXCONN) == -1) st = util::ErrnoAsStatus();
+  if (!st.ok()) {
+    close(fd);
+    return util::StatusBuilder(st) << "Failed to listen on " << path;
+  }
+
+  // Shared with the connection threads, which may outlive a failed accept.
+  auto limit = std::make_shared<ConnectionLimit>();
+  for (;;) {
+    limit->Acquire();
+    int conn = accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (conn == -1) {
+      int err = errno;
+      limit->Release();
+      if (err == EINTR || err == ECONNABORTED) continue;
+      close(fd);
+      return util::StatusBuilder(util::ErrnoAsStatus(err))
+          << "Failed to accept on " << path;
+    }
+
+    std::thread([conn, pool, limit] {
+      if (absl::Status st = ServeStream(conn, conn, pool); !st.ok()) {
+        std::cerr << st << std::endl;
+      }
+      close(conn);
+      limit->Release();
+    }).detach();
+  }
+}
+
+}  // namespace cue2pb
@@ -0,0 +1,30 @@
+#ifndef CUE2PB_SERVER_H_
+#define CUE2PB_SERVER_H_
+
+#include <string_view>
+
+#include "absl/status/status.h"
+#include "util/thread_pool.h"
+
+// A long-lived conversion server, so that callers in other languages don't pay
+// for a process startup per cuesheet. See service.proto for the protocol.
+
+namespace cue2pb {
+
+// Reads ConversionRequests from in_fd until EOF, converting them on pool, and
+// writes ConversionResponses to out_fd. Returns once every response has been
+// written. The fds may be the same socket.
+//
+// At most 64 requests are converted or waiting to be written at once; past
+// that, reading stops until the client reads some responses. A client that
+// stops reading stalls only its own stream.
+absl::Status ServeStream(int in_fd, int out_fd, util::ThreadPool *pool);
+
+// Listens on a unix domain socket at path, serving each connection as a
+// stream on its own thread, up to 256 at once. A socket file left at path by
+// a server that's no longer listening is replaced. Only returns on error.
+absl::Status ServeUnixSocket(std::string_view path, util::ThreadPool *pool);
+
+}  // namespace cue2pb
+
+#endif  // CUE2PB_SERVER_H_
@@ -0,0 +1,184 @@
+#include "cue2pb/server.h"
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "cue2pb/cuesheet.pb.h"
+#include "cue2pb/service.pb.h"
+#include "cue2pb/text_format.h"
+#include "google/protobuf/io/zero_copy_stream_impl.h"
+#include "google/protobuf/util/delimited_message_util.h"
+#include "util/file.h"
+#include "util/testing/assertions.h"
+#include "util/testing/protobuf_assertions.h"
+#include "util/thread_pool.h"
+
+namespace cue2pb {
+
+using ::google::protobuf::io::FileInputStream;
+using ::google::protobuf::io::FileOutputStream;
+using ::google::protobuf::util::ParseDelimitedFromZeroCopyStream;
+using ::google::protobuf::util::SerializeDelimitedToZeroCopyStream;
+using ::util::IsEqual;
+using ::util::IsOk;
+
+namespace {
+
+std::string ReadTestdataOrDie(std::string_view filename) {
+  return std::string(
+      util::MappedFile::Open("cue2pb/testdata/" + std::string(filename))
+          ->contents());
+}
+
+// Sends every request over a socket to ServeStream, and returns the responses
+// keyed by id.
+std::map<uint64_t, ConversionResponse> RoundTrip(
+    const std::vector<ConversionRequest> &requests, util::ThreadPool *pool) {
+  int fds[2];
+  EXPECT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+
+  absl::Status serve_status;
+  std::thread server([&] {
+    serve_status = ServeStream(fds[1], fds[1], pool);
+  });
+
+  std::thread client([&] {
+    FileOutputStream out(fds[0]);
+    for (const ConversionRequest &request : requests) {
+      EXPECT_TRUE(SerializeDelimitedToZeroCopyStream(request, &out));
+    }
+    EXPECT_TRUE(out.Flush());
+    shutdown(fds[0], SHUT_WR);
+  });
+
+  std::map<uint64_t, ConversionResponse> responses;
+  FileInputStream in(fds[0]);
+  for (size_t i = 0; i < requests.size(); i++) {
+    ConversionResponse response;
+    bool clean_eof = false;
+    EXPECT_TRUE(ParseDelimitedFromZeroCopyStream(&response, &in, &clean_eof));
+    responses[response.id()] = response;
+  }
+
+  client.join();
+  server.join();
+  EXPECT_TRUE(IsOk(serve_status));
+  close(fds[0]);
+  close(fds[1]);
+  return responses;
+}
+
+std::map<uint64_t, ConversionResponse> RoundTrip(
+    const std::vector<ConversionRequest> &requests) {
+  util::ThreadPool pool(4);
+  return RoundTrip(requests, &pool);
+}
+
+TEST(ServeStreamTest, ConvertsBothDirections) {
+  std::string cuesheet = ReadTestdataOrDie("full_disc.cue");
+  std::string textproto = ReadTestdataOrDie("full_disc.textproto");
+  std::string unparsed = ReadTestdataOrDie("full_disc.unparsed_cue");
+  Cuesheet expected = CuesheetFromTextProto(textproto).value();
+
+  std::vector<ConversionRequest> requests;
+  for (uint64_t id = 0; id < 32; id += 2) {
+    ConversionRequest &to_proto = requests.emplace_back();
+    to_proto.set_id(id);
+    to_proto.set_direction(ConversionRequest::DIRECTION_CUE_TO_PROTO);
+    to_proto.set_input(cuesheet);
+
+    ConversionRequest &to_cue = requests.emplace_back();
+    to_cue.set_id(id + 1);
+    to_cue.set_direction(ConversionRequest::DIRECTION_PROTO_TO_CUE);
+    to_cue.set_format(ConversionRequest::FORMAT_TEXT);
+    to_cue.set_input(textproto);
+  }
+
+  std::map<uint64_t, ConversionResponse> responses = RoundTrip(requests);
+  ASSERT_EQ(requests.size(), responses.size());
+  for (uint64_t id = 0; id < 32; id += 2) {
+    const ConversionResponse &to_proto = responses[id];
+    EXPECT_EQ(0, to_proto.code()) << to_proto.error();
+    Cuesheet parsed;
+    EXPECT_TRUE(parsed.ParseFromString(to_proto.output()));
+    EXPECT_TRUE(IsEqual(expected, parsed));
+
+    const ConversionResponse &to_cue = responses[id + 1];
+    EXPECT_EQ(0, to_cue.code()) << to_cue.error();
+    EXPECT_EQ(unparsed, to_cue.output());
+  }
+}
+
+TEST(ServeStreamTest, ReportsErrorsPerRequest) {
+  std::vector<ConversionRequest> requests(3);
+  requests[0].set_id(7);
+  requests[0].set_direction(ConversionRequest::DIRECTION_CUE_TO_PROTO);
+  requests[0].set_input("BOGUS COMMAND\n");
+  requests[1].set_id(8);
+  requests[1].set_input("TITLE Foo\n");
+  requests[2].set_id(9);
+  requests[2].set_direction(ConversionRequest::DIRECTION_CUE_TO_PROTO);
+  requests[2].set_format(ConversionRequest::FORMAT_TEXT);
+  requests[2].set_input("TITLE Foo\n");
+
+  std::map<uint64_t, ConversionResponse> responses = RoundTrip(requests);
+  ASSERT_EQ(3u, responses.size());
+  EXPECT_EQ(static_cast<int>(absl::StatusCode::kInvalidArgument),
+            responses[7].code());
+  EXPECT_FALSE(responses[7].error().empty());
+  EXPECT_EQ(static_cast<int>(absl::StatusCode::kInvalidArgument),
+            responses[8].code());
+  EXPECT_EQ(0, responses[9].code());
+  EXPECT_EQ("tags {\n  title: \"Foo\"\n}\n", responses[9].output());
+}
+
+TEST(ServeStreamTest, StalledClientDoesNotBlockOthers) {
+  signal(SIGPIPE, SIG_IGN);
+
+  ConversionRequest request;
+  request.set_direction(ConversionRequest::DIRECTION_CUE_TO_PROTO);
+  request.set_format(ConversionRequest::FORMAT_TEXT);
+  request.set_input(ReadTestdataOrDie("full_disc.cue"));
+
+  // A client that sends far more than fits in the socket's buffers, and never
+  // reads a response.
+  int fds[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  util::ThreadPool pool(1);
+  absl::Status stalled_status;
+  std::thread stalled_server([&] {
+    stalled_status = ServeStream(fds[1], fds[1], &pool);
+  });
+  std::thread stalled_client([&] {
+    FileOutputStream out(fds[0]);
+    for (int i = 0; i < 1000; i++) {
+      if (!SerializeDelimitedToZeroCopyStream(request, &out)) break;
+    }
+    out.Flush();
+  });
+  // Long enough to fill them.
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+  // Another client, sharing the only worker, is still served.
+  std::map<uint64_t, ConversionResponse> responses =
+      RoundTrip({request}, &pool);
+  ASSERT_EQ(1u, responses.size());
+  EXPECT_EQ(0, responses[0].code()) << responses[0].error();
+
+  shutdown(fds[0], SHUT_RDWR);
+  stalled_client.join();
+  stalled_server.join();
+  EXPECT_FALSE(IsOk(stalled_status));
+  close(fds[0]);
+  close(fds[1]);
+}
+
+}  // namespace
+}  // namespace cue2pb
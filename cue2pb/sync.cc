@@ -0,0 +1,324 @@
+#include "cue2pb/sync.h"
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/match.h"
+#include "absl/synchronization/mutex.h"
+#include "cue2pb/batch.h"
+#include "cue2pb/manifest.pb.h"
+#include "util/errno.h"
+#include "util/file.h"
+#include "util/fingerprint.h"
+#include "util/status_builder.h"
+#include "util/status_macros.h"
+#include "util/thread_pool.h"
+
+namespace cue2pb {
+namespace {
+
+// Files whose size or mtime changed are converted in batches of this many,
+// so that one huge directory is still spread across threads.
+constexpr size_t kFilesPerTask = 64;
+
+struct FileState {
+  int64_t size;
+  int64_t mtime_nsec;
+  uint64_t fingerprint;
+  int64_t output_size;
+  int64_t output_mtime_nsec;
+};
+
+struct ChangedFile {
+  std::string path;
+  FileState state;
+};
+
+int64_t MtimeNsec(const struct stat &st) {
+  return int64_t{st.st_mtim.tv_sec} * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+// Whether the output at path, relative to dir_fd, is still the one recorded
+// in state.
+bool OutputUnchanged(int dir_fd, const std::string &path,
+                     const FileState &state) {
+  struct stat st;
+  return fstatat(dir_fd, path.c_str(), &st, AT_SYMLINK_NOFOLLOW) == 0 &&
+      st.st_size == state.output_size &&
+      MtimeNsec(st) == state.output_mtime_nsec;
+}
+
+// Walks the tree with a task per directory on a shared pool, so that idle
+// threads pick up whichever directories are waiting.
+class TreeSync {
+ public:
+  TreeSync(std::string_view root, const SyncOptions &options,
+           absl::flat_hash_map<std::string, FileState> previous,
+           std::ostream *errors)
+    : root_(root),
+      options_(options),
+      previous_(std::move(previous)),
+      errors_(errors),
+      pool_(options.jobs)
+    {}
+
+  // Syncs the whole tree, returning the new manifest's entries.
+  std::vector<Manifest::Entry> Run(SyncStats *stats) {
+    Schedule([this] { SyncDirectory(""); });
+
+    absl::MutexLock lock(&mu_);
+    mu_.Await(absl::Condition(this, &TreeSync::Idle));
+    *stats = stats_;
+    return std::move(entries_);
+  }
+
+ private:
+  bool Idle() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    return pending_ == 0;
+  }
+
+  void Schedule(std::function<void()> fn) {
+    {
+      absl::MutexLock lock(&mu_);
+      pending_++;
+    }
+    pool_.Schedule([this, fn = std::move(fn)] {
+      fn();
+      absl::MutexLock lock(&mu_);
+      pending_--;
+    });
+  }
+
+  std::string FullPath(std::string_view relative) const {
+    if (relative.empty()) return root_;
+    return root_ + "/" + std::string(relative);
+  }
+
+  void Fail(std::string_view relative, const absl::Status &status) {
+    absl::MutexLock lock(&mu_);
+    stats_.failed++;
+    *errors_ << FullPath(relative) << ": " << status << std::endl;
+  }
+
+  void SyncDirectory(const std::string &relative) {
+    std::string path = FullPath(relative);
+    DIR *dir = opendir(path.c_str());
+    if (dir == nullptr) {
+      Fail(relative, util::StatusBuilder(util::ErrnoAsStatus())
+                         << "Failed to open directory");
+      return;
+    }
+
+    std::vector<Manifest::Entry> unchanged;
+    std::vector<ChangedFile> changed;
+    std::string prefix = relative.empty() ? "" : relative + "/";
+    while (struct dirent *ent = readdir(dir)) {
+      std::string_view name = ent->d_name;
+      if (name == "." || name == "..") continue;
+
+      unsigned char type = ent->d_type;
+      if (type == DT_UNKNOWN) {
+        struct stat st;
+        if (fstatat(dirfd(dir), ent->d_name, &st, AT_SYMLINK_NOFOLLOW) == -1) {
+          continue;
+        }
+        if (S_ISDIR(st.st_mode)) type = DT_DIR;
+        if (S_ISREG(st.st_mode)) type = DT_REG;
+      }
+
+      if (type == DT_DIR) {
+        Schedule([this, child = prefix + std::string(name)] {
+          SyncDirectory(child);
+        });
+        continue;
+      }
+      if (type != DT_REG || !absl::EndsWithIgnoreCase(name, ".cue")) continue;
+
+      std::string child = prefix + std::string(name);
+      struct stat st;
+      if (fstatat(dirfd(dir), ent->d_name, &st, AT_SYMLINK_NOFOLLOW) == -1) {
+        Fail(child, util::StatusBuilder(util::ErrnoAsStatus())
+                        << "Failed to stat");
+        continue;
+      }
+      FileState state{st.st_size, MtimeNsec(st), 0, 0, 0};
+
+      auto it = previous_.find(child);
+      if (it != previous_.end() && it->second.size == state.size &&
+          it->second.mtime_nsec == state.mtime_nsec &&
+          OutputUnchanged(dirfd(dir),
+                          SiblingOutputPath(name, options_.output_suffix),
+                          it->second)) {
+        unchanged.push_back(MakeEntry(std::move(child), it->second));
+        continue;
+      }
+
+      changed.push_back({std::move(child), state});
+      if (changed.size() == kFilesPerTask) ScheduleChanged(&changed);
+    }
+    closedir(dir);
+
+    if (!changed.empty()) ScheduleChanged(&changed);
+    Record(&unchanged, /*converted=*/0);
+  }
+
+  void ScheduleChanged(std::vector<ChangedFile> *changed) {
+    Schedule([this, files = std::move(*changed)]() mutable {
+      std::vector<Manifest::Entry> entries;
+      size_t converted = 0;
+      for (ChangedFile &file : files) {
+        absl::StatusOr<bool> was_converted = SyncFile(file.path, &file.state);
+        if (!was_converted.ok()) {
+          Fail(file.path, was_converted.status());
+          continue;
+        }
+        converted += *was_converted;
+        entries.push_back(MakeEntry(std::move(file.path), file.state));
+      }
+      Record(&entries, converted);
+    });
+    changed->clear();
+  }
+
+  // Converts a file whose size or mtime changed, unless neither its contents
+  // nor its output did. Returns whether it was converted.
+  absl::StatusOr<bool> SyncFile(const std::string &relative,
+                                FileState *state) {
+    std::string path = FullPath(relative);
+    ASSIGN_OR_RETURN(util::MappedFile mapped, util::MappedFile::Open(path));
+    state->fingerprint = util::Fingerprint64(mapped.contents());
+
+    std::string output_path = SiblingOutputPath(path, options_.output_suffix);
+    auto it = previous_.find(relative);
+    if (it != previous_.end() && it->second.size == state->size &&
+        it->second.fingerprint == state->fingerprint &&
+        OutputUnchanged(AT_FDCWD, output_path, it->second)) {
+      state->output_size = it->second.output_size;
+      state->output_mtime_nsec = it->second.output_mtime_nsec;
+      return false;
+    }
+
+    std::string output;
+    RETURN_IF_ERROR(CueToProto(mapped.contents(), options_.format,
+                               options_.cache, &output));
+    RETURN_IF_ERROR(util::WriteFile(output_path, output));
+
+    struct stat st;
+    if (stat(output_path.c_str(), &st) == -1) {
+      return util::StatusBuilder(util::ErrnoAsStatus())
+          << "Failed to stat " << output_path;
+    }
+    state->output_size = st.st_size;
+    state->output_mtime_nsec = MtimeNsec(st);
+    return true;
+  }
+
+  static Manifest::Entry MakeEntry(std::string path, const FileState &state) {
+    Manifest::Entry entry;
+    entry.set_path(std::move(path));
+    entry.set_size(state.size);
+    entry.set_mtime_nsec(state.mtime_nsec);
+    entry.set_fingerprint(state.fingerprint);
+    entry.set_output_size(state.output_size);
+    entry.set_output_mtime_nsec(state.output_mtime_nsec);
+    return entry;
+  }
+
+  // Adds a task's synced files to the manifest.
+  void Record(std::vector<Manifest::Entry> *entries, size_t converted) {
+    absl::MutexLock lock(&mu_);
+    stats_.converted += converted;
+    stats_.unchanged += entries->size() - converted;
+    for (Manifest::Entry &entry : *entries) {
+      entries_.push_back(std::move(entry));
+    }
+  }
+
+  const std::string root_;
+  const SyncOptions &options_;
+  const absl::flat_hash_map<std::string, FileState> previous_;
+  std::ostream *errors_;
+
+  absl::Mutex mu_;
+  int pending_ ABSL_GUARDED_BY(mu_) = 0;
+  SyncStats stats_ ABSL_GUARDED_BY(mu_);
+  std::vector<Manifest::Entry> entries_ ABSL_GUARDED_BY(mu_);
+
+  // Last, so that its threads are joined before anything they use is
+  // destroyed.
+  util::ThreadPool pool_;
+};
+
+// Loads the previous run's manifest, if there was one and it was written with
+// the same options.
+absl::StatusOr<absl::flat_hash_map<std::string, FileState>> LoadManifest(
+    const std::string &path, const SyncOptions &options) {
+  absl::flat_hash_map<std::string, FileState> previous;
+
+  absl::StatusOr<util::MappedFile> mapped = util::MappedFile::Open(path);
+  if (!mapped.ok()) {
+    if (absl::IsNotFound(mapped.status())) return previous;
+    return mapped.status();
+  }
+
+  Manifest manifest;
+  if (!manifest.ParseFromArray(mapped->contents().data(),
+                               static_cast<int>(mapped->contents().size()))) {
+    return util::DataLossErrorBuilder() << "Failed to parse manifest " << path;
+  }
+  if (manifest.output_suffix() != options.output_suffix ||
+      manifest.textformat() != (options.format == ProtoFormat::kText)) {
+    return previous;
+  }
+
+  previous.reserve(manifest.entry_size());
+  for (Manifest::Entry &entry : *manifest.mutable_entry()) {
+    previous.emplace(std::move(*entry.mutable_path()),
+                     FileState{entry.size(), entry.mtime_nsec(),
+                               entry.fingerprint(), entry.output_size(),
+                               entry.output_mtime_nsec()});
+  }
+  return previous;
+}
+
+}  // namespace
+
+absl::Status SyncTree(std::string_view root, const SyncOptions &options,
+                      SyncStats *stats, std::ostream *errors) {
+  std::string manifest_path = options.manifest_path;
+  if (manifest_path.empty()) {
+    manifest_path = std::string(root) + "/" + std::string(kManifestName);
+  }
+  ASSIGN_OR_RETURN(auto previous, LoadManifest(manifest_path, options));
+
+  Manifest manifest;
+  manifest.set_output_suffix(options.output_suffix);
+  manifest.set_textformat(options.format == ProtoFormat::kText);
+  {
+    TreeSync sync(root, options, std::move(previous), errors);
+    for (Manifest::Entry &entry : sync.Run(stats)) {
+      *manifest.add_entry() = std::move(entry);
+    }
+  }
+  std::sort(manifest.mutable_entry()->begin(), manifest.mutable_entry()->end(),
+            [](const Manifest::Entry &a, const Manifest::Entry &b) {
+              return a.path() < b.path();
+            });
+  RETURN_IF_ERROR(util::WriteFile(manifest_path, manifest.SerializeAsString()));
+
+  if (stats->failed != 0) {
+    return util::UnknownErrorBuilder()
+        << stats->failed << " files failed to convert";
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace cue2pb
@@ -0,0 +1,57 @@
+#ifndef CUE2PB_SYNC_H_
+#define CUE2PB_SYNC_H_
+
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <stddef.h>
+
+#include "absl/status/status.h"
+#include "cue2pb/convert.h"
+
+// Keeping a proto next to every cuesheet in a directory tree, as done by
+// `cue2pb --recursive`.
+
+namespace cue2pb {
+
+// The default manifest, in the root of the tree.
+inline constexpr std::string_view kManifestName = ".cue2pb_manifest";
+
+struct SyncOptions {
+  ProtoFormat format = ProtoFormat::kBinary;
+
+  // Threads to walk the tree and convert with. <= 0 means one per CPU.
+  int jobs = 0;
+
+  // Each cuesheet's proto is written next to it, with its extension replaced
+  // by this suffix.
+  std::string output_suffix = ".cuepb";
+
+  // Where the manifest is kept. Empty means kManifestName in the root.
+  std::string manifest_path;
+
+  // If set, cuesheets are looked up in and added to this cache.
+  const ParseCache *cache = nullptr;
+};
+
+struct SyncStats {
+  size_t converted = 0;
+  size_t unchanged = 0;
+  size_t failed = 0;
+};
+
+// Converts every *.cue file under root that has changed since the manifest was
+// last written, and rewrites the manifest. A cuesheet is unchanged if its size
+// and mtime match the manifest, or failing that, its contents do; and its
+// proto is still the one written for it, by size and mtime. Symlinks aren't
+// followed.
+//
+// Like ConvertFiles, failures are reported to errors without stopping the
+// others, and cause an error to be returned. Failed files are left out of the
+// manifest so that they are retried.
+absl::Status SyncTree(std::string_view root, const SyncOptions &options,
+                      SyncStats *stats, std::ostream *errors);
+
+}  // namespace cue2pb
+
+#endif  // CUE2PB_SYNC_H_
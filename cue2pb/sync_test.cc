@@ -0,0 +1,151 @@
+#include "cue2pb/sync.h"
+
+#include <filesystem>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+#include "cue2pb/cuesheet.pb.h"
+#include "cue2pb/text_format.h"
+#include "util/file.h"
+#include "util/testing/assertions.h"
+#include "util/testing/protobuf_assertions.h"
+
+namespace cue2pb {
+
+using ::util::IsEqual;
+using ::util::IsOk;
+
+namespace {
+
+std::string ReadTestdata(std::string_view filename) {
+  return std::string(
+      util::MappedFile::Open("cue2pb/testdata/" + std::string(filename))
+          ->contents());
+}
+
+class SyncTreeTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    char dir_template[] = "/tmp/sync_test.XXXXXX";
+    root_ = mkdtemp(dir_template);
+    std::error_code ec;
+    std::filesystem::create_directories(root_ + "/a/b", ec);
+    ASSERT_FALSE(ec);
+    std::filesystem::create_directories(root_ + "/c", ec);
+    ASSERT_FALSE(ec);
+
+    Write("a/hidden_track.cue", ReadTestdata("hidden_track.cue"));
+    Write("a/b/full_disc.CUE", ReadTestdata("full_disc.cue"));
+    Write("c/broken.cue", "NOT A COMMAND\n");
+    Write("notes.txt", "Not a cuesheet\n");
+  }
+
+  void TearDown() override {
+    std::error_code ec;
+    std::filesystem::remove_all(root_, ec);
+  }
+
+  void Write(std::string_view relative, std::string_view contents) {
+    ASSERT_TRUE(IsOk(util::WriteFile(Path(relative), contents)));
+  }
+
+  std::string Path(std::string_view relative) {
+    return root_ + "/" + std::string(relative);
+  }
+
+  SyncStats Sync(bool expect_ok) {
+    SyncStats stats;
+    std::ostringstream errors;
+    SyncOptions options;
+    options.jobs = 3;
+    EXPECT_EQ(expect_ok, IsOk(SyncTree(root_, options, &stats, &errors)))
+        << errors.str();
+    return stats;
+  }
+
+  void ExpectConverted(std::string_view relative, std::string_view name) {
+    auto mapped = util::MappedFile::Open(Path(relative));
+    ASSERT_TRUE(IsOk(mapped)) << relative;
+    Cuesheet found;
+    ASSERT_TRUE(found.ParseFromArray(mapped->contents().data(),
+                                     mapped->contents().size()));
+    Cuesheet expected =
+        CuesheetFromTextProto(ReadTestdata(std::string(name) + ".textproto"))
+            .value();
+    EXPECT_TRUE(IsEqual(expected, found)) << relative;
+  }
+
+  std::string root_;
+};
+
+TEST_F(SyncTreeTest, SkipsUnchangedFiles) {
+  SyncStats stats = Sync(/*expect_ok=*/false);
+  EXPECT_EQ(2, stats.converted);
+  EXPECT_EQ(0, stats.unchanged);
+  EXPECT_EQ(1, stats.failed);
+  ExpectConverted("a/hidden_track.cuepb", "hidden_track");
+  ExpectConverted("a/b/full_disc.cuepb", "full_disc");
+
+  // The failed file is retried, and the others skipped.
+  Write("c/broken.cue", ReadTestdata("eac_singlefile.cue"));
+  stats = Sync(/*expect_ok=*/true);
+  EXPECT_EQ(1, stats.converted);
+  EXPECT_EQ(2, stats.unchanged);
+  ExpectConverted("c/broken.cuepb", "eac_singlefile");
+
+  stats = Sync(/*expect_ok=*/true);
+  EXPECT_EQ(0, stats.converted);
+  EXPECT_EQ(3, stats.unchanged);
+}
+
+TEST_F(SyncTreeTest, ComparesContentsWhenTouched) {
+  Write("c/broken.cue", ReadTestdata("eac_singlefile.cue"));
+  Sync(/*expect_ok=*/true);
+
+  // A new mtime with the same contents isn't converted again.
+  struct timespec times[2] = {{0, UTIME_OMIT}, {12345, 0}};
+  ASSERT_EQ(0, utimensat(AT_FDCWD, Path("a/hidden_track.cue").c_str(), times,
+                         0));
+  SyncStats stats = Sync(/*expect_ok=*/true);
+  EXPECT_EQ(0, stats.converted);
+  EXPECT_EQ(3, stats.unchanged);
+
+  // New contents are.
+  Write("a/hidden_track.cue", ReadTestdata("eac_multifile_gaps.cue"));
+  stats = Sync(/*expect_ok=*/true);
+  EXPECT_EQ(1, stats.converted);
+  EXPECT_EQ(2, stats.unchanged);
+  ExpectConverted("a/hidden_track.cuepb", "eac_multifile_gaps");
+}
+
+TEST_F(SyncTreeTest, RegeneratesMissingOrChangedOutputs) {
+  Write("c/broken.cue", ReadTestdata("eac_singlefile.cue"));
+  Sync(/*expect_ok=*/true);
+
+  ASSERT_EQ(0, unlink(Path("a/hidden_track.cuepb").c_str()));
+  Write("a/b/full_disc.cuepb", "Damaged");
+  SyncStats stats = Sync(/*expect_ok=*/true);
+  EXPECT_EQ(2, stats.converted);
+  EXPECT_EQ(1, stats.unchanged);
+  ExpectConverted("a/hidden_track.cuepb", "hidden_track");
+  ExpectConverted("a/b/full_disc.cuepb", "full_disc");
+
+  // Likewise when the cuesheet was touched too.
+  struct timespec times[2] = {{0, UTIME_OMIT}, {12345, 0}};
+  ASSERT_EQ(0, utimensat(AT_FDCWD, Path("a/hidden_track.cue").c_str(), times,
+                         0));
+  ASSERT_EQ(0, unlink(Path("a/hidden_track.cuepb").c_str()));
+  stats = Sync(/*expect_ok=*/true);
+  EXPECT_EQ(1, stats.converted);
+  EXPECT_EQ(2, stats.unchanged);
+  ExpectConverted("a/hidden_track.cuepb", "hidden_track");
+}
+
+}  // namespace
+}  // namespace cue2pb
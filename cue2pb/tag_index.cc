@@ -0,0 +1,523 @@
+#include "cue2pb/tag_index.h"
+
+#include <algorithm>
+#include <iterator>
+#include <numeric>
+#include <utility>
+
+#include "absl/strings/ascii.h"
+#include "absl/strings/str_cat.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "util/status_builder.h"
+#include "util/status_macros.h"
+
+namespace cue2pb {
+namespace {
+
+using ::google::protobuf::io::CodedInputStream;
+using ::google::protobuf::io::CodedOutputStream;
+
+constexpr std::string_view kHeaderMagic = "CUETAG01";
+constexpr std::string_view kTrailerMagic = "CUETAGIX";
+constexpr size_t kEntrySize = 32;
+constexpr size_t kTrailerSize = 32;
+
+// Records per block of postings, and the size of each block's skip.
+constexpr uint64_t kBlockSize = 128;
+constexpr size_t kSkipSize = 12;
+
+uint64_t NumBlocks(uint64_t records) {
+  return (records + kBlockSize - 1) / kBlockSize;
+}
+
+void AppendFixed32(uint32_t value, std::string *output) {
+  uint8_t buf[sizeof(value)];
+  CodedOutputStream::WriteLittleEndian32ToArray(value, buf);
+  output->append(reinterpret_cast<char*>(buf), sizeof(buf));
+}
+
+void AppendFixed64(uint64_t value, std::string *output) {
+  uint8_t buf[sizeof(value)];
+  CodedOutputStream::WriteLittleEndian64ToArray(value, buf);
+  output->append(reinterpret_cast<char*>(buf), sizeof(buf));
+}
+
+uint32_t ReadFixed32(const char *data) {
+  uint32_t value;
+  CodedInputStream::ReadLittleEndian32FromArray(
+      reinterpret_cast<const uint8_t*>(data), &value);
+  return value;
+}
+
+uint64_t ReadFixed64(const char *data) {
+  uint64_t value;
+  CodedInputStream::ReadLittleEndian64FromArray(
+      reinterpret_cast<const uint8_t*>(data), &value);
+  return value;
+}
+
+std::string TermKey(std::string_view field, std::string_view value) {
+  return absl::StrCat(field, std::string_view("\0", 1), value);
+}
+
+// Reads postings one record at a time.
+class PostingsReader {
+ public:
+  PostingsReader(std::string_view postings, uint64_t records)
+    : blocks_(NumBlocks(records)),
+      skips_(postings.data()),
+      deltas_(postings.substr(blocks_ * kSkipSize))
+    {}
+
+  // Reads the next record, returning false at the end of the postings, or if
+  // they're corrupt.
+  bool Next(uint64_t *record) {
+    if (p_ == end_) {
+      return block_ < blocks_ && StartBlock(block_, record);
+    }
+    // Decoded by hand, since most differences are a byte, and that's worth a
+    // fast path here.
+    uint64_t delta = *p_ & 0x7f;
+    for (int shift = 7; *p_++ & 0x80; shift += 7) {
+      if (p_ == end_ || shift > 63) {
+        corrupt_ = true;
+        return false;
+      }
+      delta |= static_cast<uint64_t>(*p_ & 0x7f) << shift;
+    }
+    record_ += delta;
+    *record = record_;
+    return true;
+  }
+
+  // Reads the first record that's at least target, which must be greater
+  // than the last record read. Blocks that end before target are skipped
+  // without reading them.
+  bool SkipTo(uint64_t target, uint64_t *record) {
+    // Usually target is in the current block.
+    if (block_ == blocks_ || first(block_) > target) {
+      while (Next(record)) {
+        if (*record >= target) return true;
+      }
+      return false;
+    }
+
+    // Otherwise finds the first block starting after target.
+    size_t lo = block_;
+    size_t hi = blocks_;
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      if (first(mid) <= target) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    // Then starts at the block before it, unless that's the current one.
+    if (lo > block_) {
+      if (!StartBlock(lo - 1, record)) return false;
+      if (*record >= target) return true;
+    }
+    while (Next(record)) {
+      if (*record >= target) return true;
+    }
+    return false;
+  }
+
+  absl::Status status() const {
+    if (corrupt_) {
+      return util::DataLossErrorBuilder() << "Corrupt tag index postings";
+    }
+    return absl::OkStatus();
+  }
+
+ private:
+  uint64_t first(size_t block) const {
+    return ReadFixed64(skips_ + block * kSkipSize);
+  }
+  uint32_t offset(size_t block) const {
+    return ReadFixed32(skips_ + block * kSkipSize + 8);
+  }
+
+  bool StartBlock(size_t block, uint64_t *record) {
+    size_t begin = offset(block);
+    size_t end = block + 1 < blocks_ ? offset(block + 1) : deltas_.size();
+    if (begin > end || end > deltas_.size()) {
+      corrupt_ = true;
+      return false;
+    }
+    p_ = reinterpret_cast<const uint8_t*>(deltas_.data()) + begin;
+    end_ = reinterpret_cast<const uint8_t*>(deltas_.data()) + end;
+    block_ = block + 1;
+    record_ = first(block);
+    *record = record_;
+    return true;
+  }
+
+  size_t blocks_ = 0;
+  const char *skips_ = nullptr;
+  std::string_view deltas_;
+
+  // The block after the one being read, and what's left of its deltas.
+  size_t block_ = 0;
+  const uint8_t *p_ = nullptr;
+  const uint8_t *end_ = nullptr;
+  uint64_t record_ = 0;
+  bool corrupt_ = false;
+};
+
+absl::Status Decode(PostingsReader reader, uint64_t records,
+                    std::vector<uint64_t> *out) {
+  out->clear();
+  out->reserve(records);
+  uint64_t record;
+  while (reader.Next(&record)) out->push_back(record);
+  return reader.status();
+}
+
+// Keeps the records that are also in reader's postings.
+absl::Status Intersect(PostingsReader reader,
+                       std::vector<uint64_t> *records) {
+  uint64_t posting;
+  bool more = reader.Next(&posting);
+  size_t kept = 0;
+  for (uint64_t record : *records) {
+    if (more && posting < record) more = reader.SkipTo(record, &posting);
+    if (!more) break;
+    if (posting == record) (*records)[kept++] = record;
+  }
+  records->resize(kept);
+  return reader.status();
+}
+
+// Adds the records of b to a, using scratch.
+void Union(const std::vector<uint64_t> &b, std::vector<uint64_t> *a,
+           std::vector<uint64_t> *scratch) {
+  if (a->empty()) {
+    *a = b;
+    return;
+  }
+  scratch->clear();
+  std::set_union(a->begin(), a->end(), b.begin(), b.end(),
+                 std::back_inserter(*scratch));
+  a->swap(*scratch);
+}
+
+}  // namespace
+
+absl::StatusOr<TagQuery> ParseTagQuery(std::string_view query) {
+  TagQuery parsed;
+  parsed.clauses.emplace_back();
+  bool want_term = true;
+  size_t i = 0;
+  auto word_end = [&](size_t from) {
+    while (from < query.size() && !absl::ascii_isspace(query[from])) from++;
+    return from;
+  };
+
+  while (true) {
+    while (i < query.size() && absl::ascii_isspace(query[i])) i++;
+    if (i == query.size()) break;
+
+    if (!want_term) {
+      size_t end = word_end(i);
+      std::string_view word = query.substr(i, end - i);
+      if (word == "OR") {
+        parsed.clauses.emplace_back();
+      } else if (word != "AND") {
+        return util::InvalidArgumentErrorBuilder()
+            << "Expected AND or OR in tag query, not " << word;
+      }
+      i = end;
+      want_term = true;
+      continue;
+    }
+
+    size_t colon = query.find(':', i);
+    if (colon == std::string_view::npos || colon == i ||
+        word_end(i) < colon) {
+      return util::InvalidArgumentErrorBuilder()
+          << "Expected FIELD:value in tag query at "
+          << query.substr(i, word_end(i) - i);
+    }
+    TagTerm term;
+    term.field = std::string(query.substr(i, colon - i));
+    i = colon + 1;
+    if (i < query.size() && query[i] == '"') {
+      size_t close = query.find('"', i + 1);
+      if (close == std::string_view::npos) {
+        return util::InvalidArgumentErrorBuilder()
+            << "Unterminated quote in tag query for " << term.field;
+      }
+      term.value = std::string(query.substr(i + 1, close - i - 1));
+      i = close + 1;
+    } else {
+      size_t end = word_end(i);
+      term.value = std::string(query.substr(i, end - i));
+      i = end;
+    }
+    if (term.value.empty()) {
+      return util::InvalidArgumentErrorBuilder()
+          << "Empty value in tag query for " << term.field;
+    }
+    parsed.clauses.back().push_back(std::move(term));
+    want_term = false;
+  }
+
+  if (want_term) {
+    return util::InvalidArgumentErrorBuilder()
+        << "Tag query ends where a term was expected";
+  }
+  return parsed;
+}
+
+void TagIndexBuilder::AddTerm(std::string_view field, std::string_view value,
+                              uint64_t record) {
+  if (value.empty()) return;
+  Postings &postings = terms_[TermKey(field, value)];
+  // A term found more than once in a cuesheet is one posting.
+  if (postings.records > 0 && postings.last == record) return;
+
+  if (postings.records % kBlockSize == 0) {
+    AppendFixed64(record, &postings.skips);
+    AppendFixed32(postings.deltas.size(), &postings.skips);
+  } else {
+    uint8_t buf[10];  // The longest a varint64 can be.
+    uint8_t *end = CodedOutputStream::WriteVarint64ToArray(
+        record - postings.last, buf);
+    postings.deltas.append(reinterpret_cast<char*>(buf), end - buf);
+  }
+  postings.records++;
+  postings.last = record;
+}
+
+absl::Status TagIndexBuilder::Add(uint64_t record, const Cuesheet &cuesheet) {
+  if (!empty_ && record <= last_record_) {
+    return util::InvalidArgumentErrorBuilder()
+        << "Tag index record " << record << " added after " << last_record_;
+  }
+  empty_ = false;
+  last_record_ = record;
+
+  auto add_tags = [&](const Cuesheet::Tags &tags) {
+    AddTerm("TITLE", tags.title(), record);
+    AddTerm("PERFORMER", tags.performer(), record);
+    AddTerm("SONGWRITER", tags.songwriter(), record);
+    for (const Cuesheet::CommentTag &tag : tags.comment_tag()) {
+      AddTerm(tag.name(), tag.value(), record);
+    }
+  };
+
+  AddTerm("CATALOG", cuesheet.catalog(), record);
+  add_tags(cuesheet.tags());
+  for (const Cuesheet::File &file : cuesheet.file()) {
+    for (const Cuesheet::Track &track : file.track()) {
+      AddTerm("ISRC", track.isrc(), record);
+      add_tags(track.tags());
+    }
+  }
+  return absl::OkStatus();
+}
+
+absl::Status TagIndexBuilder::Write(std::string_view path) const {
+  std::vector<std::pair<std::string_view, const Postings*>> terms;
+  terms.reserve(terms_.size());
+  for (const auto &[key, postings] : terms_) terms.emplace_back(key, &postings);
+  std::sort(terms.begin(), terms.end(),
+            [](const auto &a, const auto &b) { return a.first < b.first; });
+
+  std::string out(kHeaderMagic);
+  std::vector<uint64_t> postings_offsets;
+  postings_offsets.reserve(terms.size());
+  for (const auto &[key, postings] : terms) {
+    if (postings->skips.size() + postings->deltas.size() > UINT32_MAX ||
+        postings->records > UINT32_MAX || key.size() > UINT32_MAX) {
+      return util::InvalidArgumentErrorBuilder()
+          << "Tag index term " << key << " is too large";
+    }
+    postings_offsets.push_back(out.size());
+    out.append(postings->skips);
+    out.append(postings->deltas);
+  }
+
+  uint64_t terms_offset = out.size();
+  uint64_t key_offset = 0;
+  for (size_t i = 0; i < terms.size(); i++) {
+    const auto &[key, postings] = terms[i];
+    AppendFixed64(postings_offsets[i], &out);
+    AppendFixed32(postings->skips.size() + postings->deltas.size(), &out);
+    AppendFixed32(postings->records, &out);
+    AppendFixed64(key_offset, &out);
+    AppendFixed32(key.size(), &out);
+    AppendFixed32(0, &out);
+    key_offset += key.size();
+  }
+  uint64_t keys_offset = out.size();
+  for (const auto &[key, postings] : terms) out.append(key);
+
+  AppendFixed64(terms_offset, &out);
+  AppendFixed64(terms.size(), &out);
+  AppendFixed64(keys_offset, &out);
+  out.append(kTrailerMagic);
+  return util::WriteFile(path, out);
+}
+
+absl::Status IndexArchive(const ArchiveReader &archive,
+                          TagIndexBuilder *builder) {
+  // The archive's index is sorted by key, but records must be added in
+  // order.
+  std::vector<size_t> order(archive.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return archive.offset(a) < archive.offset(b);
+  });
+
+  Cuesheet cuesheet;
+  for (size_t i : order) {
+    std::string_view record = archive.record(i);
+    if (!cuesheet.ParseFromArray(record.data(), record.size())) {
+      return util::DataLossErrorBuilder()
+          << "Failed to parse archive record for " << archive.key(i);
+    }
+    RETURN_IF_ERROR(builder->Add(archive.offset(i), cuesheet));
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<TagIndexReader> TagIndexReader::Open(std::string_view path) {
+  ASSIGN_OR_RETURN(util::MappedFile file, util::MappedFile::Open(path));
+  absl::StatusOr<TagIndexReader> reader = Open(std::move(file));
+  if (!reader.ok()) {
+    return util::StatusBuilder(reader.status()) << ": " << path;
+  }
+  return reader;
+}
+
+absl::StatusOr<TagIndexReader> TagIndexReader::Open(util::MappedFile file) {
+  std::string_view contents = file.contents();
+  if (contents.size() < kHeaderMagic.size() + kTrailerSize ||
+      contents.substr(0, kHeaderMagic.size()) != kHeaderMagic ||
+      contents.substr(contents.size() - kTrailerMagic.size()) !=
+          kTrailerMagic) {
+    return util::InvalidArgumentErrorBuilder() << "Not a tag index";
+  }
+
+  const char *trailer = contents.data() + contents.size() - kTrailerSize;
+  uint64_t terms_offset = ReadFixed64(trailer);
+  uint64_t num_terms = ReadFixed64(trailer + 8);
+  uint64_t keys_offset = ReadFixed64(trailer + 16);
+  uint64_t keys_end = contents.size() - kTrailerSize;
+
+  // Every term is checked up front, so that lookups don't have to be.
+  bool valid = terms_offset >= kHeaderMagic.size() &&
+      terms_offset <= keys_end &&
+      num_terms <= (keys_end - terms_offset) / kEntrySize &&
+      keys_offset == terms_offset + num_terms * kEntrySize;
+  for (uint64_t i = 0; valid && i < num_terms; i++) {
+    const char *entry = contents.data() + terms_offset + i * kEntrySize;
+    uint64_t offset = ReadFixed64(entry);
+    uint64_t size = ReadFixed32(entry + 8);
+    uint64_t records = ReadFixed32(entry + 12);
+    uint64_t key_offset = ReadFixed64(entry + 16);
+    uint64_t key_size = ReadFixed32(entry + 24);
+    valid = offset <= terms_offset && size <= terms_offset - offset &&
+        records > 0 && NumBlocks(records) * kSkipSize <= size &&
+        key_offset <= keys_end - keys_offset &&
+        key_size <= keys_end - keys_offset - key_offset;
+  }
+  if (!valid) {
+    return util::DataLossErrorBuilder() << "Corrupt tag index terms";
+  }
+
+  return TagIndexReader(std::move(file), terms_offset, num_terms,
+                        keys_offset);
+}
+
+TagIndexReader::TagIndexReader(util::MappedFile file, size_t terms_offset,
+                               size_t num_terms, size_t keys_offset)
+  : file_(std::move(file)),
+    terms_offset_(terms_offset),
+    num_terms_(num_terms),
+    keys_offset_(keys_offset)
+  {}
+
+const char *TagIndexReader::entry(size_t i) const {
+  return file_.contents().data() + terms_offset_ + i * kEntrySize;
+}
+
+std::string_view TagIndexReader::key(size_t i) const {
+  const char *e = entry(i);
+  return file_.contents().substr(keys_offset_ + ReadFixed64(e + 16),
+                                 ReadFixed32(e + 24));
+}
+
+std::string_view TagIndexReader::postings(size_t i) const {
+  const char *e = entry(i);
+  return file_.contents().substr(ReadFixed64(e), ReadFixed32(e + 8));
+}
+
+uint32_t TagIndexReader::records(size_t i) const {
+  return ReadFixed32(entry(i) + 12);
+}
+
+size_t TagIndexReader::FindTerm(std::string_view field,
+                                std::string_view value) const {
+  std::string key = TermKey(field, value);
+  size_t lo = 0;
+  size_t hi = num_terms_;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (this->key(mid) < key) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo == num_terms_ || this->key(lo) != key) return num_terms_;
+  return lo;
+}
+
+absl::StatusOr<std::vector<uint64_t>> TagIndexReader::Find(
+    std::string_view field, std::string_view value) const {
+  std::vector<uint64_t> records;
+  size_t term = FindTerm(field, value);
+  if (term == num_terms_) return records;
+  RETURN_IF_ERROR(Decode(PostingsReader(postings(term), this->records(term)),
+                         this->records(term), &records));
+  return records;
+}
+
+absl::StatusOr<std::vector<uint64_t>> TagIndexReader::Search(
+    const TagQuery &query) const {
+  std::vector<uint64_t> matches;
+  std::vector<uint64_t> clause_matches;
+  std::vector<uint64_t> scratch;
+  for (const std::vector<TagTerm> &clause : query.clauses) {
+    std::vector<size_t> terms;
+    for (const TagTerm &term : clause) {
+      terms.push_back(FindTerm(term.field, term.value));
+    }
+    if (terms.empty() ||
+        std::find(terms.begin(), terms.end(), num_terms_) != terms.end()) {
+      continue;
+    }
+
+    // Starting from the rarest term keeps every intersection small, and
+    // lets the rest skip most of their postings.
+    std::sort(terms.begin(), terms.end(), [this](size_t a, size_t b) {
+      return records(a) < records(b);
+    });
+    RETURN_IF_ERROR(Decode(PostingsReader(postings(terms[0]),
+                                          records(terms[0])),
+                           records(terms[0]), &clause_matches));
+    for (size_t i = 1; i < terms.size() && !clause_matches.empty(); i++) {
+      RETURN_IF_ERROR(Intersect(
+          PostingsReader(postings(terms[i]), records(terms[i])),
+          &clause_matches));
+    }
+    Union(clause_matches, &matches, &scratch);
+  }
+  return matches;
+}
+
+}  // namespace cue2pb
@@ -0,0 +1,137 @@
+#ifndef CUE2PB_TAG_INDEX_H_
+#define CUE2PB_TAG_INDEX_H_
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "cue2pb/archive.h"
+#include "cue2pb/cuesheet.pb.h"
+#include "util/file.h"
+
+// A tag index (.cuetags) maps the tags of many cuesheets to the records that
+// have them, so that finding every disc with a tag reads only that tag's
+// records. Each record is a number chosen by whoever builds the index; for an
+// archive, it's the record's offset in the archive.
+//
+// A term is a field and a value. The fields are CATALOG, TITLE, PERFORMER,
+// SONGWRITER and ISRC, and the name of each comment tag (e.g. GENRE for
+// REM GENRE). Tags of the disc and of its tracks are indexed alike, and
+// values are matched exactly.
+//
+// The layout, with every integer little-endian, is:
+//
+//   "CUETAG01"
+//   postings: for each term, the records having it in increasing order, in
+//       blocks of 128 records:
+//       skips: for each block
+//           uint64 its first record
+//           uint32 offset of its deltas within the deltas
+//       deltas: for each record but the first of its block, its difference
+//           from the record before it, as a varint
+//   terms: one per term, sorted by key, each
+//       uint64 offset of the postings
+//       uint32 size of the postings
+//       uint32 number of records
+//       uint64 offset of the key within the keys
+//       uint32 size of the key
+//       uint32 reserved
+//   keys: for every term, its field, a NUL and its value, concatenated
+//   trailer:
+//       uint64 offset of the terms
+//       uint64 number of terms
+//       uint64 offset of the keys
+//       "CUETAGIX"
+
+namespace cue2pb {
+
+struct TagTerm {
+  std::string field;
+  std::string value;
+};
+
+// A record matches a query if it has every term of any one of its clauses.
+struct TagQuery {
+  std::vector<std::vector<TagTerm>> clauses;
+};
+
+// Parses a query of FIELD:value terms joined by AND and OR, where AND binds
+// more tightly, e.g.
+//
+//   GENRE:Jazz AND PERFORMER:"Miles Davis" OR ISRC:USSM15900113
+//
+// A value with spaces is double quoted.
+absl::StatusOr<TagQuery> ParseTagQuery(std::string_view query);
+
+class TagIndexBuilder {
+ public:
+  // Adds the terms of a cuesheet. Each record must be greater than the one
+  // added before it.
+  absl::Status Add(uint64_t record, const Cuesheet &cuesheet);
+
+  // Writes the index to path, replacing whatever was there.
+  absl::Status Write(std::string_view path) const;
+
+ private:
+  struct Postings {
+    std::string skips;
+    std::string deltas;
+    uint64_t records = 0;
+    uint64_t last = 0;
+  };
+
+  void AddTerm(std::string_view field, std::string_view value,
+               uint64_t record);
+
+  absl::flat_hash_map<std::string, Postings> terms_;
+  bool empty_ = true;
+  uint64_t last_record_ = 0;
+};
+
+// Adds every cuesheet of an archive, by its offset in the archive.
+absl::Status IndexArchive(const ArchiveReader &archive,
+                          TagIndexBuilder *builder);
+
+class TagIndexReader {
+ public:
+  static absl::StatusOr<TagIndexReader> Open(std::string_view path);
+  static absl::StatusOr<TagIndexReader> Open(util::MappedFile file);
+
+  // The number of terms.
+  size_t size() const { return num_terms_; }
+
+  // The records having a term, in increasing order.
+  absl::StatusOr<std::vector<uint64_t>> Find(std::string_view field,
+                                             std::string_view value) const;
+
+  // The records matching a query, in increasing order.
+  absl::StatusOr<std::vector<uint64_t>> Search(const TagQuery &query) const;
+
+ private:
+  TagIndexReader(util::MappedFile file, size_t terms_offset, size_t num_terms,
+                 size_t keys_offset);
+
+  // The fixed-size entry for the i'th term, and its fields.
+  const char *entry(size_t i) const;
+  std::string_view key(size_t i) const;
+  std::string_view postings(size_t i) const;
+  uint32_t records(size_t i) const;
+
+  // The index of a term, or size() if no record has it.
+  size_t FindTerm(std::string_view field, std::string_view value) const;
+
+  // Like ArchiveReader, offsets rather than pointers.
+  util::MappedFile file_;
+  size_t terms_offset_;
+  size_t num_terms_;
+  size_t keys_offset_;
+};
+
+}  // namespace cue2pb
+
+#endif  // CUE2PB_TAG_INDEX_H_
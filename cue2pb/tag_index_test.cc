@@ -0,0 +1,276 @@
+#include "cue2pb/tag_index.h"
+
+#include <algorithm>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "cue2pb/archive.h"
+#include "cue2pb/parser.h"
+#include "util/file.h"
+#include "util/testing/assertions.h"
+
+namespace cue2pb {
+
+using ::util::IsOk;
+
+namespace {
+
+constexpr const char *kTestdata[] = {
+  "complete_small", "eac_multifile_gapless", "eac_multifile_gaps",
+  "eac_singlefile", "full_disc", "hidden_track",
+};
+
+std::vector<uint64_t> Records(absl::StatusOr<std::vector<uint64_t>> records) {
+  EXPECT_TRUE(IsOk(records));
+  return records.ok() ? *std::move(records) : std::vector<uint64_t>();
+}
+
+class TagIndexTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    char path_template[] = "/tmp/tag_index_test.XXXXXX";
+    int fd = mkstemp(path_template);
+    ASSERT_NE(-1, fd);
+    close(fd);
+    path_ = path_template;
+
+    for (const char *name : kTestdata) {
+      auto mapped = util::MappedFile::Open(
+          absl::StrCat("cue2pb/testdata/", name, ".cue"));
+      ASSERT_TRUE(IsOk(mapped));
+      absl::StatusOr<Cuesheet> cuesheet = ParseCuesheet(mapped->contents());
+      ASSERT_TRUE(IsOk(cuesheet));
+      cuesheets_.push_back(*std::move(cuesheet));
+    }
+  }
+
+  void TearDown() override { unlink(path_.c_str()); }
+
+  // Indexes the testdata, the i'th as record 10 * i + 3.
+  absl::StatusOr<TagIndexReader> IndexTestdata() {
+    TagIndexBuilder builder;
+    for (size_t i = 0; i < cuesheets_.size(); i++) {
+      if (absl::Status st = builder.Add(10 * i + 3, cuesheets_[i]); !st.ok()) {
+        return st;
+      }
+    }
+    if (absl::Status st = builder.Write(path_); !st.ok()) return st;
+    return TagIndexReader::Open(path_);
+  }
+
+  // The testdata records having a disc or track comment tag.
+  std::vector<uint64_t> WithCommentTag(std::string_view name,
+                                       std::string_view value) {
+    auto has = [&](const Cuesheet::Tags &tags) {
+      for (const Cuesheet::CommentTag &tag : tags.comment_tag()) {
+        if (tag.name() == name && tag.value() == value) return true;
+      }
+      return false;
+    };
+    std::vector<uint64_t> records;
+    for (size_t i = 0; i < cuesheets_.size(); i++) {
+      bool found = has(cuesheets_[i].tags());
+      for (const Cuesheet::File &file : cuesheets_[i].file()) {
+        for (const Cuesheet::Track &track : file.track()) {
+          found = found || has(track.tags());
+        }
+      }
+      if (found) records.push_back(10 * i + 3);
+    }
+    return records;
+  }
+
+  std::string path_;
+  std::vector<Cuesheet> cuesheets_;
+};
+
+TEST_F(TagIndexTest, Find) {
+  auto reader = IndexTestdata();
+  ASSERT_TRUE(IsOk(reader));
+
+  std::vector<uint64_t> ska = WithCommentTag("GENRE", "Ska");
+  ASSERT_FALSE(ska.empty());
+  EXPECT_EQ(ska, Records(reader->Find("GENRE", "Ska")));
+  std::vector<uint64_t> comment = WithCommentTag("COMMENT", "Track comment");
+  ASSERT_FALSE(comment.empty());
+  EXPECT_EQ(comment, Records(reader->Find("COMMENT", "Track comment")));
+
+  // Tags of tracks are found like those of discs, once per disc.
+  std::vector<uint64_t> specials = Records(
+      reader->Find("PERFORMER", "The Specials"));
+  EXPECT_LT(1, specials.size());
+  EXPECT_TRUE(std::is_sorted(specials.begin(), specials.end()));
+  EXPECT_EQ(2, Records(reader->Find("ISRC", "XYZ56789")).size());
+
+  EXPECT_TRUE(Records(reader->Find("GENRE", "Jazz")).empty());
+  EXPECT_TRUE(Records(reader->Find("GENR", "ESka")).empty());
+  EXPECT_TRUE(Records(reader->Find("PERFORMER", "")).empty());
+}
+
+TEST_F(TagIndexTest, Search) {
+  auto reader = IndexTestdata();
+  ASSERT_TRUE(IsOk(reader));
+
+  auto search = [&](std::string_view query) {
+    absl::StatusOr<TagQuery> parsed = ParseTagQuery(query);
+    EXPECT_TRUE(IsOk(parsed)) << query;
+    return parsed.ok() ? Records(reader->Search(*parsed))
+                       : std::vector<uint64_t>();
+  };
+
+  std::vector<uint64_t> ska = WithCommentTag("GENRE", "Ska");
+  std::vector<uint64_t> alternative = WithCommentTag("GENRE", "Alternative");
+  ASSERT_FALSE(alternative.empty());
+  EXPECT_EQ(ska, search("GENRE:Ska"));
+  EXPECT_EQ(ska, search("GENRE:Ska AND PERFORMER:\"The Specials\""));
+  EXPECT_TRUE(search("GENRE:Ska AND GENRE:Alternative").empty());
+  EXPECT_TRUE(search("GENRE:Ska AND GENRE:Jazz").empty());
+
+  std::vector<uint64_t> either = ska;
+  either.insert(either.end(), alternative.begin(), alternative.end());
+  std::sort(either.begin(), either.end());
+  EXPECT_EQ(either, search("GENRE:Ska OR GENRE:Alternative"));
+  EXPECT_EQ(either, search("GENRE:Alternative OR GENRE:Ska OR GENRE:Ska"));
+
+  std::vector<uint64_t> date = WithCommentTag("DATE", "1991");
+  std::vector<uint64_t> ska_in_1991;
+  std::set_intersection(ska.begin(), ska.end(), date.begin(), date.end(),
+                        std::back_inserter(ska_in_1991));
+  ASSERT_FALSE(ska_in_1991.empty());
+  EXPECT_EQ(ska_in_1991, search("GENRE:Jazz OR GENRE:Ska AND DATE:1991"));
+}
+
+TEST_F(TagIndexTest, ManyBlocks) {
+  // Enough records for many blocks of postings, some of them far apart, with
+  // terms on every record, every seventh, and every eleventh.
+  TagIndexBuilder builder;
+  std::vector<uint64_t> records;
+  for (uint64_t i = 0; i < 5000; i++) {
+    uint64_t record = 3 * i + (i >= 2500 ? uint64_t{1} << 40 : 0);
+    Cuesheet cuesheet;
+    Cuesheet::Tags *tags = cuesheet.mutable_tags();
+    tags->set_title("All");
+    if (i % 7 == 0) tags->set_performer("Seventh");
+    if (i % 11 == 0) tags->set_songwriter("Eleventh");
+    ASSERT_TRUE(IsOk(builder.Add(record, cuesheet)));
+    records.push_back(record);
+  }
+  ASSERT_TRUE(IsOk(builder.Write(path_)));
+  auto reader = TagIndexReader::Open(path_);
+  ASSERT_TRUE(IsOk(reader));
+
+  EXPECT_EQ(records, Records(reader->Find("TITLE", "All")));
+  std::vector<uint64_t> seventh, eleventh, both, either;
+  for (size_t i = 0; i < records.size(); i++) {
+    if (i % 7 == 0) seventh.push_back(records[i]);
+    if (i % 11 == 0) eleventh.push_back(records[i]);
+    if (i % 7 == 0 && i % 11 == 0) both.push_back(records[i]);
+    if (i % 7 == 0 || i % 11 == 0) either.push_back(records[i]);
+  }
+  EXPECT_EQ(seventh, Records(reader->Find("PERFORMER", "Seventh")));
+
+  auto search = [&](std::string_view query) {
+    absl::StatusOr<TagQuery> parsed = ParseTagQuery(query);
+    EXPECT_TRUE(IsOk(parsed)) << query;
+    return parsed.ok() ? Records(reader->Search(*parsed))
+                       : std::vector<uint64_t>();
+  };
+  EXPECT_EQ(both, search("PERFORMER:Seventh AND SONGWRITER:Eleventh"));
+  EXPECT_EQ(both, search(
+      "TITLE:All AND SONGWRITER:Eleventh AND PERFORMER:Seventh"));
+  EXPECT_EQ(either, search("PERFORMER:Seventh OR SONGWRITER:Eleventh"));
+  EXPECT_EQ(seventh, search("TITLE:All AND PERFORMER:Seventh"));
+}
+
+TEST_F(TagIndexTest, ParseTagQuery) {
+  auto parsed = ParseTagQuery(
+      "  GENRE:Jazz AND PERFORMER:\"Miles Davis\"\tOR ISRC:USSM15900113 ");
+  ASSERT_TRUE(IsOk(parsed));
+  ASSERT_EQ(2, parsed->clauses.size());
+  ASSERT_EQ(2, parsed->clauses[0].size());
+  EXPECT_EQ("GENRE", parsed->clauses[0][0].field);
+  EXPECT_EQ("Jazz", parsed->clauses[0][0].value);
+  EXPECT_EQ("PERFORMER", parsed->clauses[0][1].field);
+  EXPECT_EQ("Miles Davis", parsed->clauses[0][1].value);
+  ASSERT_EQ(1, parsed->clauses[1].size());
+  EXPECT_EQ("ISRC", parsed->clauses[1][0].field);
+  EXPECT_EQ("USSM15900113", parsed->clauses[1][0].value);
+
+  for (const char *invalid : {
+      "", "GENRE", ":Jazz", "GENRE:", "GENRE:\"Jazz", "GENRE:Jazz AND",
+      "GENRE:Jazz DATE:1959", "GENRE:Jazz NOT DATE:1959", "OR GENRE:Jazz",
+  }) {
+    EXPECT_EQ(absl::StatusCode::kInvalidArgument,
+              ParseTagQuery(invalid).status().code()) << invalid;
+  }
+}
+
+TEST_F(TagIndexTest, RecordsMustIncrease) {
+  TagIndexBuilder builder;
+  ASSERT_TRUE(IsOk(builder.Add(0, cuesheets_[0])));
+  EXPECT_FALSE(IsOk(builder.Add(0, cuesheets_[1])));
+  ASSERT_TRUE(IsOk(builder.Add(1, cuesheets_[1])));
+}
+
+TEST_F(TagIndexTest, IndexArchive) {
+  std::string archive_path = path_ + ".cuepbs";
+  {
+    auto writer = ArchiveWriter::Create(archive_path);
+    ASSERT_TRUE(IsOk(writer));
+    for (size_t i = 0; i < cuesheets_.size(); i++) {
+      ASSERT_TRUE(IsOk(writer->Add(kTestdata[i], cuesheets_[i])));
+    }
+    ASSERT_TRUE(IsOk(writer->Finish()));
+  }
+  auto archive = ArchiveReader::Open(archive_path);
+  unlink(archive_path.c_str());
+  ASSERT_TRUE(IsOk(archive));
+
+  TagIndexBuilder builder;
+  ASSERT_TRUE(IsOk(IndexArchive(*archive, &builder)));
+  ASSERT_TRUE(IsOk(builder.Write(path_)));
+  auto reader = TagIndexReader::Open(path_);
+  ASSERT_TRUE(IsOk(reader));
+
+  // Each record is the offset of a cuesheet with the tag.
+  std::vector<uint64_t> records = Records(reader->Find("GENRE", "Ska"));
+  ASSERT_EQ(WithCommentTag("GENRE", "Ska").size(), records.size());
+  for (size_t i = 0; i < archive->size(); i++) {
+    bool found = std::find(records.begin(), records.end(),
+                           archive->offset(i)) != records.end();
+    Cuesheet cuesheet;
+    ASSERT_TRUE(IsOk(archive->Read(archive->key(i), &cuesheet)));
+    bool ska = false;
+    for (const Cuesheet::CommentTag &tag : cuesheet.tags().comment_tag()) {
+      ska = ska || (tag.name() == "GENRE" && tag.value() == "Ska");
+    }
+    EXPECT_EQ(ska, found) << archive->key(i);
+  }
+}
+
+TEST_F(TagIndexTest, Corrupt) {
+  ASSERT_TRUE(IsOk(IndexTestdata()));
+  auto mapped = util::MappedFile::Open(path_);
+  ASSERT_TRUE(IsOk(mapped));
+  std::string contents(mapped->contents());
+
+  ASSERT_TRUE(IsOk(util::WriteFile(path_, contents.substr(1))));
+  EXPECT_EQ(absl::StatusCode::kInvalidArgument,
+            TagIndexReader::Open(path_).status().code());
+
+  // The terms claim more of the file than there is.
+  std::string truncated = contents.substr(0, 8) + contents.substr(40);
+  ASSERT_TRUE(IsOk(util::WriteFile(path_, truncated)));
+  EXPECT_EQ(absl::StatusCode::kDataLoss,
+            TagIndexReader::Open(path_).status().code());
+}
+
+}  // namespace
+}  // namespace cue2pb
@@ -1,6 +1,10 @@
 #include "cue2pb/text_format.h"
 
+#include <iterator>
+#include <string>
 #include <utility>
+#include <stddef.h>
+#include <stdint.h>
 
 #include "google/protobuf/io/zero_copy_stream_impl.h"
 #include "google/protobuf/text_format.h"
@@ -9,7 +13,8 @@
 
 namespace cue2pb {
 
-using ::google::protobuf::io::IstreamInputStream;
+using ::google::protobuf::io::ArrayInputStream;
+using ::google::protobuf::io::ZeroCopyInputStream;
 using ::google::protobuf::TextFormat;
 
 class StatusCollector : public ::google::protobuf::io::ErrorCollector {
@@ -51,18 +56,586 @@ class StatusCollector : public ::google::protobuf::io::ErrorCollector {
   absl::Status status_;
 };
 
-absl::StatusOr<Cuesheet> CuesheetFromTextProto(std::istream *input) {
-  IstreamInputStream istrm(input);
+namespace {
+
+// The enum value names, indexed by value.
+constexpr std::string_view kFileTypeNames[] = {
+  "TYPE_UNKNOWN", "TYPE_WAVE", "TYPE_MP3", "TYPE_AIFF", "TYPE_BINARY",
+  "TYPE_MOTOROLA",
+};
+constexpr std::string_view kTrackTypeNames[] = {
+  "TYPE_UNKNOWN", "TYPE_AUDIO", "TYPE_CDG", "TYPE_MODE1_2048",
+  "TYPE_MODE1_2352", "TYPE_MODE2_2336", "TYPE_MODE2_2352", "TYPE_CDI_2336",
+  "TYPE_CDI_2352",
+};
+constexpr std::string_view kTrackFlagNames[] = {
+  "FLAG_UNKNOWN", "FLAG_DCP", "FLAG_4CH", "FLAG_PRE",
+};
+
+static_assert(std::size(kFileTypeNames) == Cuesheet::File::Type_ARRAYSIZE);
+static_assert(std::size(kTrackTypeNames) == Cuesheet::Track::Type_ARRAYSIZE);
+static_assert(std::size(kTrackFlagNames) == Cuesheet::Track::Flag_ARRAYSIZE);
+
+bool IsIdentifierChar(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+      (c >= '0' && c <= '9') || c == '_';
+}
+
+bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+bool IsOctalDigit(char c) { return c >= '0' && c <= '7'; }
+
+int HexDigitValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+// Only unknown fields need reflection, which is as cheap as an accessor.
+bool HasUnknownFields(const google::protobuf::Message &message) {
+  return !message.GetReflection()->GetUnknownFields(message).empty();
+}
+
+// A recursive descent parser for the subset of the text format that is
+// actually written: named fields, {} messages, quoted strings with the common
+// escapes, decimal integers, enum names and # comments. Anything else makes
+// it give up, so that TextFormat::Parser can either handle it or report the
+// error.
+class TextParser {
+ public:
+  explicit TextParser(std::string_view input)
+    : p_(input.data()), end_(input.data() + input.size())
+    {}
+
+  bool Parse(Cuesheet *cuesheet) { return ParseMessage(cuesheet, false); }
+
+ private:
+  void SkipWhitespace() {
+    while (p_ != end_) {
+      char c = *p_;
+      if (c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' ||
+          c == '\f') {
+        p_++;
+      } else if (c == '#') {
+        while (p_ != end_ && *p_ != '\n') p_++;
+      } else {
+        break;
+      }
+    }
+  }
+
+  bool Consume(char c) {
+    if (p_ == end_ || *p_ != c) return false;
+    p_++;
+    return true;
+  }
+
+  bool ConsumeIdentifier(std::string_view *name) {
+    const char *start = p_;
+    if (p_ == end_ || IsDigit(*p_)) return false;
+    while (p_ != end_ && IsIdentifierChar(*p_)) p_++;
+    *name = std::string_view(start, p_ - start);
+    return !name->empty();
+  }
+
+  // Parses fields up to the end of the input, or a closing brace if nested,
+  // handing each one's name to ParseField.
+  template <typename Message>
+  bool ParseMessage(Message *message, bool nested) {
+    uint32_t seen = 0;
+    for (;;) {
+      SkipWhitespace();
+      if (p_ == end_) return !nested;
+      if (nested && Consume('}')) return true;
+
+      std::string_view name;
+      if (!ConsumeIdentifier(&name)) return false;
+      SkipWhitespace();
+      bool colon = Consume(':');
+      SkipWhitespace();
+      bool brace = Consume('{');
+      if (!colon && !brace) return false;
+      if (!ParseField(name, brace, &seen, message)) return false;
+
+      SkipWhitespace();
+      if (!Consume(';')) Consume(',');
+    }
+  }
+
+  // Singular fields may only be given once; TextFormat reports an error.
+  static bool Once(uint32_t *seen, int number) {
+    uint32_t bit = uint32_t{1} << number;
+    if (*seen & bit) return false;
+    *seen |= bit;
+    return true;
+  }
+
+  template <typename Message>
+  bool ParseSubmessage(bool brace, Message *message) {
+    return brace && ParseMessage(message, true);
+  }
+
+  bool ParseString(bool brace, std::string *value) {
+    if (brace) return false;
+    value->clear();
+    bool any = false;
+    // Adjacent strings are concatenated.
+    for (;;) {
+      SkipWhitespace();
+      if (p_ == end_ || (*p_ != '"' && *p_ != '\'')) return any;
+      char quote = *p_++;
+      for (;;) {
+        const char *start = p_;
+        while (p_ != end_ && *p_ != quote && *p_ != '\\' && *p_ != '\n' &&
+               *p_ != '\0') {
+          p_++;
+        }
+        value->append(start, p_ - start);
+        if (p_ == end_ || *p_ == '\n' || *p_ == '\0') return false;
+        if (*p_++ == quote) break;
+        if (!ParseEscape(value)) return false;
+      }
+      any = true;
+    }
+  }
+
+  // Parses the escape after a backslash, as io::Tokenizer does.
+  bool ParseEscape(std::string *value) {
+    if (p_ == end_) return false;
+    char c = *p_++;
+    switch (c) {
+      case 'a': value->push_back('\a'); return true;
+      case 'b': value->push_back('\b'); return true;
+      case 'f': value->push_back('\f'); return true;
+      case 'n': value->push_back('\n'); return true;
+      case 'r': value->push_back('\r'); return true;
+      case 't': value->push_back('\t'); return true;
+      case 'v': value->push_back('\v'); return true;
+      case '\\': case '?': case '\'': case '"':
+        value->push_back(c);
+        return true;
+      case 'x': {
+        if (p_ == end_ || HexDigitValue(*p_) < 0) return false;
+        int code = HexDigitValue(*p_++);
+        if (p_ != end_ && HexDigitValue(*p_) >= 0) {
+          code = code * 16 + HexDigitValue(*p_++);
+        }
+        value->push_back(static_cast<char>(code));
+        return true;
+      }
+    }
+    if (!IsOctalDigit(c)) return false;
+    int code = c - '0';
+    for (int i = 0; i < 2 && p_ != end_ && IsOctalDigit(*p_); i++) {
+      code = code * 8 + (*p_++ - '0');
+    }
+    value->push_back(static_cast<char>(code));
+    return true;
+  }
+
+  bool ParseInt32(bool brace, int32_t *value) {
+    if (brace) return false;
+    bool negative = Consume('-');
+    if (p_ == end_ || !IsDigit(*p_)) return false;
+    // Leave octal, hex and floats to TextFormat.
+    if (*p_ == '0' && p_ + 1 != end_ && IsIdentifierChar(p_[1])) return false;
+
+    uint64_t magnitude = 0;
+    const char *start = p_;
+    while (p_ != end_ && IsDigit(*p_) && p_ - start < 11) {
+      magnitude = magnitude * 10 + (*p_++ - '0');
+    }
+    if (p_ != end_ && (IsIdentifierChar(*p_) || *p_ == '.')) return false;
+    if (magnitude > uint64_t{INT32_MAX} + negative) return false;
+    *value = static_cast<int32_t>(negative ? -static_cast<int64_t>(magnitude)
+                                           : magnitude);
+    return true;
+  }
+
+  template <typename T, size_t N>
+  bool ParseEnum(bool brace, const std::string_view (&names)[N], T *value) {
+    std::string_view name;
+    if (brace || !ConsumeIdentifier(&name)) return false;
+    for (size_t i = 0; i < N; i++) {
+      if (names[i] == name) {
+        *value = static_cast<T>(i);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool ParseField(std::string_view name, bool brace, uint32_t *seen,
+                  Cuesheet *cuesheet) {
+    if (name == "tags") {
+      return Once(seen, 1) && ParseSubmessage(brace, cuesheet->mutable_tags());
+    } else if (name == "catalog") {
+      return Once(seen, 2) && ParseString(brace, cuesheet->mutable_catalog());
+    } else if (name == "cd_text_file") {
+      return Once(seen, 3) &&
+          ParseString(brace, cuesheet->mutable_cd_text_file());
+    } else if (name == "file") {
+      return ParseSubmessage(brace, cuesheet->add_file());
+    }
+    return false;
+  }
+
+  bool ParseField(std::string_view name, bool brace, uint32_t *seen,
+                  Cuesheet::Tags *tags) {
+    if (name == "title") {
+      return Once(seen, 1) && ParseString(brace, tags->mutable_title());
+    } else if (name == "performer") {
+      return Once(seen, 2) && ParseString(brace, tags->mutable_performer());
+    } else if (name == "songwriter") {
+      return Once(seen, 3) && ParseString(brace, tags->mutable_songwriter());
+    } else if (name == "comment_tag") {
+      return ParseSubmessage(brace, tags->add_comment_tag());
+    }
+    return false;
+  }
+
+  bool ParseField(std::string_view name, bool brace, uint32_t *seen,
+                  Cuesheet::CommentTag *tag) {
+    if (name == "name") {
+      return Once(seen, 1) && ParseString(brace, tag->mutable_name());
+    } else if (name == "value") {
+      return Once(seen, 2) && ParseString(brace, tag->mutable_value());
+    }
+    return false;
+  }
+
+  bool ParseField(std::string_view name, bool brace, uint32_t *seen,
+                  Cuesheet::File *file) {
+    if (name == "type") {
+      Cuesheet::File::Type type;
+      if (!Once(seen, 1) || !ParseEnum(brace, kFileTypeNames, &type)) {
+        return false;
+      }
+      file->set_type(type);
+      return true;
+    } else if (name == "path") {
+      return Once(seen, 2) && ParseString(brace, file->mutable_path());
+    } else if (name == "track") {
+      return ParseSubmessage(brace, file->add_track());
+    }
+    return false;
+  }
+
+  bool ParseField(std::string_view name, bool brace, uint32_t *seen,
+                  Cuesheet::Track *track) {
+    if (name == "type") {
+      Cuesheet::Track::Type type;
+      if (!Once(seen, 1) || !ParseEnum(brace, kTrackTypeNames, &type)) {
+        return false;
+      }
+      track->set_type(type);
+      return true;
+    } else if (name == "number") {
+      int32_t number;
+      if (!Once(seen, 2) || !ParseInt32(brace, &number)) return false;
+      track->set_number(number);
+      return true;
+    } else if (name == "tags") {
+      return Once(seen, 3) && ParseSubmessage(brace, track->mutable_tags());
+    } else if (name == "flag") {
+      Cuesheet::Track::Flag flag;
+      if (!ParseEnum(brace, kTrackFlagNames, &flag)) return false;
+      track->add_flag(flag);
+      return true;
+    } else if (name == "isrc") {
+      return Once(seen, 5) && ParseString(brace, track->mutable_isrc());
+    } else if (name == "postgap") {
+      return Once(seen, 6) && ParseSubmessage(brace, track->mutable_postgap());
+    } else if (name == "pregap") {
+      return Once(seen, 7) && ParseSubmessage(brace, track->mutable_pregap());
+    } else if (name == "index") {
+      return ParseSubmessage(brace, track->add_index());
+    } else if (name == "postgap_frames") {
+      int32_t frames;
+      if (!Once(seen, 9) || !ParseInt32(brace, &frames)) return false;
+      track->set_postgap_frames(frames);
+      return true;
+    } else if (name == "pregap_frames") {
+      int32_t frames;
+      if (!Once(seen, 10) || !ParseInt32(brace, &frames)) return false;
+      track->set_pregap_frames(frames);
+      return true;
+    }
+    return false;
+  }
+
+  bool ParseField(std::string_view name, bool brace, uint32_t *seen,
+                  Cuesheet::Index *index) {
+    if (name == "number") {
+      int32_t number;
+      if (!Once(seen, 1) || !ParseInt32(brace, &number)) return false;
+      index->set_number(number);
+      return true;
+    } else if (name == "position") {
+      return Once(seen, 2) &&
+          ParseSubmessage(brace, index->mutable_position());
+    } else if (name == "frames") {
+      int32_t frames;
+      if (!Once(seen, 3) || !ParseInt32(brace, &frames)) return false;
+      index->set_frames(frames);
+      return true;
+    }
+    return false;
+  }
+
+  bool ParseField(std::string_view name, bool brace, uint32_t *seen,
+                  Cuesheet::MSF *msf) {
+    int32_t value;
+    if (name == "minute") {
+      if (!Once(seen, 1) || !ParseInt32(brace, &value)) return false;
+      msf->set_minute(value);
+      return true;
+    } else if (name == "second") {
+      if (!Once(seen, 2) || !ParseInt32(brace, &value)) return false;
+      msf->set_second(value);
+      return true;
+    } else if (name == "frame") {
+      if (!Once(seen, 3) || !ParseInt32(brace, &value)) return false;
+      msf->set_frame(value);
+      return true;
+    }
+    return false;
+  }
+
+  const char *p_;
+  const char *end_;
+};
+
+// Prints fields in field number order, skipping those with default values,
+// as TextFormat::Printer does for proto3 messages.
+class TextPrinter {
+ public:
+  explicit TextPrinter(std::string *output)
+    : output_(output)
+    {}
+
+  // Returns false if anything in the cuesheet has unknown fields, which are
+  // left to TextFormat.
+  bool Print(const Cuesheet &cuesheet) {
+    if (HasUnknownFields(cuesheet)) return false;
+    if (cuesheet.has_tags() && !PrintTags("tags", cuesheet.tags())) {
+      return false;
+    }
+    PrintString("catalog", cuesheet.catalog());
+    PrintString("cd_text_file", cuesheet.cd_text_file());
+    for (const Cuesheet::File &file : cuesheet.file()) {
+      if (!PrintFile(file)) return false;
+    }
+    return true;
+  }
+
+ private:
+  void Indent() { output_->append(2 * depth_, ' '); }
+
+  void BeginMessage(std::string_view name) {
+    Indent();
+    output_->append(name);
+    output_->append(" {\n");
+    depth_++;
+  }
+
+  void EndMessage() {
+    depth_--;
+    Indent();
+    output_->append("}\n");
+  }
+
+  void PrintName(std::string_view name) {
+    Indent();
+    output_->append(name);
+    output_->append(": ");
+  }
+
+  void PrintString(std::string_view name, const std::string &value) {
+    if (value.empty()) return;
+    PrintName(name);
+    output_->push_back('"');
+    AppendCEscaped(value);
+    output_->append("\"\n");
+  }
+
+  void PrintInt32(std::string_view name, int32_t value) {
+    if (value == 0) return;
+    PrintName(name);
+    output_->append(std::to_string(value));
+    output_->push_back('\n');
+  }
+
+  template <size_t N>
+  void PrintEnum(std::string_view name, const std::string_view (&names)[N],
+                 int value) {
+    PrintName(name);
+    if (value >= 0 && static_cast<size_t>(value) < N) {
+      output_->append(names[value]);
+    } else {
+      // Proto3 enums keep values they don't know about.
+      output_->append(std::to_string(value));
+    }
+    output_->push_back('\n');
+  }
+
+  // As protobuf's CEscape: the common C escapes, and octal for everything
+  // else that isn't printable ASCII.
+  void AppendCEscaped(std::string_view value) {
+    const char *p = value.data();
+    const char *end = p + value.size();
+    while (p != end) {
+      // Copy runs of characters that need no escaping in one go.
+      const char *start = p;
+      while (p != end && NeedsNoEscape(*p)) p++;
+      output_->append(start, p - start);
+      if (p == end) break;
+
+      char c = *p++;
+      switch (c) {
+        case '\n': output_->append("\\n"); continue;
+        case '\r': output_->append("\\r"); continue;
+        case '\t': output_->append("\\t"); continue;
+        case '"': output_->append("\\\""); continue;
+        case '\'': output_->append("\\'"); continue;
+        case '\\': output_->append("\\\\"); continue;
+      }
+      unsigned char u = static_cast<unsigned char>(c);
+      char octal[] = {'\\', static_cast<char>('0' + (u >> 6)),
+                      static_cast<char>('0' + ((u >> 3) & 7)),
+                      static_cast<char>('0' + (u & 7))};
+      output_->append(octal, sizeof(octal));
+    }
+  }
+
+  static bool NeedsNoEscape(char c) {
+    unsigned char u = static_cast<unsigned char>(c);
+    return u >= 0x20 && u < 0x7f && c != '"' && c != '\'' && c != '\\';
+  }
+
+  bool PrintTags(std::string_view name, const Cuesheet::Tags &tags) {
+    if (HasUnknownFields(tags)) return false;
+    BeginMessage(name);
+    PrintString("title", tags.title());
+    PrintString("performer", tags.performer());
+    PrintString("songwriter", tags.songwriter());
+    for (const Cuesheet::CommentTag &tag : tags.comment_tag()) {
+      if (HasUnknownFields(tag)) return false;
+      BeginMessage("comment_tag");
+      PrintString("name", tag.name());
+      PrintString("value", tag.value());
+      EndMessage();
+    }
+    EndMessage();
+    return true;
+  }
+
+  bool PrintMSF(std::string_view name, const Cuesheet::MSF &msf) {
+    if (HasUnknownFields(msf)) return false;
+    BeginMessage(name);
+    PrintInt32("minute", msf.minute());
+    PrintInt32("second", msf.second());
+    PrintInt32("frame", msf.frame());
+    EndMessage();
+    return true;
+  }
+
+  bool PrintFile(const Cuesheet::File &file) {
+    if (HasUnknownFields(file)) return false;
+    BeginMessage("file");
+    if (file.type() != 0) PrintEnum("type", kFileTypeNames, file.type());
+    PrintString("path", file.path());
+    for (const Cuesheet::Track &track : file.track()) {
+      if (!PrintTrack(track)) return false;
+    }
+    EndMessage();
+    return true;
+  }
+
+  bool PrintTrack(const Cuesheet::Track &track) {
+    if (HasUnknownFields(track)) return false;
+    BeginMessage("track");
+    if (track.type() != 0) PrintEnum("type", kTrackTypeNames, track.type());
+    PrintInt32("number", track.number());
+    if (track.has_tags() && !PrintTags("tags", track.tags())) return false;
+    for (int flag : track.flag()) PrintEnum("flag", kTrackFlagNames, flag);
+    PrintString("isrc", track.isrc());
+    if (track.has_postgap() && !PrintMSF("postgap", track.postgap())) {
+      return false;
+    }
+    if (track.has_pregap() && !PrintMSF("pregap", track.pregap())) {
+      return false;
+    }
+    for (const Cuesheet::Index &index : track.index()) {
+      if (HasUnknownFields(index)) return false;
+      BeginMessage("index");
+      PrintInt32("number", index.number());
+      if (index.has_position() && !PrintMSF("position", index.position())) {
+        return false;
+      }
+      PrintInt32("frames", index.frames());
+      EndMessage();
+    }
+    PrintInt32("postgap_frames", track.postgap_frames());
+    PrintInt32("pregap_frames", track.pregap_frames());
+    EndMessage();
+    return true;
+  }
+
+  std::string *output_;
+  int depth_ = 0;
+};
+
+absl::StatusOr<Cuesheet> ParseTextProto(ZeroCopyInputStream *input) {
   StatusCollector collector(/*options=*/{});
   TextFormat::Parser parser;
   Cuesheet cuesheet;
 
   parser.RecordErrorsTo(&collector);
-  if (!parser.Parse(&istrm, &cuesheet)) {
+  if (!parser.Parse(input, &cuesheet)) {
     return collector.status();
   }
 
   return std::move(cuesheet);
 }
 
+}  // namespace
+
+namespace text_format_internal {
+
+bool ParseCuesheet(std::string_view input, Cuesheet *cuesheet) {
+  return TextParser(input).Parse(cuesheet);
+}
+
+bool PrintCuesheet(const Cuesheet &cuesheet, std::string *output) {
+  return TextPrinter(output).Print(cuesheet);
+}
+
+}  // namespace text_format_internal
+
+absl::StatusOr<Cuesheet> CuesheetFromTextProto(std::istream *input) {
+  std::string contents(std::istreambuf_iterator<char>(*input), {});
+  return CuesheetFromTextProto(contents);
+}
+
+absl::StatusOr<Cuesheet> CuesheetFromTextProto(std::string_view input) {
+  Cuesheet cuesheet;
+  if (text_format_internal::ParseCuesheet(input, &cuesheet)) {
+    return std::move(cuesheet);
+  }
+
+  ArrayInputStream istrm(input.data(), static_cast<int>(input.size()));
+  return ParseTextProto(&istrm);
+}
+
+void AppendCuesheetTextProto(const Cuesheet &cuesheet, std::string *output) {
+  size_t original_size = output->size();
+  if (text_format_internal::PrintCuesheet(cuesheet, output)) return;
+
+  output->resize(original_size);
+  std::string text;
+  TextFormat::PrintToString(cuesheet, &text);
+  output->append(text);
+}
+
 }  // namespace cue2pb
@@ -3,13 +3,35 @@
 
 #include <fstream>
 #include <ios>
+#include <string>
+#include <string_view>
 
 #include "cue2pb/cuesheet.pb.h"
 #include "absl/status/statusor.h"
 
+// Reading and writing Cuesheets in the protobuf text format. These accept and
+// produce exactly what google::protobuf::TextFormat does, but handle the
+// Cuesheet schema directly instead of through reflection, which is several
+// times faster. Anything they don't handle themselves, like unknown fields or
+// malformed input, is passed on to TextFormat.
+
 namespace cue2pb {
 
 absl::StatusOr<Cuesheet> CuesheetFromTextProto(std::istream *input);
+absl::StatusOr<Cuesheet> CuesheetFromTextProto(std::string_view input);
+
+// Appends cuesheet to output, byte-for-byte as TextFormat::Print would.
+void AppendCuesheetTextProto(const Cuesheet &cuesheet, std::string *output);
+
+namespace text_format_internal {
+
+// The specialized implementations, without the fallback to TextFormat. These
+// return false, leaving the output in an unspecified state, for anything
+// they don't handle.
+bool ParseCuesheet(std::string_view input, Cuesheet *cuesheet);
+bool PrintCuesheet(const Cuesheet &cuesheet, std::string *output);
+
+}  // namespace text_format_internal
 
 }  // namespace cue2pb
 
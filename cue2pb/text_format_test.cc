@@ -0,0 +1,216 @@
+#include "cue2pb/text_format.h"
+
+#include <random>
+#include <string>
+#include <string_view>
+
+#include "gtest/gtest.h"
+#include "cue2pb/cuesheet.pb.h"
+#include "google/protobuf/text_format.h"
+#include "util/file.h"
+#include "util/testing/assertions.h"
+#include "util/testing/protobuf_assertions.h"
+
+namespace cue2pb {
+
+using ::google::protobuf::TextFormat;
+using ::util::IsEqual;
+using ::util::IsOk;
+
+namespace {
+
+constexpr const char *kTestdata[] = {
+  "eac_multifile_gapless", "eac_multifile_gaps", "eac_singlefile",
+  "full_disc", "hidden_track",
+};
+
+std::string GenericPrint(const Cuesheet &cuesheet) {
+  std::string out;
+  EXPECT_TRUE(TextFormat::PrintToString(cuesheet, &out));
+  return out;
+}
+
+void ExpectParsesAsGeneric(std::string_view input, bool specialized) {
+  Cuesheet generic;
+  bool generic_ok = TextFormat::ParseFromString(std::string(input), &generic);
+
+  Cuesheet fast;
+  EXPECT_EQ(specialized, text_format_internal::ParseCuesheet(input, &fast))
+      << input;
+  if (specialized) {
+    EXPECT_TRUE(IsEqual(generic, fast)) << input;
+  }
+
+  absl::StatusOr<Cuesheet> parsed = CuesheetFromTextProto(input);
+  ASSERT_EQ(generic_ok, parsed.ok()) << input;
+  if (generic_ok) {
+    EXPECT_TRUE(IsEqual(generic, *parsed)) << input;
+  }
+}
+
+TEST(TextFormatTest, Testdata) {
+  for (const char *name : kTestdata) {
+    auto mapped = util::MappedFile::Open(
+        "cue2pb/testdata/" + std::string(name) + ".textproto");
+    ASSERT_TRUE(IsOk(mapped));
+    ExpectParsesAsGeneric(mapped->contents(), /*specialized=*/true);
+
+    Cuesheet cuesheet = CuesheetFromTextProto(mapped->contents()).value();
+    std::string printed;
+    EXPECT_TRUE(text_format_internal::PrintCuesheet(cuesheet, &printed));
+    EXPECT_EQ(GenericPrint(cuesheet), printed) << name;
+  }
+}
+
+TEST(TextFormatTest, PrintsLikeGeneric) {
+  Cuesheet cuesheet;
+  std::string every_byte;
+  for (int c = 0; c < 256; c++) every_byte.push_back(static_cast<char>(c));
+  cuesheet.mutable_tags()->set_title(every_byte);
+  cuesheet.set_catalog("'quoted' \"both\" ways");
+
+  Cuesheet::File *file = cuesheet.add_file();
+  file->set_type(static_cast<Cuesheet::File::Type>(42));
+  Cuesheet::Track *track = file->add_track();
+  track->set_number(-3);
+  track->add_flag(Cuesheet::Track::FLAG_UNKNOWN);
+  track->add_flag(static_cast<Cuesheet::Track::Flag>(-1));
+  track->add_flag(Cuesheet::Track::FLAG_PRE);
+  track->mutable_tags();
+  track->mutable_pregap();
+  track->add_index()->mutable_position()->set_frame(74);
+  track->add_index();
+  track->add_index()->set_frames(335549);
+  track->set_pregap_frames(-1);
+  file->add_track()->set_type(Cuesheet::Track::TYPE_CDI_2352);
+
+  std::string printed;
+  EXPECT_TRUE(text_format_internal::PrintCuesheet(cuesheet, &printed));
+  EXPECT_EQ(GenericPrint(cuesheet), printed);
+
+  ExpectParsesAsGeneric(printed, /*specialized=*/false);
+}
+
+TEST(TextFormatTest, PrintFallsBackForUnknownFields) {
+  Cuesheet cuesheet;
+  cuesheet.set_catalog("1234");
+  // Field 99, a varint of 1.
+  ASSERT_TRUE(cuesheet.add_file()->add_track()->ParseFromString(
+      std::string("\x98\x06\x01", 3)));
+
+  std::string printed;
+  EXPECT_FALSE(text_format_internal::PrintCuesheet(cuesheet, &printed));
+
+  printed = "prefix";
+  AppendCuesheetTextProto(cuesheet, &printed);
+  EXPECT_EQ("prefix" + GenericPrint(cuesheet), printed);
+}
+
+TEST(TextFormatTest, RandomCuesheetsPrintLikeGeneric) {
+  std::mt19937 rng(1);
+  auto random_string = [&rng]() {
+    std::string s(rng() % 8, '\0');
+    for (char &c : s) c = static_cast<char>(rng() % 256);
+    return s;
+  };
+
+  for (int i = 0; i < 200; i++) {
+    Cuesheet cuesheet;
+    if (rng() % 2) cuesheet.mutable_tags()->set_title(random_string());
+    if (rng() % 2) cuesheet.set_cd_text_file(random_string());
+    for (int f = rng() % 3; f > 0; f--) {
+      Cuesheet::File *file = cuesheet.add_file();
+      file->set_type(static_cast<Cuesheet::File::Type>(rng() % 6));
+      file->set_path(random_string());
+      for (int t = rng() % 3; t > 0; t--) {
+        Cuesheet::Track *track = file->add_track();
+        track->set_type(static_cast<Cuesheet::Track::Type>(rng() % 9));
+        track->set_number(static_cast<int32_t>(rng()));
+        if (rng() % 2) {
+          Cuesheet::CommentTag *tag =
+              track->mutable_tags()->add_comment_tag();
+          tag->set_name(random_string());
+          tag->set_value(random_string());
+        }
+        for (int n = rng() % 3; n > 0; n--) {
+          track->add_flag(static_cast<Cuesheet::Track::Flag>(rng() % 4));
+        }
+        if (rng() % 2) track->mutable_postgap()->set_second(rng() % 60);
+        Cuesheet::MSF *position = track->add_index()->mutable_position();
+        position->set_minute(rng() % 100);
+        position->set_frame(rng() % 65);
+      }
+    }
+
+    std::string printed;
+    EXPECT_TRUE(text_format_internal::PrintCuesheet(cuesheet, &printed));
+    ASSERT_EQ(GenericPrint(cuesheet), printed);
+
+    Cuesheet parsed;
+    EXPECT_TRUE(text_format_internal::ParseCuesheet(printed, &parsed))
+        << printed;
+    EXPECT_TRUE(IsEqual(cuesheet, parsed)) << printed;
+  }
+}
+
+TEST(TextFormatTest, ParsesLikeGeneric) {
+  constexpr std::string_view kSpecialized[] = {
+    "",
+    "  # Nothing but a comment",
+    "catalog: \"1234\"",
+    "catalog: '1234'",
+    "catalog: \"12\" '34' \"\"",
+    "catalog: \"\\x41\\101\\n\\?\\'\\\"\\a\\777\"",
+    "tags { title: \"x\" } catalog: \"y\"",
+    "tags: { title: \"x\" }; catalog: \"y\",",
+    "tags{title:\"x\"}",
+    "file { track { number: -2147483648 index { position { } } } }",
+    "file { track { number: 2147483647 flag: FLAG_DCP flag: FLAG_DCP } }",
+    "file { type: TYPE_MOTOROLA track { type: TYPE_CDG } track { } }",
+    "file { track { number: 0 } } # trailing\n",
+    "file { track { pregap_frames: 150 index { frames: 32 } } }",
+  };
+  for (std::string_view input : kSpecialized) {
+    ExpectParsesAsGeneric(input, /*specialized=*/true);
+  }
+
+  // Valid input that is left to TextFormat.
+  constexpr std::string_view kGenericOnly[] = {
+    "tags < title: \"x\" >",
+    "file { track { number: 0x10 } }",
+    "file { track { number: 010 } }",
+    "file { track { number: - 1 } }",
+    "file { type: 1 }",
+    "file { track { flag: [FLAG_DCP, FLAG_PRE] } }",
+    "file [ { path: \"a\" }, { path: \"b\" } ]",
+    "catalog: \"\\u00e9\"",
+  };
+  for (std::string_view input : kGenericOnly) {
+    ExpectParsesAsGeneric(input, /*specialized=*/false);
+  }
+
+  // Errors, which are all reported by TextFormat.
+  constexpr std::string_view kInvalid[] = {
+    "catalog \"1234\"",
+    "catalog: 1234",
+    "catalog: \"1234",
+    "catalog: \"12\n34\"",
+    "catalog: \"1234\" catalog: \"5678\"",
+    "tags { } tags { }",
+    "tags { ",
+    "}",
+    "does_not_exist: 1",
+    "[cue2pb.ext] { }",
+    "file { type: TYPE_FLAC }",
+    "file { track { number: 2147483648 } }",
+    "file { track { number: 1.5 } }",
+    "file { track { number: 1abc } }",
+    "catalog: \"\\q\"",
+  };
+  for (std::string_view input : kInvalid) {
+    ExpectParsesAsGeneric(input, /*specialized=*/false);
+  }
+}
+
+}  // namespace
+}  // namespace cue2pb
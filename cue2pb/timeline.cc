@@ -0,0 +1,132 @@
+#include "cue2pb/timeline.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "cue2pb/frames.h"
+#include "util/status_builder.h"
+
+namespace cue2pb {
+
+absl::StatusOr<CuesheetTimeline> CuesheetTimeline::Create(
+    const Cuesheet &cuesheet, absl::Span<const int64_t> file_lengths) {
+  if (!file_lengths.empty() &&
+      file_lengths.size() != static_cast<size_t>(cuesheet.file_size())) {
+    return util::InvalidArgumentErrorBuilder()
+        << "Got " << file_lengths.size() << " file lengths for "
+        << cuesheet.file_size() << " files";
+  }
+
+  CuesheetTimeline timeline;
+  timeline.file_tracks_.push_back(0);
+  timeline.track_indices_.push_back(0);
+  for (int f = 0; f < cuesheet.file_size(); f++) {
+    const Cuesheet::File &file = cuesheet.file(f);
+    // The silence inserted into the file's timeline so far, and the last
+    // index seen, to check that they're in order.
+    int64_t silence = 0;
+    int64_t previous = 0;
+    for (const Cuesheet::Track &track : file.track()) {
+      int64_t pregap = PregapFrames(track);
+      int64_t postgap = PostgapFrames(track);
+      if (pregap < 0 || postgap < 0) {
+        return util::InvalidArgumentErrorBuilder()
+            << "Negative gap in track " << track.number();
+      }
+      silence += pregap;
+
+      int first_index = static_cast<int>(timeline.index_frames_.size());
+      int64_t start = kUnknown;
+      for (const Cuesheet::Index &index : track.index()) {
+        int64_t position = PositionFrames(index);
+        if (position < previous) {
+          return util::InvalidArgumentErrorBuilder()
+              << "INDEX " << index.number() << " of track " << track.number()
+              << " is before the index preceding it";
+        }
+        previous = position;
+        timeline.index_frames_.push_back(position + silence);
+        timeline.index_numbers_.push_back(index.number());
+        if (index.number() == 1 && start == kUnknown) {
+          start = position + silence;
+        }
+      }
+      if (start == kUnknown) {
+        return util::InvalidArgumentErrorBuilder()
+            << "Track " << track.number() << " has no INDEX 01";
+      }
+
+      int64_t gap_start = timeline.index_frames_[first_index] - pregap;
+      if (timeline.tracks() > timeline.file_tracks_.back()) {
+        timeline.ends_.back() = gap_start;
+      }
+      timeline.track_files_.push_back(f);
+      timeline.track_numbers_.push_back(track.number());
+      timeline.gap_starts_.push_back(gap_start);
+      timeline.starts_.push_back(start);
+      timeline.ends_.push_back(kUnknown);
+      timeline.track_indices_.push_back(
+          static_cast<int>(timeline.index_frames_.size()));
+      silence += postgap;
+    }
+
+    if (!file_lengths.empty() &&
+        timeline.tracks() > timeline.file_tracks_.back()) {
+      if (file_lengths[f] < previous) {
+        return util::InvalidArgumentErrorBuilder()
+            << "File " << file.path() << " is " << file_lengths[f]
+            << " frames long, but has an index at " << previous;
+      }
+      timeline.ends_.back() = file_lengths[f] + silence;
+    }
+    timeline.file_tracks_.push_back(timeline.tracks());
+  }
+
+  for (int f = 0; f < timeline.files(); f++) {
+    for (int t = timeline.first_track(f); t < timeline.first_track(f + 1);
+         t++) {
+      const Cuesheet::Track &track =
+          cuesheet.file(f).track(t - timeline.first_track(f));
+      if (timeline.starts_[t] > timeline.gap_starts_[t]) {
+        timeline.gaps_.push_back({Gap::Kind::kPregap, f, t,
+                                  timeline.gap_starts_[t],
+                                  timeline.starts_[t]});
+      }
+      int64_t postgap = PostgapFrames(track);
+      if (postgap > 0 && timeline.ends_[t] != kUnknown) {
+        timeline.gaps_.push_back({Gap::Kind::kPostgap, f, t,
+                                  timeline.ends_[t] - postgap,
+                                  timeline.ends_[t]});
+      }
+    }
+  }
+  return std::move(timeline);
+}
+
+int64_t CuesheetTimeline::Duration(int track) const {
+  if (ends_[track] == kUnknown) return kUnknown;
+  return ends_[track] - starts_[track];
+}
+
+int CuesheetTimeline::TrackAt(int64_t frames, int file) const {
+  auto begin = gap_starts_.begin() + first_track(file);
+  auto end = gap_starts_.begin() + first_track(file + 1);
+  auto it = std::upper_bound(begin, end, frames);
+  if (it == begin) return -1;
+  int track = static_cast<int>(it - gap_starts_.begin()) - 1;
+  if (ends_[track] != kUnknown && frames >= ends_[track]) return -1;
+  return track;
+}
+
+int CuesheetTimeline::IndexAt(int64_t frames, int file) const {
+  int track = TrackAt(frames, file);
+  if (track < 0) return -1;
+  auto begin = index_frames_.begin() + first_index(track);
+  auto end = index_frames_.begin() + first_index(track + 1);
+  auto it = std::upper_bound(begin, end, frames);
+  // Pregap silence before the track's first index counts as that index.
+  if (it != begin) --it;
+  return static_cast<int>(it - index_frames_.begin());
+}
+
+}  // namespace cue2pb
@@ -0,0 +1,112 @@
+#ifndef CUE2PB_TIMELINE_H_
+#define CUE2PB_TIMELINE_H_
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "cue2pb/cuesheet.pb.h"
+
+namespace cue2pb {
+
+// Where every track and index of a Cuesheet starts, precomputed into flat
+// sorted arrays so that seeking is a binary search rather than a walk over
+// the proto.
+//
+// Each FILE is played back on its own timeline, in frames since the start of
+// its playback: the file's data, with the silence of each PREGAP inserted just
+// before its track's first index, and that of each POSTGAP just after its
+// track's data. A track occupies [gap_start, end) of its file's timeline. Its
+// gap, [gap_start, start), is its pregap silence followed by its data before
+// INDEX 01 (i.e. from INDEX 00, if it has one). Its postgap is the end of
+// [start, end).
+//
+// Tracks are identified by their position in the cuesheet, counting from 0
+// across all files, and indices by their position in index_frames().
+class CuesheetTimeline {
+ public:
+  // The end of a file's last track, when the length of the file isn't known.
+  static constexpr int64_t kUnknown = -1;
+
+  struct Gap {
+    enum class Kind {
+      kPregap,  // [gap_start, start) of a track.
+      kPostgap,
+    };
+
+    Kind kind;
+    int file;
+    int track;
+    int64_t begin;
+    int64_t end;
+  };
+
+  // file_lengths, if not empty, has the length in frames of the data of each
+  // FILE, without which the end of each file's last track is kUnknown.
+  //
+  // Fails if a track has no INDEX 01, or the indices of a file aren't in
+  // order.
+  static absl::StatusOr<CuesheetTimeline> Create(
+      const Cuesheet &cuesheet, absl::Span<const int64_t> file_lengths = {});
+
+  int files() const { return static_cast<int>(file_tracks_.size()) - 1; }
+  int tracks() const { return static_cast<int>(track_numbers_.size()); }
+
+  // The tracks of file are [first_track(file), first_track(file + 1)).
+  int first_track(int file) const { return file_tracks_[file]; }
+  int file(int track) const { return track_files_[track]; }
+  int32_t number(int track) const { return track_numbers_[track]; }
+
+  int64_t gap_start(int track) const { return gap_starts_[track]; }
+  // Where INDEX 01 is.
+  int64_t start(int track) const { return starts_[track]; }
+  // Where the next track's gap starts, or kUnknown.
+  int64_t end(int track) const { return ends_[track]; }
+
+  // From INDEX 01 to the end of the track, including its postgap but not its
+  // pregap. kUnknown if the end of the track is.
+  int64_t Duration(int track) const;
+
+  // The indices of track are [first_index(track), first_index(track + 1)).
+  int first_index(int track) const { return track_indices_[track]; }
+  // Where each index is on its file's timeline.
+  const std::vector<int64_t> &index_frames() const { return index_frames_; }
+  const std::vector<int32_t> &index_numbers() const { return index_numbers_; }
+
+  // The track or index playing at frames into file's timeline, or -1 if
+  // frames is before the first track's gap or past the last track's end. Each
+  // is a binary search. Pregap silence before a track's first index counts as
+  // that index.
+  int TrackAt(int64_t frames, int file = 0) const;
+  int IndexAt(int64_t frames, int file = 0) const;
+
+  // Every pregap and postgap that isn't empty, ordered by file and then by
+  // where they begin.
+  const std::vector<Gap> &Gaps() const { return gaps_; }
+
+ private:
+  CuesheetTimeline() = default;
+
+  // Indexed by file, with one more entry than there are files.
+  std::vector<int> file_tracks_;
+
+  // Indexed by track.
+  std::vector<int> track_files_;
+  std::vector<int32_t> track_numbers_;
+  std::vector<int64_t> gap_starts_;
+  std::vector<int64_t> starts_;
+  std::vector<int64_t> ends_;
+  std::vector<int> track_indices_;  // With one more entry than tracks.
+
+  // Indexed by index.
+  std::vector<int64_t> index_frames_;
+  std::vector<int32_t> index_numbers_;
+
+  std::vector<Gap> gaps_;
+};
+
+}  // namespace cue2pb
+
+#endif  // CUE2PB_TIMELINE_H_
@@ -0,0 +1,147 @@
+#include "cue2pb/timeline.h"
+
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "absl/status/statusor.h"
+#include "cue2pb/parser.h"
+#include "util/testing/assertions.h"
+#include "util/status_macros.h"
+
+namespace cue2pb {
+namespace {
+
+using ::util::IsOk;
+using Gap = CuesheetTimeline::Gap;
+
+Cuesheet ParseOrDie(std::string_view input) {
+  absl::StatusOr<Cuesheet> cuesheet = ParseCuesheet(input);
+  CHECK_OK(cuesheet.status());
+  return *std::move(cuesheet);
+}
+
+// Frames: a pregap of 30, a postgap of 75, and indices at 0; 750, 900; 1500.
+constexpr std::string_view kGaps =
+    "FILE \"a.wav\" WAVE\n"
+    "  TRACK 01 AUDIO\n"
+    "    PREGAP 00:00:30\n"
+    "    POSTGAP 00:01:00\n"
+    "    INDEX 01 00:00:00\n"
+    "  TRACK 02 AUDIO\n"
+    "    INDEX 00 00:10:00\n"
+    "    INDEX 01 00:12:00\n"
+    "  TRACK 03 AUDIO\n"
+    "    INDEX 01 00:20:00\n";
+
+TEST(CuesheetTimelineTest, GapsShiftTheTimeline) {
+  const int64_t lengths[] = {3000};
+  absl::StatusOr<CuesheetTimeline> timeline =
+      CuesheetTimeline::Create(ParseOrDie(kGaps), lengths);
+  ASSERT_TRUE(IsOk(timeline));
+  ASSERT_EQ(1, timeline->files());
+  ASSERT_EQ(3, timeline->tracks());
+
+  EXPECT_EQ((std::vector<int64_t>{30, 855, 1005, 1605}),
+            timeline->index_frames());
+  EXPECT_EQ((std::vector<int32_t>{1, 0, 1, 1}), timeline->index_numbers());
+
+  EXPECT_EQ(0, timeline->gap_start(0));
+  EXPECT_EQ(30, timeline->start(0));
+  EXPECT_EQ(855, timeline->end(0));
+  EXPECT_EQ(825, timeline->Duration(0));
+  EXPECT_EQ(600, timeline->Duration(1));
+  EXPECT_EQ(1500, timeline->Duration(2));
+  EXPECT_EQ(3105, timeline->end(2));
+
+  ASSERT_EQ(3, timeline->Gaps().size());
+  const Gap &pregap = timeline->Gaps()[0];
+  EXPECT_EQ(Gap::Kind::kPregap, pregap.kind);
+  EXPECT_EQ(0, pregap.track);
+  EXPECT_EQ(0, pregap.begin);
+  EXPECT_EQ(30, pregap.end);
+  const Gap &postgap = timeline->Gaps()[1];
+  EXPECT_EQ(Gap::Kind::kPostgap, postgap.kind);
+  EXPECT_EQ(780, postgap.begin);
+  EXPECT_EQ(855, postgap.end);
+  const Gap &index0 = timeline->Gaps()[2];
+  EXPECT_EQ(1, index0.track);
+  EXPECT_EQ(855, index0.begin);
+  EXPECT_EQ(1005, index0.end);
+}
+
+TEST(CuesheetTimelineTest, TrackAndIndexAt) {
+  const int64_t lengths[] = {3000};
+  absl::StatusOr<CuesheetTimeline> timeline =
+      CuesheetTimeline::Create(ParseOrDie(kGaps), lengths);
+  ASSERT_TRUE(IsOk(timeline));
+
+  const struct {
+    int64_t frames;
+    int track;
+    int index;
+  } kCases[] = {
+    {-1, -1, -1}, {0, 0, 0}, {854, 0, 0}, {855, 1, 1}, {1004, 1, 1},
+    {1005, 1, 2}, {1605, 2, 3}, {3104, 2, 3}, {3105, -1, -1},
+  };
+  for (const auto &c : kCases) {
+    EXPECT_EQ(c.track, timeline->TrackAt(c.frames)) << c.frames;
+    EXPECT_EQ(c.index, timeline->IndexAt(c.frames)) << c.frames;
+  }
+}
+
+TEST(CuesheetTimelineTest, UnknownFileLengths) {
+  absl::StatusOr<CuesheetTimeline> timeline = CuesheetTimeline::Create(
+      ParseOrDie("FILE \"1.wav\" WAVE\n"
+                 "  TRACK 01 AUDIO\n"
+                 "    INDEX 01 00:00:00\n"
+                 "FILE \"2.wav\" WAVE\n"
+                 "  TRACK 02 AUDIO\n"
+                 "    POSTGAP 00:02:00\n"
+                 "    INDEX 00 00:00:00\n"
+                 "    INDEX 01 00:00:28\n"
+                 "  TRACK 03 AUDIO\n"
+                 "    POSTGAP 00:01:00\n"
+                 "    INDEX 01 00:30:00\n"));
+  ASSERT_TRUE(IsOk(timeline));
+  ASSERT_EQ(2, timeline->files());
+  EXPECT_EQ(1, timeline->first_track(1));
+  EXPECT_EQ(1, timeline->file(2));
+  EXPECT_EQ(3, timeline->number(2));
+
+  EXPECT_EQ(CuesheetTimeline::kUnknown, timeline->Duration(0));
+  EXPECT_EQ(2372, timeline->Duration(1));
+  EXPECT_EQ(CuesheetTimeline::kUnknown, timeline->Duration(2));
+
+  EXPECT_EQ(0, timeline->TrackAt(1 << 30));
+  EXPECT_EQ(1, timeline->TrackAt(0, 1));
+  EXPECT_EQ(2, timeline->TrackAt(1 << 30, 1));
+
+  // Track 02's pregap and postgap. The postgap of track 03 can't be placed
+  // without knowing where its end is.
+  ASSERT_EQ(2, timeline->Gaps().size());
+  EXPECT_EQ(1, timeline->Gaps()[1].file);
+  EXPECT_EQ(2250, timeline->Gaps()[1].begin);
+}
+
+TEST(CuesheetTimelineTest, Invalid) {
+  EXPECT_FALSE(IsOk(CuesheetTimeline::Create(ParseOrDie(
+      "FILE \"a.wav\" WAVE\n"
+      "  TRACK 01 AUDIO\n"
+      "    INDEX 00 00:00:00\n"))));
+  EXPECT_FALSE(IsOk(CuesheetTimeline::Create(ParseOrDie(
+      "FILE \"a.wav\" WAVE\n"
+      "  TRACK 01 AUDIO\n"
+      "    INDEX 01 00:10:00\n"
+      "  TRACK 02 AUDIO\n"
+      "    INDEX 01 00:05:00\n"))));
+
+  const int64_t lengths[] = {3000, 3000};
+  EXPECT_FALSE(IsOk(CuesheetTimeline::Create(ParseOrDie(kGaps), lengths)));
+  const int64_t too_short[] = {1000};
+  EXPECT_FALSE(IsOk(CuesheetTimeline::Create(ParseOrDie(kGaps), too_short)));
+}
+
+}  // namespace
+}  // namespace cue2pb
@@ -3,10 +3,13 @@
 #include <utility>
 #include <string>
 #include <string_view>
+#include <stddef.h>
+#include <stdint.h>
 
 #include "absl/strings/match.h"
-#include "absl/strings/str_format.h"
-#include "absl/strings/str_join.h"
+#include "absl/strings/str_cat.h"
+#include "cue2pb/keywords.h"
+#include "cue2pb/msf.h"
 #include "util/status_builder.h"
 #include "util/status_macros.h"
 #include "absl/status/statusor.h"
@@ -14,165 +17,150 @@
 namespace cue2pb {
 namespace {
 
-std::string QuoteIfNeeded(std::string_view s) {
+void AppendQuotedIfNeeded(std::string_view s, std::string *output) {
   if (s.empty() || absl::StrContains(s, " ")) {
-    return "\"" + std::string(s) + "\"";
+    absl::StrAppend(output, "\"", s, "\"");
+  } else {
+    output->append(s);
   }
-  return std::string(s);
 }
 
-absl::StatusOr<std::string> FileTypeToString(Cuesheet::File::Type type) {
-  using File = ::cue2pb::Cuesheet::File;
-
-  std::string type_str;
-  switch (type) {
-    case File::TYPE_WAVE:
-      type_str = "WAVE";
-      break;
-    case File::TYPE_MP3:
-      type_str = "MP3";
-      break;
-    case File::TYPE_AIFF:
-      type_str = "AIFF";
-      break;
-    case File::TYPE_BINARY:
-      type_str = "BINARY";
-      break;
-    case File::TYPE_MOTOROLA:
-      type_str = "MOTOROLA";
-      break;
-    default:
-      return util::InvalidArgumentErrorBuilder()
-          << "Unknown file type: '" << File::Type_Name(type) << "'";
-  }
-
-  return std::move(type_str);
+// Appends n as if by "%02d".
+void AppendTwoDigits(int32_t n, std::string *output) {
+  if (n >= 0 && n < 100) {
+    output->push_back('0' + n / 10);
+    output->push_back('0' + n % 10);
+  } else {
+    absl::StrAppend(output, n);
+  }
+}
+
+absl::StatusOr<std::string_view> FileTypeToString(Cuesheet::File::Type type) {
+  std::string_view type_str = FileTypeName(type);
+  if (type_str.empty()) {
+    return util::InvalidArgumentErrorBuilder()
+        << "Unknown file type: '" << Cuesheet::File::Type_Name(type) << "'";
+  }
+  return type_str;
 }
 
-absl::StatusOr<std::string> TrackTypeToString(Cuesheet::Track::Type type) {
-  using Track = ::cue2pb::Cuesheet::Track;
-
-  std::string type_str;
-  switch (type) {
-    case Track::TYPE_AUDIO:
-      type_str = "AUDIO";
-      break;
-    case Track::TYPE_CDG:
-      type_str = "CDG";
-      break;
-    case Track::TYPE_MODE1_2048:
-      type_str = "MODE1/2048";
-      break;
-    case Track::TYPE_MODE1_2352:
-      type_str = "MODE1/2352";
-      break;
-    case Track::TYPE_MODE2_2336:
-      type_str = "MODE2/2336";
-      break;
-    case Track::TYPE_MODE2_2352:
-      type_str = "MODE2/2352";
-      break;
-    case Track::TYPE_CDI_2336:
-      type_str = "CDI/2336";
-      break;
-    case Track::TYPE_CDI_2352:
-      type_str = "CDI/2352";
-      break;
-    default:
-      return util::InvalidArgumentErrorBuilder()
-          << "Unknown track type: '" << Track::Type_Name(type) << "'";
-  }
-
-  return std::move(type_str);
+absl::StatusOr<std::string_view> TrackTypeToString(Cuesheet::Track::Type type) {
+  std::string_view type_str = TrackTypeName(type);
+  if (type_str.empty()) {
+    return util::InvalidArgumentErrorBuilder()
+        << "Unknown track type: '" << Cuesheet::Track::Type_Name(type) << "'";
+  }
+  return type_str;
 }
 
-absl::StatusOr<std::string> FlagToString(Cuesheet::Track::Flag flag) {
-  using Track = ::cue2pb::Cuesheet::Track;
-
-  std::string flag_str;
-  switch (flag) {
-    case Track::FLAG_DCP:
-      flag_str = "DCP";
-      break;
-    case Track::FLAG_4CH:
-      flag_str = "4CH";
-      break;
-    case Track::FLAG_PRE:
-      flag_str = "PRE";
-      break;
-    default:
-      return util::InvalidArgumentErrorBuilder()
-          << "Unknown track flag: '" << Track::Flag_Name(flag) << "'";
-  }
-
-  return std::move(flag_str);
+absl::StatusOr<std::string_view> FlagToString(Cuesheet::Track::Flag flag) {
+  std::string_view flag_str = TrackFlagName(flag);
+  if (flag_str.empty()) {
+    return util::InvalidArgumentErrorBuilder()
+        << "Unknown track flag: '" << Cuesheet::Track::Flag_Name(flag) << "'";
+  }
+  return flag_str;
 }
 
-std::string MSFToString(const Cuesheet::MSF &msf) {
-  return absl::StrFormat("%02d:%02d:%02d", msf.minute(), msf.second(),
-                         msf.frame());
+void AppendMSF(int32_t minute, int32_t second, int32_t frame,
+               std::string *output) {
+  AppendTwoDigits(minute, output);
+  output->push_back(':');
+  AppendTwoDigits(second, output);
+  output->push_back(':');
+  AppendTwoDigits(frame, output);
 }
 
-bool IsZeroMSF(const Cuesheet::MSF &msf) {
-  return msf.minute() == 0 && msf.second() == 0 && msf.frame() == 0;
+// Appends a position stored in either form (see cuesheet.proto). An MSF is
+// written as it is, even if out of range, rather than normalized.
+void AppendPosition(bool has_msf, const Cuesheet::MSF &msf, int32_t frames,
+                    std::string *output) {
+  if (has_msf) {
+    AppendMSF(msf.minute(), msf.second(), msf.frame(), output);
+    return;
+  }
+  int32_t minute, second, frame;
+  FramesToMSF(frames, &minute, &second, &frame);
+  AppendMSF(minute, second, frame, output);
 }
 
-absl::Status UnparseTags(const Cuesheet::Tags &tags, std::ostream *output) {
+bool IsZeroPosition(const Cuesheet::MSF &msf, int32_t frames) {
+  return msf.minute() == 0 && msf.second() == 0 && msf.frame() == 0 &&
+      frames == 0;
+}
+
+absl::Status UnparseTags(const Cuesheet::Tags &tags, std::string *output) {
   for (const Cuesheet::CommentTag &tag : tags.comment_tag()) {
-    *output << "REM " << tag.name() << " " << QuoteIfNeeded(tag.value())
-            << std::endl;
+    absl::StrAppend(output, "REM ", tag.name(), " ");
+    AppendQuotedIfNeeded(tag.value(), output);
+    output->push_back('\n');
   }
 
   if (!tags.title().empty()) {
-    *output << "TITLE " << QuoteIfNeeded(tags.title()) << std::endl;
+    output->append("TITLE ");
+    AppendQuotedIfNeeded(tags.title(), output);
+    output->push_back('\n');
   }
 
   if (!tags.performer().empty()) {
-    *output << "PERFORMER " << QuoteIfNeeded(tags.performer())
-            << std::endl;
+    output->append("PERFORMER ");
+    AppendQuotedIfNeeded(tags.performer(), output);
+    output->push_back('\n');
   }
 
   if (!tags.songwriter().empty()) {
-    *output << "SONGWRITER " << QuoteIfNeeded(tags.songwriter())
-            << std::endl;
+    output->append("SONGWRITER ");
+    AppendQuotedIfNeeded(tags.songwriter(), output);
+    output->push_back('\n');
   }
 
   return absl::OkStatus();
 }
 
-absl::Status UnparseIndex(const Cuesheet::Index &index, std::ostream *output) {
-  *output << "INDEX " << absl::StrFormat("%02d", index.number()) << " "
-          << MSFToString(index.position()) << std::endl;
+absl::Status UnparseIndex(const Cuesheet::Index &index, std::string *output) {
+  output->append("INDEX ");
+  AppendTwoDigits(index.number(), output);
+  output->push_back(' ');
+  AppendPosition(index.has_position(), index.position(), index.frames(),
+                 output);
+  output->push_back('\n');
   return absl::OkStatus();
 }
 
-absl::Status UnparseTrack(const Cuesheet::Track &track, std::ostream *output) {
+absl::Status UnparseTrack(const Cuesheet::Track &track, std::string *output) {
   ASSIGN_OR_RETURN(auto type, TrackTypeToString(track.type()));
 
-  *output << "TRACK " << absl::StrFormat("%02d", track.number()) << " " << type
-          << std::endl;
+  output->append("TRACK ");
+  AppendTwoDigits(track.number(), output);
+  absl::StrAppend(output, " ", type, "\n");
 
   RETURN_IF_ERROR(UnparseTags(track.tags(), output));
 
   if (!track.isrc().empty()) {
-    *output << "ISRC " << track.isrc() << std::endl;
+    absl::StrAppend(output, "ISRC ", track.isrc(), "\n");
   }
 
-  std::vector<std::string> flags;
-  for (int i = 0; i < track.flag_size(); i++) {
-    ASSIGN_OR_RETURN(auto flag_str, FlagToString(track.flag(i)));
-    flags.emplace_back(std::move(flag_str));
-  }
-  if (!flags.empty()) {
-    *output << "FLAGS " << absl::StrJoin(flags, " ") << std::endl;
+  if (track.flag_size() > 0) {
+    output->append("FLAGS");
+    for (int i = 0; i < track.flag_size(); i++) {
+      ASSIGN_OR_RETURN(auto flag_str, FlagToString(track.flag(i)));
+      absl::StrAppend(output, " ", flag_str);
+    }
+    output->push_back('\n');
   }
 
-  if (!IsZeroMSF(track.pregap())) {
-    *output << "PREGAP " << MSFToString(track.pregap()) << std::endl;
+  if (!IsZeroPosition(track.pregap(), track.pregap_frames())) {
+    output->append("PREGAP ");
+    AppendPosition(track.has_pregap(), track.pregap(), track.pregap_frames(),
+                   output);
+    output->push_back('\n');
   }
 
-  if (!IsZeroMSF(track.postgap())) {
-    *output << "POSTGAP " << MSFToString(track.postgap()) << std::endl;
+  if (!IsZeroPosition(track.postgap(), track.postgap_frames())) {
+    output->append("POSTGAP ");
+    AppendPosition(track.has_postgap(), track.postgap(), track.postgap_frames(),
+                   output);
+    output->push_back('\n');
   }
 
   for (const Cuesheet::Index &index : track.index()) {
@@ -182,10 +170,12 @@ absl::Status UnparseTrack(const Cuesheet::Track &track, std::ostream *output) {
   return absl::OkStatus();
 }
 
-absl::Status UnparseFile(const Cuesheet::File &file, std::ostream *output) {
+absl::Status UnparseFile(const Cuesheet::File &file, std::string *output) {
   ASSIGN_OR_RETURN(auto type, FileTypeToString(file.type()));
 
-  *output << "FILE " << QuoteIfNeeded(file.path()) << " " << type << std::endl;
+  output->append("FILE ");
+  AppendQuotedIfNeeded(file.path(), output);
+  absl::StrAppend(output, " ", type, "\n");
 
   for (const Cuesheet::Track &track : file.track()) {
     RETURN_IF_ERROR(UnparseTrack(track, output));
@@ -194,18 +184,17 @@ absl::Status UnparseFile(const Cuesheet::File &file, std::ostream *output) {
   return absl::OkStatus();
 }
 
-}  // namespace
-
-absl::Status UnparseCuesheet(const Cuesheet &cuesheet, std::ostream *output) {
+absl::Status UnparseCuesheetTo(const Cuesheet &cuesheet, std::string *output) {
   RETURN_IF_ERROR(UnparseTags(cuesheet.tags(), output));
 
   if (!cuesheet.catalog().empty()) {
-    *output << "CATALOG " << cuesheet.catalog() << std::endl;
+    absl::StrAppend(output, "CATALOG ", cuesheet.catalog(), "\n");
   }
 
   if (!cuesheet.cd_text_file().empty()) {
-    *output << "CDTEXTFILE " << QuoteIfNeeded(cuesheet.cd_text_file())
-            << std::endl;
+    output->append("CDTEXTFILE ");
+    AppendQuotedIfNeeded(cuesheet.cd_text_file(), output);
+    output->push_back('\n');
   }
 
   for (const Cuesheet::File &file : cuesheet.file()) {
@@ -215,4 +204,22 @@ absl::Status UnparseCuesheet(const Cuesheet &cuesheet, std::ostream *output) {
   return absl::OkStatus();
 }
 
+}  // namespace
+
+absl::Status UnparseCuesheet(const Cuesheet &cuesheet, std::string *output) {
+  size_t original_size = output->size();
+  absl::Status st = UnparseCuesheetTo(cuesheet, output);
+  if (!st.ok()) output->resize(original_size);
+  return st;
+}
+
+absl::Status UnparseCuesheet(const Cuesheet &cuesheet, std::ostream *output) {
+  std::string buf;
+  RETURN_IF_ERROR(UnparseCuesheet(cuesheet, &buf));
+  if (!output->write(buf.data(), buf.size())) {
+    return absl::DataLossError("Failed to write cuesheet");
+  }
+  return absl::OkStatus();
+}
+
 }  // namespace cue2pb
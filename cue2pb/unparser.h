@@ -2,12 +2,19 @@
 #define CUE2PB_UNPARSER_H_
 
 #include <ostream>
+#include <string>
 
 #include "cue2pb/cuesheet.pb.h"
 #include "absl/status/status.h"
 
 namespace cue2pb {
 
+// Appends the cuesheet to *output, one '\n' terminated line per command. On
+// error *output is left as it was.
+absl::Status UnparseCuesheet(const Cuesheet &cuesheet, std::string *output);
+
+// Unparses the whole cuesheet into a buffer, and then writes it to output in
+// one go. output is not flushed.
 absl::Status UnparseCuesheet(const Cuesheet &cuesheet, std::ostream *output);
 
 }  // namespace cue2pb
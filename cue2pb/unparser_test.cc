@@ -99,6 +99,27 @@ TEST_P(CuesheetEqualsProtoTest, MatchSample) {
   EXPECT_EQ(expected, *found);
 }
 
+TEST_P(CuesheetEqualsProtoTest, MatchSampleAppended) {
+  const auto &p = GetParam();
+
+  Cuesheet incue = CuesheetFromProtoStringOrDie(p.proto);
+
+  std::string found = "prefix\n";
+  ASSERT_TRUE(IsOk(UnparseCuesheet(incue, &found)));
+  EXPECT_EQ("prefix\n" + p.cuesheet, found);
+}
+
+TEST(UnparseInvalidTest, UnknownTrackTypeLeavesOutputUntouched) {
+  Cuesheet incue = CuesheetFromProtoStringOrDie(R"""(
+      tags { title: "Foo" }
+      file { path: "foo.wav" type: TYPE_WAVE track { number: 1 } }
+  )""");
+
+  std::string found = "prefix\n";
+  ASSERT_FALSE(IsOk(UnparseCuesheet(incue, &found)));
+  EXPECT_EQ("prefix\n", found);
+}
+
 INSTANTIATE_TEST_SUITE_P(
     Examples,
     CuesheetEqualsProtoFilesTest,
@@ -143,5 +164,32 @@ INSTANTIATE_TEST_SUITE_P(
     )
 );
 
+INSTANTIATE_TEST_SUITE_P(
+    CompactPositions,
+    CuesheetEqualsProtoTest,
+    testing::Values(
+      CuesheetProtoSample{
+        "FILE foo.wav WAVE\nTRACK 01 AUDIO\nPREGAP 00:02:00\n"
+        "INDEX 00 00:00:00\nINDEX 01 74:33:74\n",
+        R"""(file { path: "foo.wav" type: TYPE_WAVE
+                    track { type: TYPE_AUDIO number: 1 pregap_frames: 150
+                            index { number: 0 }
+                            index { number: 1 frames: 335549 } } })"""
+      }
+    )
+);
+
+INSTANTIATE_TEST_SUITE_P(
+    TrackTypes,
+    CuesheetEqualsProtoTest,
+    testing::Values(
+      CuesheetProtoSample{
+        "FILE foo.bin BINARY\nTRACK 01 CDI/2336\n",
+        R"""(file { path: "foo.bin" type: TYPE_BINARY
+                    track { type: TYPE_CDI_2336 number: 1 } })"""
+      }
+    )
+);
+
 }  // namespace
 }  // namespace cue2pb
@@ -0,0 +1,428 @@
+#include "cue2pb/visitor.h"
+
+#include <algorithm>
+#include <string_view>
+#include <utility>
+#include <stddef.h>
+
+#include "absl/algorithm/container.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_format.h"
+#include "absl/status/statusor.h"
+#include "cue2pb/keywords.h"
+#include "cue2pb/lines.h"
+#include "cue2pb/msf.h"
+#include "util/status_builder.h"
+#include "util/status_macros.h"
+
+namespace cue2pb {
+namespace {
+
+using File = ::cue2pb::Cuesheet::File;
+using Track = ::cue2pb::Cuesheet::Track;
+
+// The characters SplitLine() treats as whitespace.
+constexpr char kWhitespace[] = " \t\n\v\f\r";
+
+// How many lines FeedLines() splits at a time.
+constexpr size_t kMaxLines = 256;
+
+// How much FeedLines() first looks at. The window then doubles, up to
+// kSplitLinesWindow, so that a parse which stops early (see ParseOptions)
+// doesn't classify much more than it reads.
+constexpr size_t kFirstWindow = 512;
+
+absl::StatusOr<int> ParseInt(std::string_view str) {
+  int ret = -1;
+  if (!absl::SimpleAtoi(str, &ret)) {
+    return util::InvalidArgumentErrorBuilder()
+        << "Could not parse '" << str << "' as an int";
+  }
+  return ret;
+}
+
+absl::StatusOr<std::pair<std::string_view, std::string_view>>
+    ParseString(std::string_view cur) {
+  if (cur.empty() || cur[0] != '"') {
+    return util::InvalidArgumentErrorBuilder()
+        << "Expected a quoted string, not: '" << cur << "'";
+  }
+
+  int closequote_pos = -1;
+  for (size_t i = 1; i < cur.size(); i++) {
+    if (cur[i] == '"' && cur[i - 1] != '\\') {
+      closequote_pos = i;
+      break;
+    }
+  }
+
+  if (closequote_pos == -1) {
+    return util::InvalidArgumentErrorBuilder()
+        << "Couldn't find a closing quote in: '" << cur << "'";
+  }
+
+  return std::make_pair(
+      cur.substr(1, closequote_pos - 1),
+      cur.substr(closequote_pos + 1));
+}
+
+// Parses a string that is either quoted (with no trailing characters), or is
+// unquoted and consumes the entire input string.
+// If an error occurs, str is unmodified.
+absl::Status ParseOptionallyQuotedString(std::string_view *str) {
+  if (!str->empty() && (*str)[0] == '"') {
+    ASSIGN_OR_RETURN(auto p, ParseString(*str));
+    if (!p.second.empty()) {
+      return util::InvalidArgumentErrorBuilder()
+          << "Trailing garbage after performer: '" << p.second << "'";
+    }
+    *str = p.first;
+  }
+  return absl::OkStatus();
+}
+
+// Splits off the first whitespace-separated token of str, returning it and
+// what's left after the whitespace following it.
+std::pair<std::string_view, std::string_view> SplitToken(std::string_view str) {
+  Line line = SplitLine(str);
+  return std::make_pair(line.command(str), line.rest(str));
+}
+
+absl::StatusOr<int64_t> ParseFrames(std::string_view cur) {
+  int32_t minute, second, frame;
+  if (!DecodeMSF(cur, &minute, &second, &frame)) {
+    return util::InvalidArgumentErrorBuilder()
+        << "Could not parse '" << cur << "' as an MSF";
+  }
+  return MSFToFrames(minute, second, frame);
+}
+
+absl::Status ParseIndex(std::string_view cur, CuesheetVisitor *visitor) {
+  auto [indexno_str, msf_str] = SplitToken(cur);
+
+  ASSIGN_OR_RETURN(int32_t indexno, ParseInt(indexno_str));
+  ASSIGN_OR_RETURN(int64_t frames, ParseFrames(msf_str));
+  return visitor->OnIndex(indexno, frames);
+}
+
+absl::Status ParseFile(std::string_view cur, CuesheetVisitor *visitor) {
+  ASSIGN_OR_RETURN(auto p, ParseString(cur));
+  std::string_view path = p.first;
+  std::string_view type = absl::StripAsciiWhitespace(p.second);
+
+  File::Type file_type;
+  if (!ParseFileType(type, &file_type)) {
+    return util::InvalidArgumentErrorBuilder()
+        << "Unknown file type: '" << type << "'";
+  }
+  return visitor->OnFile(path, file_type);
+}
+
+absl::Status ParseTrack(std::string_view cur, CuesheetVisitor *visitor) {
+  auto [trackno_str, type_str] = SplitToken(cur);
+
+  ASSIGN_OR_RETURN(int32_t trackno, ParseInt(trackno_str));
+
+  Track::Type type;
+  if (!ParseTrackType(type_str, &type)) {
+    return util::InvalidArgumentErrorBuilder()
+        << "Unknown track type: '" << type_str << "'";
+  }
+  return visitor->OnTrack(trackno, type);
+}
+
+absl::Status ParseComment(std::string_view cur, CuesheetVisitor::Scope scope,
+                          CuesheetVisitor *visitor) {
+  // Some comments are special. Ones of the form REM <UPPER_TAG> ... are
+  // convention to specify additional tags that are not normally supported in
+  // cuesheets. Those are supported explicitly here. All other comments are
+  // dropped.
+
+  auto [key, value] = SplitToken(cur);
+  if (value.empty() || !absl::c_all_of(key, &absl::ascii_isupper)) {
+    // This is a non-tag comment.
+    return absl::OkStatus();
+  }
+
+  ParseOptionallyQuotedString(&value).IgnoreError();
+  return visitor->OnCommentTag(scope, key, value);
+}
+
+absl::Status ParseTag(std::string_view cur, CuesheetVisitor::Scope scope,
+                      CuesheetVisitor::Tag tag, CuesheetVisitor *visitor) {
+  RETURN_IF_ERROR(ParseOptionallyQuotedString(&cur));
+  return visitor->OnTag(scope, tag, cur);
+}
+
+absl::Status ParseCDTextFile(std::string_view cur, CuesheetVisitor *visitor) {
+  RETURN_IF_ERROR(ParseOptionallyQuotedString(&cur));
+  return visitor->OnCdTextFile(cur);
+}
+
+absl::Status ParsePregap(std::string_view cur, CuesheetVisitor *visitor) {
+  ASSIGN_OR_RETURN(int64_t frames, ParseFrames(cur));
+  return visitor->OnPregap(frames);
+}
+
+absl::Status ParsePostgap(std::string_view cur, CuesheetVisitor *visitor) {
+  ASSIGN_OR_RETURN(int64_t frames, ParseFrames(cur));
+  return visitor->OnPostgap(frames);
+}
+
+// Adds the fields that the ones asked for imply.
+uint32_t ImpliedFields(uint32_t fields) {
+  constexpr uint32_t kInTrack =
+      ParseOptions::kTrackTags | ParseOptions::kIsrc | ParseOptions::kFlags |
+      ParseOptions::kIndices | ParseOptions::kGaps;
+  if (fields & kInTrack) fields |= ParseOptions::kTracks;
+  if (fields & ParseOptions::kTracks) fields |= ParseOptions::kFiles;
+  return fields & ParseOptions::kAll;
+}
+
+absl::Status ParseFlags(std::string_view cur, CuesheetVisitor *visitor) {
+  for (std::string_view flag_str :
+       absl::StrSplit(cur, absl::ByAnyChar(kWhitespace), absl::SkipEmpty())) {
+    Track::Flag flag;
+    if (!ParseTrackFlag(flag_str, &flag)) {
+      return util::InvalidArgumentErrorBuilder()
+          << "Unknown flag: '" << flag_str << "'";
+    }
+    RETURN_IF_ERROR(visitor->OnFlag(flag));
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+absl::Status CuesheetVisitor::OnCatalog(std::string_view catalog) {
+  return absl::OkStatus();
+}
+
+absl::Status CuesheetVisitor::OnCdTextFile(std::string_view path) {
+  return absl::OkStatus();
+}
+
+absl::Status CuesheetVisitor::OnFile(std::string_view path, File::Type type) {
+  return absl::OkStatus();
+}
+
+absl::Status CuesheetVisitor::OnTrack(int32_t number, Track::Type type) {
+  return absl::OkStatus();
+}
+
+absl::Status CuesheetVisitor::OnIndex(int32_t number, int64_t frames) {
+  return absl::OkStatus();
+}
+
+absl::Status CuesheetVisitor::OnPregap(int64_t frames) {
+  return absl::OkStatus();
+}
+
+absl::Status CuesheetVisitor::OnPostgap(int64_t frames) {
+  return absl::OkStatus();
+}
+
+absl::Status CuesheetVisitor::OnIsrc(std::string_view isrc) {
+  return absl::OkStatus();
+}
+
+absl::Status CuesheetVisitor::OnFlag(Track::Flag flag) {
+  return absl::OkStatus();
+}
+
+absl::Status CuesheetVisitor::OnTag(Scope scope, Tag tag,
+                                    std::string_view value) {
+  return absl::OkStatus();
+}
+
+absl::Status CuesheetVisitor::OnCommentTag(Scope scope, std::string_view name,
+                                           std::string_view value) {
+  return absl::OkStatus();
+}
+
+CuesheetTokenizer::CuesheetTokenizer(CuesheetVisitor *visitor,
+                                     const ParseOptions &options)
+  : visitor_(visitor),
+    fields_(ImpliedFields(options.fields)),
+    done_(fields_ == 0)
+    {}
+
+absl::Status CuesheetTokenizer::NotInFileError() const {
+  return absl::InvalidArgumentError("No files (yet) in this cuesheet");
+}
+
+absl::Status CuesheetTokenizer::NotInTrackError() const {
+  if (scope_ == Scope::kDisc) return NotInFileError();
+  return util::InvalidArgumentErrorBuilder()
+      << "No tracks (yet) in the FILE block on line " << file_lineno_;
+}
+
+absl::Status CuesheetTokenizer::DispatchLine(std::string_view command,
+                                             std::string_view rest) {
+  using VisitorScope = CuesheetVisitor::Scope;
+  using Tag = CuesheetVisitor::Tag;
+
+  if (command.empty()) return absl::OkStatus();
+
+  // Tags apply to the current track if there is one, otherwise to the disc.
+  VisitorScope tag_scope = VisitorScope::kDisc;
+  uint32_t tag_field = ParseOptions::kDiscTags;
+  if (scope_ == Scope::kTrack) {
+    tag_scope = VisitorScope::kTrack;
+    tag_field = ParseOptions::kTrackTags;
+  }
+
+  switch (ParseCommand(command)) {
+    case Command::kCatalog:
+      if (!Wants(ParseOptions::kCatalog)) return absl::OkStatus();
+      return visitor_->OnCatalog(rest);
+    case Command::kCdTextFile:
+      if (!Wants(ParseOptions::kCdTextFile)) return absl::OkStatus();
+      return ParseCDTextFile(rest, visitor_);
+    case Command::kFile:
+      scope_ = Scope::kFile;
+      file_lineno_ = lineno_;
+      if (!Wants(ParseOptions::kFiles)) return absl::OkStatus();
+      return ParseFile(rest, visitor_);
+    case Command::kFlags:
+      if (scope_ != Scope::kTrack) return NotInTrackError();
+      if (!Wants(ParseOptions::kFlags)) return absl::OkStatus();
+      return ParseFlags(rest, visitor_);
+    case Command::kIndex:
+      if (scope_ != Scope::kTrack) return NotInTrackError();
+      if (!Wants(ParseOptions::kIndices)) return absl::OkStatus();
+      return ParseIndex(rest, visitor_);
+    case Command::kIsrc:
+      if (scope_ != Scope::kTrack) return NotInTrackError();
+      if (!Wants(ParseOptions::kIsrc)) return absl::OkStatus();
+      return visitor_->OnIsrc(rest);
+    case Command::kPerformer:
+      if (!Wants(tag_field)) return absl::OkStatus();
+      return ParseTag(rest, tag_scope, Tag::kPerformer, visitor_);
+    case Command::kPostgap:
+      if (scope_ != Scope::kTrack) return NotInTrackError();
+      if (!Wants(ParseOptions::kGaps)) return absl::OkStatus();
+      return ParsePostgap(rest, visitor_);
+    case Command::kPregap:
+      if (scope_ != Scope::kTrack) return NotInTrackError();
+      if (!Wants(ParseOptions::kGaps)) return absl::OkStatus();
+      return ParsePregap(rest, visitor_);
+    case Command::kRem:
+      if (!Wants(tag_field)) return absl::OkStatus();
+      return ParseComment(rest, tag_scope, visitor_);
+    case Command::kSongwriter:
+      if (!Wants(tag_field)) return absl::OkStatus();
+      return ParseTag(rest, tag_scope, Tag::kSongwriter, visitor_);
+    case Command::kTitle:
+      if (!Wants(tag_field)) return absl::OkStatus();
+      return ParseTag(rest, tag_scope, Tag::kTitle, visitor_);
+    case Command::kTrack:
+      if (scope_ == Scope::kDisc) return NotInFileError();
+      scope_ = Scope::kTrack;
+      if (!Wants(ParseOptions::kTracks)) return absl::OkStatus();
+      return ParseTrack(rest, visitor_);
+    case Command::kUnknown:
+      break;
+  }
+
+  return util::InvalidArgumentErrorBuilder()
+      << "Invalid command: '" << command << "'";
+}
+
+absl::Status CuesheetTokenizer::ParseLine(std::string_view input,
+                                          const Line &line) {
+  ++lineno_;
+  absl::Status st = DispatchLine(line.command(input), line.rest(input));
+  if (!st.ok()) {
+    status_ = absl::Status(
+        st.code(),
+        absl::StrFormat("Error on line %d: %s", lineno_, st.message()));
+  }
+  return status_;
+}
+
+absl::Status CuesheetTokenizer::FeedLines(std::string_view *chunk) {
+  RETURN_IF_ERROR(status_);
+  if (finished_) {
+    return absl::FailedPreconditionError("Cuesheet already finished");
+  }
+
+  if (done_) {
+    // Nothing that was asked for can follow, so don't even look for lines.
+    *chunk = {};
+    return absl::OkStatus();
+  }
+
+  if (!partial_line_.empty()) {
+    // Complete the line left over from the last chunk before anything else.
+    size_t eol = chunk->find('\n');
+    if (eol == std::string_view::npos) {
+      partial_line_.append(chunk->data(), chunk->size());
+      *chunk = {};
+      return absl::OkStatus();
+    }
+    partial_line_.append(chunk->data(), eol);
+    RETURN_IF_ERROR(ParseLine(partial_line_, SplitLine(partial_line_)));
+    partial_line_.clear();
+    chunk->remove_prefix(eol + 1);
+  }
+
+  Line lines[kMaxLines];
+  size_t window = kFirstWindow;
+  while (!done_ && !chunk->empty()) {
+    size_t consumed;
+    size_t n =
+        SplitLines(chunk->substr(0, window), lines, kMaxLines, &consumed);
+    if (n == 0 && window < std::min(chunk->size(), kSplitLinesWindow)) {
+      window *= 2;
+      continue;
+    }
+    window = std::min(window * 2, kSplitLinesWindow);
+
+    if (n == 0) {
+      // Either there are no more complete lines, or the next is too long for
+      // SplitLines().
+      size_t eol = chunk->find('\n');
+      if (eol == std::string_view::npos) break;
+      std::string_view line = chunk->substr(0, eol);
+      RETURN_IF_ERROR(ParseLine(line, SplitLine(line)));
+      chunk->remove_prefix(eol + 1);
+      continue;
+    }
+
+    for (size_t i = 0; i < n && !done_; i++) {
+      RETURN_IF_ERROR(ParseLine(*chunk, lines[i]));
+    }
+    chunk->remove_prefix(consumed);
+  }
+  if (done_) *chunk = {};
+  return absl::OkStatus();
+}
+
+absl::Status CuesheetTokenizer::Feed(std::string_view chunk) {
+  RETURN_IF_ERROR(FeedLines(&chunk));
+  partial_line_.append(chunk.data(), chunk.size());
+  return absl::OkStatus();
+}
+
+absl::Status CuesheetTokenizer::Finish(std::string_view chunk) {
+  RETURN_IF_ERROR(FeedLines(&chunk));
+  finished_ = true;
+  if (!partial_line_.empty() && !done_) {
+    partial_line_.append(chunk.data(), chunk.size());
+    chunk = partial_line_;
+  }
+  if (!chunk.empty()) RETURN_IF_ERROR(ParseLine(chunk, SplitLine(chunk)));
+  partial_line_.clear();
+  partial_line_.shrink_to_fit();
+  return absl::OkStatus();
+}
+
+absl::Status VisitCuesheet(std::string_view input, CuesheetVisitor *visitor,
+                           const ParseOptions &options) {
+  return CuesheetTokenizer(visitor, options).Finish(input);
+}
+
+}  // namespace cue2pb
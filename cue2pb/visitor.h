@@ -0,0 +1,151 @@
+#ifndef CUE2PB_VISITOR_H_
+#define CUE2PB_VISITOR_H_
+
+#include <string>
+#include <string_view>
+#include <stdint.h>
+
+#include "cue2pb/cuesheet.pb.h"
+#include "cue2pb/lines.h"
+#include "absl/status/status.h"
+
+namespace cue2pb {
+
+// Receives the commands of a cuesheet, in order, as they are parsed. Strings
+// point into the input, and are only valid for the duration of the call.
+// Positions are in frames since 00:00:00 (see msf.h).
+//
+// By the time a command is delivered it has been checked against the ones
+// before it: e.g. OnIndex() is only called inside a TRACK, and OnTrack() only
+// inside a FILE. Every method does nothing by default, so a visitor only needs
+// to override what it uses. Returning an error stops the parse, and the error
+// is returned annotated with its line number.
+class CuesheetVisitor {
+ public:
+  // What TITLE, PERFORMER, SONGWRITER and REM tags apply to.
+  enum class Scope {
+    kDisc,
+    kTrack,
+  };
+
+  enum class Tag {
+    kTitle,
+    kPerformer,
+    kSongwriter,
+  };
+
+  virtual ~CuesheetVisitor() = default;
+
+  virtual absl::Status OnCatalog(std::string_view catalog);
+  virtual absl::Status OnCdTextFile(std::string_view path);
+  virtual absl::Status OnFile(std::string_view path,
+                              Cuesheet::File::Type type);
+  virtual absl::Status OnTrack(int32_t number, Cuesheet::Track::Type type);
+  virtual absl::Status OnIndex(int32_t number, int64_t frames);
+  virtual absl::Status OnPregap(int64_t frames);
+  virtual absl::Status OnPostgap(int64_t frames);
+  virtual absl::Status OnIsrc(std::string_view isrc);
+  // Called once for each flag on a FLAGS line.
+  virtual absl::Status OnFlag(Cuesheet::Track::Flag flag);
+  virtual absl::Status OnTag(Scope scope, Tag tag, std::string_view value);
+  // A comment of the form REM <UPPER_TAG> <value>. Other comments are dropped.
+  virtual absl::Status OnCommentTag(Scope scope, std::string_view name,
+                                    std::string_view value);
+};
+
+// Which parts of a cuesheet to parse. Commands for fields that weren't asked
+// for are skipped without parsing their arguments. Disc-level commands may
+// follow any FILE, so even when only disc-level fields are wanted, every line
+// is looked at; only when no fields are wanted is the input ignored.
+//
+// Skipped commands aren't validated beyond their keyword and scope, and
+// ignored input isn't validated at all, so input that fails a full parse may
+// parse with a projection.
+struct ParseOptions {
+  // Fields of cuesheet.proto.
+  enum Field : uint32_t {
+    kCatalog = 1 << 0,
+    kCdTextFile = 1 << 1,
+    kDiscTags = 1 << 2,  // Cuesheet.tags.
+    kFiles = 1 << 3,  // File.path and File.type.
+    kTracks = 1 << 4,  // Track.number and Track.type.
+    kTrackTags = 1 << 5,  // Track.tags.
+    kIsrc = 1 << 6,
+    kFlags = 1 << 7,
+    kIndices = 1 << 8,
+    kGaps = 1 << 9,  // Track.pregap and Track.postgap.
+
+    kDisc = kCatalog | kCdTextFile | kDiscTags,
+    kAll = (1 << 10) - 1,
+  };
+
+  // A bitwise or of Fields. Fields inside a track imply kTracks, and kTracks
+  // implies kFiles, so that what was asked for has somewhere to go.
+  uint32_t fields = kAll;
+
+  // Whether to store positions compactly, in Index.frames and
+  // Track.{pre,post}gap_frames, rather than as MSFs. Positions too far in to
+  // fit an int32 of frames are stored as MSFs regardless.
+  bool compact_positions = false;
+};
+
+// Tokenizes a cuesheet into calls on a CuesheetVisitor, either all at once
+// with VisitCuesheet() below, or incrementally from chunks of input. Each
+// complete line is parsed in place as soon as it is fed; only a trailing
+// incomplete line is copied, and held until the rest of it arrives.
+//
+// The first error is sticky: it is returned from every later call. Once
+// Finish() has been called, nothing more can be fed.
+class CuesheetTokenizer {
+ public:
+  // visitor is not owned, and must outlive the tokenizer.
+  explicit CuesheetTokenizer(CuesheetVisitor *visitor,
+                             const ParseOptions &options = ParseOptions());
+
+  CuesheetTokenizer(const CuesheetTokenizer&) = delete;
+  CuesheetTokenizer &operator=(const CuesheetTokenizer&) = delete;
+
+  absl::Status Feed(std::string_view chunk);
+
+  // Feeds the last chunk of input, whose last line needn't end in a newline,
+  // and parses whatever is left.
+  absl::Status Finish(std::string_view chunk = {});
+
+  // Whether everything asked for by ParseOptions has been parsed, and the
+  // rest of the input will be ignored.
+  bool done() const { return done_; }
+
+ private:
+  enum class Scope {
+    kDisc,  // Before the first FILE.
+    kFile,  // After a FILE, but before its first TRACK.
+    kTrack,
+  };
+
+  // Feeds the complete lines of chunk, and returns what follows the last one.
+  absl::Status FeedLines(std::string_view *chunk);
+  absl::Status ParseLine(std::string_view input, const Line &line);
+  absl::Status DispatchLine(std::string_view command, std::string_view rest);
+  bool Wants(uint32_t fields) const { return (fields_ & fields) != 0; }
+
+  absl::Status NotInFileError() const;
+  absl::Status NotInTrackError() const;
+
+  CuesheetVisitor *visitor_;
+  uint32_t fields_;
+  Scope scope_ = Scope::kDisc;
+  int lineno_ = 0;
+  int file_lineno_ = 0;
+  std::string partial_line_;
+  bool finished_ = false;
+  bool done_ = false;
+  absl::Status status_;
+};
+
+// Parses a cuesheet held entirely in memory, calling visitor for each command.
+absl::Status VisitCuesheet(std::string_view input, CuesheetVisitor *visitor,
+                           const ParseOptions &options = ParseOptions());
+
+}  // namespace cue2pb
+
+#endif  // CUE2PB_VISITOR_H_
@@ -0,0 +1,176 @@
+#include "cue2pb/visitor.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "absl/strings/str_cat.h"
+#include "util/file.h"
+#include "util/testing/assertions.h"
+
+namespace cue2pb {
+
+using ::util::IsOk;
+
+namespace {
+
+using Scope = CuesheetVisitor::Scope;
+using Tag = CuesheetVisitor::Tag;
+
+// Records every event as a line of text.
+class RecordingVisitor : public CuesheetVisitor {
+ public:
+  absl::Status OnCatalog(std::string_view catalog) override {
+    return Record(absl::StrCat("catalog ", catalog));
+  }
+  absl::Status OnCdTextFile(std::string_view path) override {
+    return Record(absl::StrCat("cdtextfile ", path));
+  }
+  absl::Status OnFile(std::string_view path,
+                      Cuesheet::File::Type type) override {
+    return Record(absl::StrCat("file ", path, " ", type));
+  }
+  absl::Status OnTrack(int32_t number, Cuesheet::Track::Type type) override {
+    return Record(absl::StrCat("track ", number, " ", type));
+  }
+  absl::Status OnIndex(int32_t number, int64_t frames) override {
+    return Record(absl::StrCat("index ", number, " ", frames));
+  }
+  absl::Status OnPregap(int64_t frames) override {
+    return Record(absl::StrCat("pregap ", frames));
+  }
+  absl::Status OnPostgap(int64_t frames) override {
+    return Record(absl::StrCat("postgap ", frames));
+  }
+  absl::Status OnIsrc(std::string_view isrc) override {
+    return Record(absl::StrCat("isrc ", isrc));
+  }
+  absl::Status OnFlag(Cuesheet::Track::Flag flag) override {
+    return Record(absl::StrCat("flag ", flag));
+  }
+  absl::Status OnTag(Scope scope, Tag tag, std::string_view value) override {
+    return Record(absl::StrCat(scope == Scope::kDisc ? "disc " : "track ",
+                               "tag ", static_cast<int>(tag), " ", value));
+  }
+  absl::Status OnCommentTag(Scope scope, std::string_view name,
+                            std::string_view value) override {
+    return Record(absl::StrCat(scope == Scope::kDisc ? "disc " : "track ",
+                               "rem ", name, " ", value));
+  }
+
+  std::vector<std::string> events;
+
+ private:
+  absl::Status Record(std::string event) {
+    events.push_back(std::move(event));
+    return absl::OkStatus();
+  }
+};
+
+TEST(VisitCuesheetTest, DeliversEveryCommand) {
+  RecordingVisitor visitor;
+  ASSERT_TRUE(IsOk(VisitCuesheet(R"""(
+    REM GENRE Ska
+    REM a plain comment
+    CATALOG 0123456789012
+    CDTEXTFILE "disc.cdt"
+    PERFORMER "The Specials"
+    FILE "The Specials - Singles.wav" WAVE
+      TITLE "Disc"
+      TRACK 01 AUDIO
+        TITLE "Gangsters"
+        REM COMPOSER "Jerry Dammers"
+        FLAGS DCP PRE
+        ISRC GBAAA7900001
+        PREGAP 00:02:00
+        INDEX 01 01:02:03
+        POSTGAP 00:00:01
+  )""", &visitor)));
+
+  const std::vector<std::string> expected = {
+    "disc rem GENRE Ska",
+    "catalog 0123456789012",
+    "cdtextfile disc.cdt",
+    "disc tag 1 The Specials",
+    "file The Specials - Singles.wav 1",
+    "disc tag 0 Disc",
+    "track 1 1",
+    "track tag 0 Gangsters",
+    "track rem COMPOSER Jerry Dammers",
+    "flag 1",
+    "flag 3",
+    "isrc GBAAA7900001",
+    "pregap 150",
+    "index 1 4653",
+    "postgap 1",
+  };
+  EXPECT_EQ(expected, visitor.events);
+}
+
+TEST(VisitCuesheetTest, DefaultVisitorIgnoresEverything) {
+  absl::StatusOr<util::MappedFile> mapped =
+      util::MappedFile::Open("cue2pb/testdata/full_disc.cue");
+  ASSERT_TRUE(IsOk(mapped));
+
+  CuesheetVisitor visitor;
+  EXPECT_TRUE(IsOk(VisitCuesheet(mapped->contents(), &visitor)));
+}
+
+TEST(VisitCuesheetTest, ChecksScope) {
+  for (const char *cuesheet : {
+      "INDEX 01 00:00:00\n",
+      "FILE \"foo.wav\" WAVE\nISRC USRC17607839\n",
+      "TRACK 01 AUDIO\n"}) {
+    RecordingVisitor visitor;
+    EXPECT_FALSE(IsOk(VisitCuesheet(cuesheet, &visitor))) << cuesheet;
+  }
+}
+
+// Counts tracks, stopping at the first track with an ISRC.
+class FirstIsrcVisitor : public CuesheetVisitor {
+ public:
+  absl::Status OnTrack(int32_t number, Cuesheet::Track::Type type) override {
+    tracks++;
+    return absl::OkStatus();
+  }
+  absl::Status OnIsrc(std::string_view isrc) override {
+    return absl::CancelledError(isrc);
+  }
+
+  int tracks = 0;
+};
+
+TEST(VisitCuesheetTest, VisitorErrorsStopParsing) {
+  FirstIsrcVisitor visitor;
+  absl::Status st = VisitCuesheet(
+      "FILE \"foo.wav\" WAVE\n"
+      "TRACK 01 AUDIO\n"
+      "TRACK 02 AUDIO\n"
+      "ISRC USRC17607839\n"
+      "TRACK 03 AUDIO\n",
+      &visitor);
+  EXPECT_EQ(absl::StatusCode::kCancelled, st.code());
+  EXPECT_EQ("Error on line 4: USRC17607839", st.message());
+  EXPECT_EQ(2, visitor.tracks);
+}
+
+TEST(CuesheetTokenizerTest, FeedsAcrossChunks) {
+  RecordingVisitor visitor;
+  CuesheetTokenizer tokenizer(&visitor);
+  ASSERT_TRUE(IsOk(tokenizer.Feed("FILE \"a.wav\" WA")));
+  EXPECT_TRUE(visitor.events.empty());
+  ASSERT_TRUE(IsOk(tokenizer.Feed("VE\nTRACK 01 AUDIO\nINDEX 01 00:")));
+  ASSERT_TRUE(IsOk(tokenizer.Finish("00:01")));
+
+  const std::vector<std::string> expected = {
+    "file a.wav 1",
+    "track 1 1",
+    "index 1 1",
+  };
+  EXPECT_EQ(expected, visitor.events);
+  EXPECT_FALSE(IsOk(tokenizer.Feed("TITLE foo\n")));
+}
+
+}  // namespace
+}  // namespace cue2pb
@@ -1,6 +1,16 @@
 #include "util/file.h"
 
+#include <atomic>
 #include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "util/errno.h"
 #include "util/status_builder.h"
@@ -23,4 +33,125 @@ absl::StatusOr<std::ifstream> OpenInputFile(std::string_view path,
   return std::move(istrm);
 }
 
+absl::Status WriteFully(int fd, std::string_view data) {
+  while (!data.empty()) {
+    ssize_t written = write(fd, data.data(), data.size());
+    if (written == -1) {
+      if (errno == EINTR) continue;
+      return util::StatusBuilder(ErrnoAsStatus()) << "Failed to write";
+    }
+    data.remove_prefix(static_cast<size_t>(written));
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<int> CreateTempFile(std::string_view path,
+                                   std::string *tmp_path) {
+  static std::atomic<uint64_t> counter{0};
+  *tmp_path = absl::StrFormat("%s.tmp.%d.%d", path, getpid(),
+                              counter.fetch_add(1));
+
+  int fd = open(tmp_path->c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                0666);
+  if (fd == -1) {
+    return util::StatusBuilder(ErrnoAsStatus()) << "Failed to create "
+                                                << *tmp_path;
+  }
+  return fd;
+}
+
+absl::Status WriteFile(std::string_view path, std::string_view contents) {
+  std::string tmp_path;
+  absl::StatusOr<int> fd_or = CreateTempFile(path, &tmp_path);
+  if (!fd_or.ok()) return fd_or.status();
+  int fd = *fd_or;
+
+  absl::Status st = WriteFully(fd, contents);
+  if (close(fd) == -1 && st.ok()) st = ErrnoAsStatus();
+  if (st.ok() && rename(tmp_path.c_str(), std::string(path).c_str()) == -1) {
+    st = ErrnoAsStatus();
+  }
+  if (!st.ok()) {
+    unlink(tmp_path.c_str());
+    return util::StatusBuilder(st) << "Failed to write " << path;
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<MappedFile> MappedFile::Open(std::string_view path) {
+  int fd = open(std::string(path).c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return util::StatusBuilder(ErrnoAsStatus()) << "Failed to open " << path;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    absl::Status err = ErrnoAsStatus();
+    close(fd);
+    return util::StatusBuilder(err) << "Failed to stat " << path;
+  }
+
+  if (!S_ISREG(st.st_mode)) {
+    std::string buffer;
+    char chunk[64 * 1024];
+    for (;;) {
+      ssize_t n = read(fd, chunk, sizeof(chunk));
+      if (n == 0) break;
+      if (n == -1) {
+        if (errno == EINTR) continue;
+        absl::Status err = ErrnoAsStatus();
+        close(fd);
+        return util::StatusBuilder(err) << "Failed to read " << path;
+      }
+      buffer.append(chunk, static_cast<size_t>(n));
+    }
+    close(fd);
+    return MappedFile(std::move(buffer));
+  }
+
+  // mmap(2) refuses zero-length mappings, so empty files get an empty view.
+  size_t size = static_cast<size_t>(st.st_size);
+  void *data = nullptr;
+  if (size != 0) {
+    data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      absl::Status err = ErrnoAsStatus();
+      close(fd);
+      return util::StatusBuilder(err) << "Failed to mmap " << path;
+    }
+    madvise(data, size, MADV_SEQUENTIAL);
+  }
+  close(fd);
+
+  return MappedFile(data, size);
+}
+
+MappedFile::MappedFile(void *data, size_t size)
+  : data_(data), size_(size)
+  {}
+
+MappedFile::MappedFile(std::string buffer)
+  : buffer_(std::move(buffer))
+  {}
+
+MappedFile::MappedFile(MappedFile &&other)
+  : data_(std::exchange(other.data_, nullptr)),
+    size_(std::exchange(other.size_, 0)),
+    buffer_(std::move(other.buffer_))
+  {}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) {
+  if (this != &other) {
+    if (data_ != nullptr) munmap(data_, size_);
+    data_ = std::exchange(other.data_, nullptr);
+    size_ = std::exchange(other.size_, 0);
+    buffer_ = std::move(other.buffer_);
+  }
+  return *this;
+}
+
+MappedFile::~MappedFile() {
+  if (data_ != nullptr) munmap(data_, size_);
+}
+
 }  // namespace util
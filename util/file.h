@@ -3,7 +3,9 @@
 
 #include <fstream>
 #include <ios>
+#include <string>
 #include <string_view>
+#include <stddef.h>
 
 #include "absl/status/statusor.h"
 
@@ -13,6 +15,47 @@ absl::StatusOr<std::ifstream> OpenInputFile(std::string_view path);
 absl::StatusOr<std::ifstream> OpenInputFile(std::string_view path,
                                       std::ios_base::openmode mode);
 
+// Writes all of data to fd, retrying short and interrupted writes.
+absl::Status WriteFully(int fd, std::string_view data);
+
+// Creates a new, uniquely named file next to path, for writing and then
+// renaming over path. Returns its fd, and sets *tmp_path to its path.
+absl::StatusOr<int> CreateTempFile(std::string_view path,
+                                   std::string *tmp_path);
+
+// Replaces the file at path with contents. The contents are written to a
+// temporary file next to path, and renamed over it, so readers never see a
+// partially written file.
+absl::Status WriteFile(std::string_view path, std::string_view contents);
+
+// A read-only memory mapping of an entire file. The mapping is released when
+// the MappedFile is destroyed, invalidating any views into contents().
+//
+// Files that can't be mapped, like pipes, are read into memory instead.
+class MappedFile {
+ public:
+  static absl::StatusOr<MappedFile> Open(std::string_view path);
+
+  MappedFile(MappedFile &&other);
+  MappedFile &operator=(MappedFile &&other);
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  ~MappedFile();
+
+  std::string_view contents() const {
+    if (data_ == nullptr) return buffer_;
+    return {static_cast<const char*>(data_), size_};
+  }
+
+ private:
+  MappedFile(void *data, size_t size);
+  explicit MappedFile(std::string buffer);
+
+  void *data_ = nullptr;
+  size_t size_ = 0;
+  std::string buffer_;
+};
+
 }  // namespace util
 
 #endif  // UTIL_FILE_H_
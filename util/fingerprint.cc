@@ -0,0 +1,97 @@
+#include "util/fingerprint.h"
+
+#include <cstring>
+
+namespace util {
+namespace {
+
+constexpr uint64_t kPrime1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t kPrime3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t kPrime4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t kPrime5 = 0x27D4EB2F165667C5ULL;
+
+uint64_t RotateLeft(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+// Unaligned little-endian loads.
+uint64_t Load64(const char *p) {
+  unsigned char b[8];
+  std::memcpy(b, p, sizeof(b));
+  uint64_t value = 0;
+  for (int i = 7; i >= 0; i--) value = (value << 8) | b[i];
+  return value;
+}
+
+uint32_t Load32(const char *p) {
+  unsigned char b[4];
+  std::memcpy(b, p, sizeof(b));
+  return b[0] | (b[1] << 8) | (b[2] << 16) | (uint32_t{b[3]} << 24);
+}
+
+uint64_t Round(uint64_t acc, uint64_t input) {
+  acc += input * kPrime2;
+  acc = RotateLeft(acc, 31);
+  return acc * kPrime1;
+}
+
+uint64_t MergeRound(uint64_t acc, uint64_t val) {
+  acc ^= Round(0, val);
+  return acc * kPrime1 + kPrime4;
+}
+
+}  // namespace
+
+uint64_t Fingerprint64(std::string_view data) {
+  return Fingerprint64(data, 0);
+}
+
+uint64_t Fingerprint64(std::string_view data, uint64_t seed) {
+  const char *p = data.data();
+  const char *end = p + data.size();
+  uint64_t h;
+
+  if (data.size() >= 32) {
+    uint64_t v1 = seed + kPrime1 + kPrime2;
+    uint64_t v2 = seed + kPrime2;
+    uint64_t v3 = seed;
+    uint64_t v4 = seed - kPrime1;
+    for (; end - p >= 32; p += 32) {
+      v1 = Round(v1, Load64(p));
+      v2 = Round(v2, Load64(p + 8));
+      v3 = Round(v3, Load64(p + 16));
+      v4 = Round(v4, Load64(p + 24));
+    }
+    h = RotateLeft(v1, 1) + RotateLeft(v2, 7) + RotateLeft(v3, 12) +
+        RotateLeft(v4, 18);
+    h = MergeRound(h, v1);
+    h = MergeRound(h, v2);
+    h = MergeRound(h, v3);
+    h = MergeRound(h, v4);
+  } else {
+    h = seed + kPrime5;
+  }
+  h += data.size();
+
+  for (; end - p >= 8; p += 8) {
+    h ^= Round(0, Load64(p));
+    h = RotateLeft(h, 27) * kPrime1 + kPrime4;
+  }
+  if (end - p >= 4) {
+    h ^= Load32(p) * kPrime1;
+    h = RotateLeft(h, 23) * kPrime2 + kPrime3;
+    p += 4;
+  }
+  for (; p != end; p++) {
+    h ^= static_cast<unsigned char>(*p) * kPrime5;
+    h = RotateLeft(h, 11) * kPrime1;
+  }
+
+  h ^= h >> 33;
+  h *= kPrime2;
+  h ^= h >> 29;
+  h *= kPrime3;
+  h ^= h >> 32;
+  return h;
+}
+
+}  // namespace util
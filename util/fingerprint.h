@@ -0,0 +1,20 @@
+#ifndef UTIL_FINGERPRINT_H_
+#define UTIL_FINGERPRINT_H_
+
+#include <string_view>
+#include <stdint.h>
+
+namespace util {
+
+// A fast 64-bit hash of data that is stable across processes, builds and
+// machines, so it can be stored. This is XXH64 with a seed of zero. It is not
+// cryptographic.
+uint64_t Fingerprint64(std::string_view data);
+
+// As above, with a seed. Different seeds give independent hashes of the same
+// data.
+uint64_t Fingerprint64(std::string_view data, uint64_t seed);
+
+}  // namespace util
+
+#endif  // UTIL_FINGERPRINT_H_
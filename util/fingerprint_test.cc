@@ -0,0 +1,36 @@
+#include "util/fingerprint.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace util {
+namespace {
+
+// Reference values from the XXH64 implementation.
+TEST(Fingerprint64Test, MatchesXXH64) {
+  EXPECT_EQ(0xEF46DB3751D8E999ULL, Fingerprint64(""));
+  EXPECT_EQ(0xD24EC4F1A98C6E5BULL, Fingerprint64("a"));
+  EXPECT_EQ(0x44BC2CF5AD770999ULL, Fingerprint64("abc"));
+  EXPECT_EQ(0x0B242D361FDA71BCULL,
+            Fingerprint64("The quick brown fox jumps over the lazy dog"));
+
+  EXPECT_EQ(0xAC75FDA2929B17EFULL, Fingerprint64("", 2654435761));
+  EXPECT_EQ(0xBEA9CA8199328908ULL, Fingerprint64("abc", 1));
+  EXPECT_EQ(0xDF5091B6DAD2C6DBULL,
+            Fingerprint64("The quick brown fox jumps over the lazy dog", 1));
+}
+
+TEST(Fingerprint64Test, EveryLengthDiffers) {
+  std::string data;
+  uint64_t previous = Fingerprint64(data);
+  for (int i = 0; i < 100; i++) {
+    data.push_back(static_cast<char>(i));
+    uint64_t fingerprint = Fingerprint64(data);
+    EXPECT_NE(previous, fingerprint) << i;
+    previous = fingerprint;
+  }
+}
+
+}  // namespace
+}  // namespace util
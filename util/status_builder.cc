@@ -25,6 +25,9 @@ StatusBuilder FailedPreconditionErrorBuilder() {
 StatusBuilder NotFoundErrorBuilder() {
   return {absl::NotFoundError("")};
 }
+StatusBuilder DataLossErrorBuilder() {
+  return {absl::DataLossError("")};
+}
 
 StatusBuilder::StatusBuilder(const absl::Status &original)
   : status_(original)
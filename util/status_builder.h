@@ -37,6 +37,7 @@ StatusBuilder UnimplementedErrorBuilder();
 StatusBuilder InternalErrorBuilder();
 StatusBuilder FailedPreconditionErrorBuilder();
 StatusBuilder NotFoundErrorBuilder();
+StatusBuilder DataLossErrorBuilder();
 
 bool IsFailedPrecondition(const absl::Status &st);
 bool IsNotFound(const absl::Status &st);
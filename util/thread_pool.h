@@ -0,0 +1,42 @@
+#ifndef UTIL_THREAD_POOL_H_
+#define UTIL_THREAD_POOL_H_
+
+#include <deque>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+
+namespace util {
+
+// A fixed set of threads running closures from a shared FIFO queue.
+class ThreadPool {
+ public:
+  // num_threads <= 0 means one thread per CPU.
+  explicit ThreadPool(int num_threads);
+
+  // Runs everything already scheduled, then joins the threads.
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  void Schedule(std::function<void()> fn);
+
+  int num_threads() const { return static_cast<int>(threads_.size()); }
+
+ private:
+  bool ShouldWake() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+  void WorkLoop();
+
+  absl::Mutex mu_;
+  std::deque<std::function<void()>> queue_ ABSL_GUARDED_BY(mu_);
+  bool stopping_ ABSL_GUARDED_BY(mu_) = false;
+  std::vector<std::thread> threads_;
+};
+
+}  // namespace util
+
+#endif  // UTIL_THREAD_POOL_H_